@@ -18,32 +18,47 @@
  */
 
 /*
- * Because ALSA is not thread-safe (despite claims to the contrary) we use non-
- * blocking output in the pump thread with the mutex locked, then unlock the
- * mutex and wait for more room in the buffer with poll() while other threads
- * lock the mutex and read the output time.  We poll a pipe of our own as well
- * as the ALSA file descriptors so that we can wake up the pump thread when
- * needed.
+ * Because ALSA is not thread-safe (despite claims to the contrary) every call
+ * into it is made with the mutex locked.  The pump thread uses non-blocking
+ * output with the mutex locked, then unlocks the mutex and waits for more room
+ * in the buffer with poll().  We poll a pipe of our own as well as the ALSA
+ * file descriptors so that we can wake up the pump thread when needed.
+ *
+ * The software buffer between the playback thread and the pump, however, is a
+ * single-producer, single-consumer ring (see ring.h), so that writing audio,
+ * checking for free space, waiting for a period, and reading the output time
+ * never take the mutex and never wait behind a call into ALSA.  For the output
+ * time, the pump publishes the delay it last read from ALSA together with a
+ * timestamp, from which the current delay is extrapolated.
  *
  * When paused, or when it comes to the end of the data given it, the pump will
- * wait on alsa_cond for the signal to continue.  When it has more data waiting,
- * however, it will be sitting in poll() waiting for ALSA's signal that more
- * data can be written.
+ * sleep on pump_pipe alone.  When it has more data waiting, it will be sitting
+ * in poll() waiting for ALSA's signal that more data can be written.  The
+ * playback thread, when the ring is full (or while draining), sleeps on
+ * writer_pipe.  (See pump.h for how the pipes are used.)
+ *
+ * * After adding more data to the buffer, and after resuming from pause, call
+ *   pump_wake().  (There is no need to do so when entering pause.)
+ * * After taking data from the buffer, or emptying it, call writer_wake().
+ * * After setting the pump_quit flag, signal pump_pipe before joining the
+ *   thread.
+ * * If the pump gives up, it sets pump_failed and wakes the writer, which then
+ *   stops waiting for it until the next flush.
  *
- * * After adding more data to the buffer, and after resuming from pause,
- *   signal on alsa_cond to wake the pump.  (There is no need to signal when
- *   entering pause.)
- * * After setting the pump_quit flag, signal on alsa_cond AND the poll_pipe
- *   before joining the thread.
+ * The core never calls write_audio() at the same time as flush(), so the ring
+ * can safely be reset from flush() once the pump has been stopped.
  */
 
 #include <assert.h>
 #include <errno.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
 
 #include <alsa/asoundlib.h>
 
@@ -52,11 +67,17 @@
 #include <audacious/plugin.h>
 
 #include "alsa.h"
+#include "outstats.h"
+#include "pump.h"
+#include "ring.h"
 
 #define CHECK_VAL_RECOVER(value, function, ...) \
 do { \
     (value) = function (__VA_ARGS__); \
     if ((value) < 0) { \
+        if ((value) == -EPIPE) \
+            stats_count (& alsa_stats.underruns); \
+        stats_count (& alsa_stats.recoveries); \
         CHECK (snd_pcm_recover, alsa_handle, (value), 0); \
         CHECK_VAL ((value), function, __VA_ARGS__); \
     } \
@@ -76,19 +97,26 @@ static pthread_cond_t alsa_cond = PTHREAD_COND_INITIALIZER;
 static snd_pcm_format_t alsa_format;
 static int alsa_channels, alsa_rate;
 
-static void * alsa_buffer;
-static int alsa_buffer_length, alsa_buffer_data_start, alsa_buffer_data_length;
-static int alsa_period; /* milliseconds */
+static Ring alsa_ring;
+static int alsa_period; /* microseconds */
+static char alsa_mmap, alsa_low_latency, alsa_ring_locked;
+static int alsa_hw_buffer, alsa_hw_period; /* frames, as last negotiated */
 
+/* The following are shared with the pump (or with callers of output_time) and
+ * are accessed only through ATOMIC_GET and ATOMIC_SET. */
 static int64_t alsa_written; /* frames */
 static char alsa_prebuffer, alsa_paused;
 static int alsa_paused_delay; /* frames */
+static uint64_t alsa_delay; /* see delay_set () */
 
-static int poll_pipe[2];
+static WakePipe pump_pipe, writer_pipe;
 static int poll_count;
 static struct pollfd * poll_handles;
+static char alsa_draining;
+
+static OutputStats alsa_stats;
 
-static char pump_quit;
+static char pump_quit, pump_failed;
 static pthread_t pump_thread;
 
 static snd_mixer_t * alsa_mixer;
@@ -96,23 +124,18 @@ static snd_mixer_elem_t * alsa_mixer_element;
 
 static char poll_setup (void)
 {
-    if (pipe (poll_pipe))
-    {
-        ERROR ("Failed to create pipe: %s.\n", strerror (errno));
+    if (! wake_init (& pump_pipe))
         return 0;
-    }
 
-    if (fcntl (poll_pipe[0], F_SETFL, O_NONBLOCK))
+    if (! wake_init (& writer_pipe))
     {
-        ERROR ("Failed to set O_NONBLOCK on pipe: %s.\n", strerror (errno));
-        close (poll_pipe[0]);
-        close (poll_pipe[1]);
+        wake_free (& pump_pipe);
         return 0;
     }
 
     poll_count = 1 + snd_pcm_poll_descriptors_count (alsa_handle);
     poll_handles = malloc (sizeof (struct pollfd) * poll_count);
-    poll_handles[0].fd = poll_pipe[0];
+    poll_handles[0].fd = pump_pipe.fds[0];
     poll_handles[0].events = POLLIN;
     poll_count = 1 + snd_pcm_poll_descriptors (alsa_handle, poll_handles + 1,
      poll_count - 1);
@@ -124,82 +147,249 @@ static void poll_sleep (void)
 {
     if (poll (poll_handles, poll_count, -1) < 0)
     {
-        ERROR ("Failed to poll: %s.\n", strerror (errno));
+        if (errno != EINTR)
+            ERROR ("Failed to poll: %s.\n", strerror (errno));
+
         return;
     }
 
     if (poll_handles[0].revents & POLLIN)
+        wake_clear (& pump_pipe);
+}
+
+static void poll_cleanup (void)
+{
+    wake_free (& pump_pipe);
+    wake_free (& writer_pipe);
+    free (poll_handles);
+}
+
+static void pump_wake (void)
+{
+    wake_up (& pump_pipe);
+}
+
+static void writer_wake (void)
+{
+    wake_up (& writer_pipe);
+}
+
+static int filled_frames (void)
+{
+    return snd_pcm_bytes_to_frames (alsa_handle, ring_filled (& alsa_ring));
+}
+
+static char pump_ready (void)
+{
+    return ! ATOMIC_GET (pump_quit) && ! ATOMIC_GET (alsa_prebuffer) &&
+     ! ATOMIC_GET (alsa_paused) && filled_frames ();
+}
+
+/* called without the mutex, when there is nothing to write */
+static void pump_wait (void)
+{
+    ATOMIC_SET (pump_pipe.waiting, 1);
+
+    if (! pump_ready ())
+        wake_sleep (& pump_pipe);
+
+    ATOMIC_SET (pump_pipe.waiting, 0);
+}
+
+static int get_delay (void)
+{
+    snd_pcm_sframes_t delay = 0;
+
+    CHECK_RECOVER (snd_pcm_delay, alsa_handle, & delay);
+
+FAILED:
+    return delay;
+}
+
+/* In mmap mode, copies straight from the ring into the hardware buffer, saving
+ * the extra copy made by snd_pcm_writei.  snd_pcm_mmap_begin only offers the
+ * run up to the end of the hardware buffer, so we go around again after a
+ * wrap.  Unlike snd_pcm_writei, this does not start the stream by itself. */
+static snd_pcm_sframes_t mmap_write (snd_pcm_t * handle, const void * data,
+ snd_pcm_uframes_t frames)
+{
+    snd_pcm_sframes_t total = 0;
+    int error;
+
+    while (total < frames)
     {
-        char c;
-        while (read (poll_pipe[0], & c, 1) == 1)
-            ;
+        const snd_pcm_channel_area_t * areas;
+        snd_pcm_uframes_t offset;
+        snd_pcm_uframes_t run = frames - total;
+
+        if ((error = snd_pcm_mmap_begin (handle, & areas, & offset, & run)) < 0)
+            return total ? total : error;
+
+        if (! run)
+            break;
+
+        /* interleaved: one area, with <first> and <step> in bits */
+        memcpy ((char *) areas[0].addr + (areas[0].first + offset *
+         areas[0].step) / 8, (const char *) data + snd_pcm_frames_to_bytes
+         (handle, total), snd_pcm_frames_to_bytes (handle, run));
+
+        snd_pcm_sframes_t written = snd_pcm_mmap_commit (handle, offset, run);
+
+        if (written < 0)
+            return total ? total : written;
+
+        total += written;
+
+        if (written < run)
+            break;
     }
+
+    if (total > 0 && snd_pcm_state (handle) == SND_PCM_STATE_PREPARED &&
+     (error = snd_pcm_start (handle)) < 0)
+        return error;
+
+    return total;
 }
 
-static void poll_wake (void)
+static snd_pcm_sframes_t pump_write (snd_pcm_t * handle, const void * data,
+ snd_pcm_uframes_t frames)
 {
-    const char c = 0;
-    if (write (poll_pipe[1], & c, 1) < 0)
-        ERROR ("Failed to write to pipe: %s.\n", strerror (errno));
+    if (alsa_mmap)
+        return mmap_write (handle, data, frames);
+    else
+        return snd_pcm_writei (handle, data, frames);
 }
 
-static void poll_cleanup (void)
+#define RT_PRIORITY 10
+
+/* Moves the calling thread to SCHED_FIFO, at RT_PRIORITY or as close to it as
+ * RLIMIT_RTPRIO allows (raising the soft limit toward the hard one). */
+static void set_realtime (void)
 {
-    close (poll_pipe[0]);
-    close (poll_pipe[1]);
-    free (poll_handles);
+    struct rlimit limit;
+    int priority = RT_PRIORITY;
+
+    if (! getrlimit (RLIMIT_RTPRIO, & limit) && limit.rlim_cur != RLIM_INFINITY
+     && limit.rlim_cur < RT_PRIORITY && geteuid ())
+    {
+        if (limit.rlim_max > limit.rlim_cur)
+        {
+            struct rlimit raised = {.rlim_cur = MIN (limit.rlim_max,
+             RT_PRIORITY), .rlim_max = limit.rlim_max};
+
+            if (! setrlimit (RLIMIT_RTPRIO, & raised))
+                limit = raised;
+        }
+
+        priority = limit.rlim_cur;
+    }
+
+    priority = MAX (priority, sched_get_priority_min (SCHED_FIFO));
+
+    struct sched_param param = {.sched_priority = priority};
+    int error = pthread_setschedparam (pthread_self (), SCHED_FIFO, & param);
+
+    if (error)
+        ERROR ("Real-time scheduling not available: %s.\n", strerror (error));
+    else
+        AUDDBG ("Pump running with SCHED_FIFO priority %d.\n", priority);
+}
+
+/* Keeps the pump from page-faulting on the ring, raising the soft limit of
+ * RLIMIT_MEMLOCK toward the hard one if need be. */
+static void lock_ring (void)
+{
+    if (! mlock (alsa_ring.data, alsa_ring.size))
+    {
+        alsa_ring_locked = 1;
+        return;
+    }
+
+    struct rlimit limit;
+
+    if (! getrlimit (RLIMIT_MEMLOCK, & limit) && limit.rlim_max >
+     limit.rlim_cur)
+    {
+        struct rlimit raised = {.rlim_cur = limit.rlim_max, .rlim_max =
+         limit.rlim_max};
+
+        if (! setrlimit (RLIMIT_MEMLOCK, & raised) && ! mlock (alsa_ring.data,
+         alsa_ring.size))
+        {
+            alsa_ring_locked = 1;
+            return;
+        }
+    }
+
+    ERROR ("Failed to lock %d bytes of buffer in memory (see RLIMIT_MEMLOCK): "
+     "%s.\n", alsa_ring.size, strerror (errno));
 }
 
 static void * pump (void * unused)
 {
+    if (alsa_low_latency)
+        set_realtime ();
+
     pthread_mutex_lock (& alsa_mutex);
     pthread_cond_broadcast (& alsa_cond); /* signal thread started */
 
     char failed = 0;
     char workaround = 0;
+    char starved = 0;
     int slept = 0;
 
     while (! pump_quit)
     {
-        if (alsa_prebuffer || alsa_paused || ! snd_pcm_bytes_to_frames
-         (alsa_handle, alsa_buffer_data_length))
+        if (! pump_ready ())
         {
-            pthread_cond_wait (& alsa_cond, & alsa_mutex);
+            /* ran out of data while playing, other than at the end */
+            if (! starved && ! filled_frames () && ! ATOMIC_GET (alsa_prebuffer)
+             && ! ATOMIC_GET (alsa_paused) && ! ATOMIC_GET (alsa_draining))
+            {
+                stats_count (& alsa_stats.starvations);
+                starved = 1;
+            }
+
+            pthread_mutex_unlock (& alsa_mutex);
+            pump_wait ();
+            pthread_mutex_lock (& alsa_mutex);
+            stats_count (& alsa_stats.wakeups);
             continue;
         }
 
+        starved = 0;
+
         int length;
         CHECK_VAL_RECOVER (length, snd_pcm_avail_update, alsa_handle);
 
+        stats_fill (& alsa_stats.device, alsa_hw_buffer - length, alsa_hw_buffer);
+        stats_fill (& alsa_stats.ring, ring_filled (& alsa_ring), alsa_ring.size);
+
         if (! length)
             goto WAIT;
 
         slept = 0;
 
+        void * data;
         length = snd_pcm_frames_to_bytes (alsa_handle, length);
-        length = MIN (length, alsa_buffer_data_length);
-        length = MIN (length, alsa_buffer_length - alsa_buffer_data_start);
+        length = MIN (length, ring_peek (& alsa_ring, & data));
         length = snd_pcm_bytes_to_frames (alsa_handle, length);
 
         int written;
-        CHECK_VAL_RECOVER (written, snd_pcm_writei, alsa_handle, (char *)
-         alsa_buffer + alsa_buffer_data_start, length);
+        int64_t start = stats_now ();
+        CHECK_VAL_RECOVER (written, pump_write, alsa_handle, data, length);
+        stats_write_done (& alsa_stats, start);
 
         failed = 0;
 
-        written = snd_pcm_frames_to_bytes (alsa_handle, written);
-        alsa_buffer_data_start += written;
-        alsa_buffer_data_length -= written;
+        /* Publish the new delay before giving up the data, so that the output
+         * time may lag for a moment but never runs ahead. */
+        delay_set (& alsa_delay, get_delay ());
 
-        pthread_cond_broadcast (& alsa_cond); /* signal write complete */
+        ring_consume (& alsa_ring, snd_pcm_frames_to_bytes (alsa_handle, written));
+        writer_wake ();
 
-        if (alsa_buffer_data_start == alsa_buffer_length)
-        {
-            alsa_buffer_data_start = 0;
-            continue;
-        }
-
-        if (! snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer_data_length))
+        if (written == length)
             continue;
 
     WAIT:
@@ -213,7 +403,7 @@ static void * pump (void * unused)
 
         if (workaround && slept)
         {
-            const struct timespec delay = {.tv_sec = 0, .tv_nsec = 600000 *
+            const struct timespec delay = {.tv_sec = 0, .tv_nsec = 600 *
              alsa_period};
             nanosleep (& delay, NULL);
         }
@@ -224,11 +414,16 @@ static void * pump (void * unused)
         }
 
         pthread_mutex_lock (& alsa_mutex);
+        stats_count (& alsa_stats.wakeups);
         continue;
 
     FAILED:
         if (failed)
+        {
+            ATOMIC_SET (pump_failed, 1);
+            writer_wake ();
             break;
+        }
 
         failed = 1;
         CHECK (snd_pcm_prepare, alsa_handle);
@@ -241,6 +436,7 @@ static void * pump (void * unused)
 static void pump_start (void)
 {
     AUDDBG ("Starting pump.\n");
+    ATOMIC_SET (pump_failed, 0);
     pthread_create (& pump_thread, NULL, pump, NULL);
     pthread_cond_wait (& alsa_cond, & alsa_mutex);
 }
@@ -248,13 +444,12 @@ static void pump_start (void)
 static void pump_stop (void)
 {
     AUDDBG ("Stopping pump.\n");
-    pump_quit = 1;
-    pthread_cond_broadcast (& alsa_cond);
-    poll_wake ();
+    ATOMIC_SET (pump_quit, 1);
+    wake_signal (& pump_pipe);
     pthread_mutex_unlock (& alsa_mutex);
     pthread_join (pump_thread, NULL);
     pthread_mutex_lock (& alsa_mutex);
-    pump_quit = 0;
+    ATOMIC_SET (pump_quit, 0);
 }
 
 static void start_playback (void)
@@ -263,18 +458,9 @@ static void start_playback (void)
     CHECK (snd_pcm_prepare, alsa_handle);
 
 FAILED:
-    alsa_prebuffer = 0;
-    pthread_cond_broadcast (& alsa_cond);
-}
-
-static int get_delay (void)
-{
-    snd_pcm_sframes_t delay = 0;
-
-    CHECK_RECOVER (snd_pcm_delay, alsa_handle, & delay);
-
-FAILED:
-    return delay;
+    delay_set (& alsa_delay, 0);
+    ATOMIC_SET (alsa_prebuffer, 0);
+    pump_wake ();
 }
 
 int alsa_init (void)
@@ -359,8 +545,14 @@ int alsa_open_audio (int aud_format, int rate, int channels)
     snd_pcm_hw_params_t * params;
     snd_pcm_hw_params_alloca (& params);
     CHECK_NOISY (snd_pcm_hw_params_any, alsa_handle, params);
-    CHECK_NOISY (snd_pcm_hw_params_set_access, alsa_handle, params,
-     SND_PCM_ACCESS_RW_INTERLEAVED);
+
+    /* fall back to snd_pcm_writei for devices that cannot be mapped */
+    alsa_mmap = ! snd_pcm_hw_params_set_access (alsa_handle, params,
+     SND_PCM_ACCESS_MMAP_INTERLEAVED);
+
+    if (! alsa_mmap)
+        CHECK_NOISY (snd_pcm_hw_params_set_access, alsa_handle, params,
+         SND_PCM_ACCESS_RW_INTERLEAVED);
 
     CHECK_NOISY (snd_pcm_hw_params_set_format, alsa_handle, params, format);
     CHECK_NOISY (snd_pcm_hw_params_set_channels, alsa_handle, params, channels);
@@ -371,38 +563,86 @@ int alsa_open_audio (int aud_format, int rate, int channels)
     alsa_rate = rate;
 
     int total_buffer = aud_get_int (NULL, "output_buffer_size");
-    unsigned int useconds = 1000 * MIN (1000, total_buffer / 2);
     int direction = 0;
-    CHECK_NOISY (snd_pcm_hw_params_set_buffer_time_near, alsa_handle, params,
-     & useconds, & direction);
-    int hard_buffer = useconds / 1000;
+    alsa_low_latency = alsa_config_low_latency;
 
-    useconds = 1000 * (hard_buffer / 4);
-    direction = 0;
-    CHECK_NOISY (snd_pcm_hw_params_set_period_time_near, alsa_handle, params,
-     & useconds, & direction);
-    alsa_period = useconds / 1000;
+    if (alsa_low_latency)
+    {
+        /* ask for the period count explicitly; the hardware buffer is then
+         * just what those periods add up to */
+        unsigned int periods = alsa_config_periods;
+        snd_pcm_uframes_t period = MAX ((int64_t) rate * alsa_config_latency /
+         1000 / periods, 16);
+
+        CHECK_NOISY (snd_pcm_hw_params_set_period_size_near, alsa_handle,
+         params, & period, & direction);
+        direction = 0;
+        CHECK_NOISY (snd_pcm_hw_params_set_periods_near, alsa_handle, params,
+         & periods, & direction);
+    }
+    else
+    {
+        unsigned int useconds = 1000 * MIN (1000, total_buffer / 2);
+        CHECK_NOISY (snd_pcm_hw_params_set_buffer_time_near, alsa_handle,
+         params, & useconds, & direction);
+
+        useconds /= 4;
+        direction = 0;
+        CHECK_NOISY (snd_pcm_hw_params_set_period_time_near, alsa_handle,
+         params, & useconds, & direction);
+    }
 
     CHECK_NOISY (snd_pcm_hw_params, alsa_handle, params);
 
-    int soft_buffer = MAX (total_buffer / 2, total_buffer - hard_buffer);
-    AUDDBG ("Buffer: hardware %d ms, software %d ms, period %d ms.\n",
-     hard_buffer, soft_buffer, alsa_period);
+    snd_pcm_uframes_t buffer_frames, period_frames;
+    CHECK_NOISY (snd_pcm_hw_params_get_buffer_size, params, & buffer_frames);
+    CHECK_NOISY (snd_pcm_hw_params_get_period_size, params, & period_frames,
+     & direction);
+
+    alsa_hw_buffer = buffer_frames;
+    alsa_hw_period = period_frames;
+    alsa_period = (int64_t) period_frames * 1000000 / rate;
 
-    alsa_buffer_length = snd_pcm_frames_to_bytes (alsa_handle, (int64_t)
-     soft_buffer * rate / 1000);
-    alsa_buffer = malloc (alsa_buffer_length);
-    alsa_buffer_data_start = 0;
-    alsa_buffer_data_length = 0;
+    int hard_buffer = (int64_t) buffer_frames * 1000 / rate;
+    int soft_buffer;
+
+    /* The software buffer adds to the latency as much as the hardware one, so
+     * in low latency mode it follows the target rather than the buffer size
+     * set for the core; it also stays small enough to be locked in memory. */
+    if (alsa_low_latency)
+        soft_buffer = 2 * MAX (hard_buffer, alsa_config_latency);
+    else
+        soft_buffer = MAX (total_buffer / 2, total_buffer - hard_buffer);
+
+    AUDDBG ("Buffer: hardware %d frames (%d ms), period %d frames (%d us), "
+     "software %d ms, %s%s.\n", alsa_hw_buffer, hard_buffer, alsa_hw_period,
+     alsa_period, soft_buffer, alsa_mmap ? "mmap" : "writei", alsa_low_latency ?
+     ", low latency" : "");
+
+    if (alsa_low_latency && alsa_hw_buffer > (int64_t) rate *
+     alsa_config_latency / 1000 * 3 / 2)
+        ERROR ("Low latency: got a buffer of %d frames (%d ms) instead of %d "
+         "ms.\n", alsa_hw_buffer, hard_buffer, alsa_config_latency);
+
+    if (! poll_setup ())
+        goto FAILED;
+
+    ring_init (& alsa_ring, snd_pcm_frames_to_bytes (alsa_handle, (int64_t)
+     soft_buffer * rate / 1000));
+
+    alsa_ring_locked = 0;
+
+    if (alsa_low_latency)
+        lock_ring ();
 
     alsa_written = 0;
     alsa_prebuffer = 1;
     alsa_paused = 0;
     alsa_paused_delay = 0;
+    alsa_draining = 0;
+    delay_set (& alsa_delay, 0);
 
-    if (! poll_setup ())
-        goto FAILED;
-
+    stats_reset (& alsa_stats, "alsa");
     pump_start ();
 
     pthread_mutex_unlock (& alsa_mutex);
@@ -430,7 +670,12 @@ void alsa_close_audio (void)
     CHECK (snd_pcm_drop, alsa_handle);
 
 FAILED:
-    free (alsa_buffer);
+    stats_dump (& alsa_stats);
+
+    if (alsa_ring_locked)
+        munlock (alsa_ring.data, alsa_ring.size);
+
+    ring_free (& alsa_ring);
     poll_cleanup ();
     snd_pcm_close (alsa_handle);
     alsa_handle = NULL;
@@ -440,58 +685,62 @@ FAILED:
 
 int alsa_buffer_free (void)
 {
-    pthread_mutex_lock (& alsa_mutex);
-    int avail = alsa_buffer_length - alsa_buffer_data_length;
-    pthread_mutex_unlock (& alsa_mutex);
-    return avail;
+    return ring_space (& alsa_ring);
 }
 
 void alsa_write_audio (void * data, int length)
 {
-    pthread_mutex_lock (& alsa_mutex);
-
-    int start = (alsa_buffer_data_start + alsa_buffer_data_length) %
-     alsa_buffer_length;
+    assert (length <= ring_space (& alsa_ring));
 
-    assert (length <= alsa_buffer_length - alsa_buffer_data_length);
+    if (ATOMIC_GET (alsa_draining))
+        ATOMIC_SET (alsa_draining, 0);
 
-    if (length > alsa_buffer_length - start)
-    {
-        int part = alsa_buffer_length - start;
-
-        memcpy ((char *) alsa_buffer + start, data, part);
-        memcpy (alsa_buffer, (char *) data + part, length - part);
-    }
-    else
-        memcpy ((char *) alsa_buffer + start, data, length);
+    ring_write (& alsa_ring, data, length);
+    ATOMIC_SET (alsa_written, alsa_written + snd_pcm_bytes_to_frames
+     (alsa_handle, length));
 
-    alsa_buffer_data_length += length;
-    alsa_written += snd_pcm_bytes_to_frames (alsa_handle, length);
+    stats_poll (& alsa_stats);
 
-    if (! alsa_paused)
-        pthread_cond_broadcast (& alsa_cond);
+    if (! ATOMIC_GET (alsa_paused))
+        pump_wake ();
+}
 
-    pthread_mutex_unlock (& alsa_mutex);
+static char must_start (void)
+{
+    return ATOMIC_GET (alsa_prebuffer) && ! ATOMIC_GET (alsa_paused);
 }
 
 void alsa_period_wait (void)
 {
-    pthread_mutex_lock (& alsa_mutex);
+    if (ATOMIC_GET (pump_failed))
+    {
+        /* nothing to wait for; just keep the caller from spinning */
+        const struct timespec delay = {.tv_sec = 0, .tv_nsec = 1000 *
+         alsa_period};
+        nanosleep (& delay, NULL);
+        return;
+    }
 
-    while (alsa_buffer_data_length == alsa_buffer_length)
+    while (! ring_space (& alsa_ring) && ! ATOMIC_GET (pump_failed))
     {
-        if (! alsa_paused)
+        if (must_start ())
         {
-            if (alsa_prebuffer)
+            pthread_mutex_lock (& alsa_mutex);
+
+            if (must_start () && ! ring_space (& alsa_ring))
                 start_playback ();
-            else
-                pthread_cond_broadcast (& alsa_cond);
+
+            pthread_mutex_unlock (& alsa_mutex);
         }
 
-        pthread_cond_wait (& alsa_cond, & alsa_mutex);
-    }
+        ATOMIC_SET (writer_pipe.waiting, 1);
 
-    pthread_mutex_unlock (& alsa_mutex);
+        if (! ring_space (& alsa_ring) && ! must_start () && ! ATOMIC_GET
+         (pump_failed))
+            wake_sleep (& writer_pipe);
+
+        ATOMIC_SET (writer_pipe.waiting, 0);
+    }
 }
 
 void alsa_drain (void)
@@ -504,9 +753,21 @@ void alsa_drain (void)
     if (alsa_prebuffer)
         start_playback ();
 
-    while (snd_pcm_bytes_to_frames (alsa_handle, alsa_buffer_data_length))
-        pthread_cond_wait (& alsa_cond, & alsa_mutex);
+    pthread_mutex_unlock (& alsa_mutex);
+
+    ATOMIC_SET (alsa_draining, 1); /* until more data is written */
+
+    while (filled_frames () && ! ATOMIC_GET (pump_failed))
+    {
+        ATOMIC_SET (writer_pipe.waiting, 1);
+
+        if (filled_frames () && ! ATOMIC_GET (pump_failed))
+            wake_sleep (& writer_pipe);
 
+        ATOMIC_SET (writer_pipe.waiting, 0);
+    }
+
+    pthread_mutex_lock (& alsa_mutex);
     pump_stop ();
 
     if (alsa_config_drain_workaround)
@@ -543,22 +804,20 @@ FAILED:
     return;
 }
 
+/* Lock-free.  The values are read in the reverse of the order in which they
+ * are updated, so that a write or a pump cycle happening meanwhile can only
+ * make the time come out a little early. */
 int alsa_output_time (void)
 {
-    pthread_mutex_lock (& alsa_mutex);
-
-    int64_t frames = alsa_written - snd_pcm_bytes_to_frames (alsa_handle,
-     alsa_buffer_data_length);
+    int64_t frames = ATOMIC_GET (alsa_written);
+    frames -= filled_frames ();
 
-    if (alsa_prebuffer || alsa_paused)
-        frames -= alsa_paused_delay;
+    if (ATOMIC_GET (alsa_prebuffer) || ATOMIC_GET (alsa_paused))
+        frames -= ATOMIC_GET (alsa_paused_delay);
     else
-        frames -= get_delay ();
-
-    int time = frames * 1000 / alsa_rate;
+        frames -= delay_guess (& alsa_delay, alsa_rate);
 
-    pthread_mutex_unlock (& alsa_mutex);
-    return time;
+    return frames * 1000 / alsa_rate;
 }
 
 void alsa_flush (int time)
@@ -570,14 +829,14 @@ void alsa_flush (int time)
     CHECK (snd_pcm_drop, alsa_handle);
 
 FAILED:
-    alsa_buffer_data_start = 0;
-    alsa_buffer_data_length = 0;
+    ring_reset (& alsa_ring);
 
-    alsa_written = (int64_t) time * alsa_rate / 1000;
-    alsa_prebuffer = 1;
-    alsa_paused_delay = 0;
+    ATOMIC_SET (alsa_written, (int64_t) time * alsa_rate / 1000);
+    ATOMIC_SET (alsa_prebuffer, 1);
+    ATOMIC_SET (alsa_paused_delay, 0);
+    delay_set (& alsa_delay, 0);
 
-    pthread_cond_broadcast (& alsa_cond); /* interrupt period wait */
+    wake_signal (& writer_pipe); /* interrupt period wait */
 
     pump_start ();
 
@@ -589,19 +848,21 @@ void alsa_pause (int pause)
     AUDDBG ("%sause.\n", pause ? "P" : "Unp");
     pthread_mutex_lock (& alsa_mutex);
 
-    alsa_paused = pause;
+    if (! alsa_prebuffer && pause)
+        ATOMIC_SET (alsa_paused_delay, get_delay ());
 
-    if (! alsa_prebuffer)
-    {
-        if (pause)
-            alsa_paused_delay = get_delay ();
+    ATOMIC_SET (alsa_paused, pause);
 
+    if (! alsa_prebuffer)
         CHECK (snd_pcm_pause, alsa_handle, pause);
-    }
 
 DONE:
     if (! pause)
-        pthread_cond_broadcast (& alsa_cond);
+    {
+        delay_set (& alsa_delay, ATOMIC_GET (alsa_paused_delay));
+        pump_wake ();
+        writer_wake (); /* may be waiting to start playback */
+    }
 
     pthread_mutex_unlock (& alsa_mutex);
     return;
@@ -617,6 +878,18 @@ FAILED:
     goto DONE;
 }
 
+int alsa_get_hw_sizes (int * buffer, int * period, int * rate)
+{
+    pthread_mutex_lock (& alsa_mutex);
+
+    * buffer = alsa_hw_buffer;
+    * period = alsa_hw_period;
+    * rate = alsa_rate;
+
+    pthread_mutex_unlock (& alsa_mutex);
+    return * rate > 0;
+}
+
 void alsa_open_mixer (void)
 {
     snd_mixer_selem_id_t * selem_id;
@@ -71,11 +71,13 @@ void alsa_open_mixer (void);
 void alsa_close_mixer (void);
 void alsa_get_volume (int * left, int * right);
 void alsa_set_volume (int left, int right);
+int alsa_get_hw_sizes (int * buffer, int * period, int * rate);
 
 /* config.c */
 extern char * alsa_config_pcm, * alsa_config_mixer, * alsa_config_mixer_element;
 extern int alsa_config_drop_workaround, alsa_config_drain_workaround,
  alsa_config_delay_workaround;
+extern int alsa_config_low_latency, alsa_config_latency, alsa_config_periods;
 
 void alsa_config_load (void);
 void alsa_config_save (void);
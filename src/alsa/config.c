@@ -31,10 +31,11 @@
 char * alsa_config_pcm = NULL, * alsa_config_mixer = NULL,
  * alsa_config_mixer_element = NULL;
 int alsa_config_drain_workaround = 1;
+int alsa_config_low_latency = 0, alsa_config_latency = 8, alsa_config_periods = 3;
 
 static GtkListStore * pcm_list, * mixer_list, * mixer_element_list;
 static GtkWidget * window, * pcm_combo, * mixer_combo, * mixer_element_combo,
- * drain_workaround_check;
+ * drain_workaround_check, * low_latency_check, * latency_spin, * periods_spin;
 
 static GtkTreeIter * list_lookup_member (GtkListStore * list, const char * text)
 {
@@ -319,6 +320,9 @@ static const gchar * const alsa_defaults[] = {
  "pcm", "default",
  "mixer", "default",
  "drain-workaround", "TRUE",
+ "low-latency", "FALSE",
+ "latency", "8",
+ "periods", "3",
  NULL};
 
 void alsa_config_load (void)
@@ -329,6 +333,9 @@ void alsa_config_load (void)
     alsa_config_mixer = aud_get_string ("alsa", "mixer");
     alsa_config_mixer_element = aud_get_string ("alsa", "mixer-element");
     alsa_config_drain_workaround = aud_get_bool ("alsa", "drain-workaround");
+    alsa_config_low_latency = aud_get_bool ("alsa", "low-latency");
+    alsa_config_latency = aud_get_int ("alsa", "latency");
+    alsa_config_periods = aud_get_int ("alsa", "periods");
 
     if (! alsa_config_mixer_element[0])
         guess_mixer_element ();
@@ -358,6 +365,9 @@ void alsa_config_save (void)
     aud_set_string ("alsa", "mixer", alsa_config_mixer);
     aud_set_string ("alsa", "mixer-element", alsa_config_mixer_element);
     aud_set_bool ("alsa", "drain-workaround", alsa_config_drain_workaround);
+    aud_set_bool ("alsa", "low-latency", alsa_config_low_latency);
+    aud_set_int ("alsa", "latency", alsa_config_latency);
+    aud_set_int ("alsa", "periods", alsa_config_periods);
 
     free (alsa_config_pcm);
     alsa_config_pcm = NULL;
@@ -449,6 +459,38 @@ static void create_window (void)
      alsa_config_drain_workaround);
     gtk_box_pack_start ((GtkBox *) vbox, drain_workaround_check, 0, 0, 0);
 
+    low_latency_check = gtk_check_button_new_with_label (_("Low latency "
+     "(real-time priority, applies on next start)"));
+    gtk_toggle_button_set_active ((GtkToggleButton *) low_latency_check,
+     alsa_config_low_latency);
+    gtk_box_pack_start ((GtkBox *) vbox, low_latency_check, 0, 0, 0);
+
+    GtkWidget * hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_box_pack_start ((GtkBox *) vbox, hbox, 0, 0, 0);
+
+    gtk_box_pack_start ((GtkBox *) hbox, gtk_label_new (_("Hardware buffer:")),
+     0, 0, 0);
+    latency_spin = gtk_spin_button_new_with_range (1, 500, 1);
+    gtk_spin_button_set_value ((GtkSpinButton *) latency_spin,
+     alsa_config_latency);
+    gtk_box_pack_start ((GtkBox *) hbox, latency_spin, 0, 0, 0);
+    gtk_box_pack_start ((GtkBox *) hbox, gtk_label_new (_("ms in")), 0, 0, 0);
+    periods_spin = gtk_spin_button_new_with_range (2, 16, 1);
+    gtk_spin_button_set_value ((GtkSpinButton *) periods_spin,
+     alsa_config_periods);
+    gtk_box_pack_start ((GtkBox *) hbox, periods_spin, 0, 0, 0);
+    gtk_box_pack_start ((GtkBox *) hbox, gtk_label_new (_("periods")), 0, 0, 0);
+
+    int buffer, period, rate;
+    if (alsa_get_hw_sizes (& buffer, & period, & rate))
+    {
+        char * text = g_strdup_printf (_("Last opened with a buffer of %d "
+         "frames (%.1f ms) and a period of %d frames (%.1f ms)."), buffer,
+         buffer * 1000.0 / rate, period, period * 1000.0 / rate);
+        gtk_box_pack_start ((GtkBox *) vbox, gtk_label_new (text), 0, 0, 0);
+        g_free (text);
+    }
+
     gtk_widget_show_all (window);
 }
 
@@ -506,6 +548,11 @@ static void boolean_toggled (GtkToggleButton * button, void * data)
     * (int *) data = gtk_toggle_button_get_active (button);
 }
 
+static void integer_changed (GtkSpinButton * button, void * data)
+{
+    * (int *) data = gtk_spin_button_get_value_as_int (button);
+}
+
 static void connect_callbacks (void)
 {
     g_signal_connect ((GObject *) pcm_combo, "changed", (GCallback) pcm_changed,
@@ -516,6 +563,12 @@ static void connect_callbacks (void)
      mixer_element_changed, NULL);
     g_signal_connect ((GObject *) drain_workaround_check, "toggled", (GCallback)
      boolean_toggled, & alsa_config_drain_workaround);
+    g_signal_connect ((GObject *) low_latency_check, "toggled", (GCallback)
+     boolean_toggled, & alsa_config_low_latency);
+    g_signal_connect ((GObject *) latency_spin, "value-changed", (GCallback)
+     integer_changed, & alsa_config_latency);
+    g_signal_connect ((GObject *) periods_spin, "value-changed", (GCallback)
+     integer_changed, & alsa_config_periods);
     g_signal_connect ((GObject *) window, "response", (GCallback)
      gtk_widget_destroy, window);
     g_signal_connect ((GObject *) window, "destroy", (GCallback)
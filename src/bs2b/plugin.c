@@ -29,6 +29,8 @@
 #include <audacious/misc.h>
 #include <bs2b.h>
 
+#include "denormal.h"
+
 static t_bs2bdp bs2b = NULL;
 static gint bs2b_channels;
 static GtkWidget *config_window, *feed_slider, *fcut_slider;
@@ -81,7 +83,10 @@ static void bs2b_process (gfloat * * data, gint * samples)
     if (bs2b == NULL || bs2b_channels != 2)
         return;
 
+    /* the filter state lives inside libbs2b, out of reach of any guard */
+    DenormalState fpu = denormal_disable ();
     bs2b_cross_feed_f (bs2b, * data, (* samples) / 2);
+    denormal_restore (fpu);
 }
 
 static void bs2b_finish (gfloat * * data, gint * samples)
@@ -24,6 +24,8 @@
 #include <audacious/misc.h>
 
 #include "compressor.h"
+#include "denormal.h"
+#include "scratch.h"
 
 /* Response time adjustments.  Maybe this should be adjustable.  Or maybe that
  * would just be confusing.  I don't know. */
@@ -33,14 +35,16 @@
 
 #define MIN(a,b) ((a) < (b) ? (a) : (b))
 
+static int current_mode;
 static float * buffer, * output, * peaks;
-static int output_size;
 static int chunk_size, buffer_size;
 static int ring_at, buffer_filled, peaks_filled;
 static float current_peak;
 static int output_filled;
 static int current_channels, current_rate;
 
+int output_slot;
+
 static void buffer_append (float * * data, int * length)
 {
     int offset = (chunk_size * ring_at + buffer_filled) % buffer_size;
@@ -83,8 +87,8 @@ static float calc_peak (float * data, int length)
 
 static void do_ramp (float * data, int length, float peak_a, float peak_b)
 {
-    float center = aud_get_double ("compressor", "center");
-    float range = aud_get_double ("compressor", "range");
+    float center = compressor_config.center;
+    float range = compressor_config.range;
     float a = powf (peak_a / center, range - 1);
     float b = powf (peak_b / center, range - 1);
 
@@ -97,12 +101,6 @@ static void do_ramp (float * data, int length, float peak_a, float peak_b)
 
 static void output_append (float * data, int length)
 {
-    if (output_size < output_filled + length)
-    {
-        output_size = output_filled + length;
-        output = realloc (output, sizeof (float) * output_size);
-    }
-
     memcpy (output + output_filled, data, sizeof (float) * length);
     output_filled += length;
 }
@@ -127,6 +125,8 @@ static void do_compress (float * * data, int * samples, char finish)
 {
     float new_peak;
 
+    /* Everything put out comes through the buffer, so this is enough. */
+    output = scratch_get (output_slot, buffer_filled + * samples);
     output_filled = 0;
 
     while (1)
@@ -192,48 +192,95 @@ int compressor_init (void)
 
     buffer = NULL;
     output = NULL;
-    output_size = 0;
     peaks = NULL;
 
-    return 1;
+    return (output_slot = scratch_reserve (1)) >= 0;
 }
 
 void compressor_cleanup (void)
 {
     free (buffer);
-    free (output);
     free (peaks);
+
+    limiter_cleanup ();
+    multiband_cleanup ();
+    scratch_release (output_slot, 1);
 }
 
 void compressor_start (int * channels, int * rate)
 {
+    compressor_config_read ();
+    current_mode = compressor_config.mode;
+
+    current_channels = * channels;
+    current_rate = * rate;
+
+    if (current_mode == MODE_LIMITER)
+    {
+        limiter_start (* channels, * rate);
+        return;
+    }
+
+    if (current_mode == MODE_MULTIBAND)
+    {
+        multiband_start (* channels, * rate);
+        return;
+    }
+
     chunk_size = (* channels) * (int) ((* rate) * CHUNK_TIME);
     buffer_size = chunk_size * CHUNKS;
     buffer = realloc (buffer, sizeof (float) * buffer_size);
     peaks = realloc (peaks, sizeof (float) * CHUNKS);
 
-    current_channels = * channels;
-    current_rate = * rate;
-
     reset ();
 }
 
 void compressor_process (float * * data, int * samples)
 {
-    do_compress (data, samples, 0);
+    DenormalState fpu = denormal_disable ();
+
+    if (current_mode == MODE_LIMITER)
+        limiter_process (data, samples, 0);
+    else if (current_mode == MODE_MULTIBAND)
+        multiband_process (data, samples);
+    else
+        do_compress (data, samples, 0);
+
+    denormal_restore (fpu);
 }
 
 void compressor_flush (void)
 {
-    reset ();
+    if (current_mode == MODE_LIMITER)
+        limiter_flush ();
+    else if (current_mode == MODE_MULTIBAND)
+        multiband_flush ();
+    else
+        reset ();
 }
 
 void compressor_finish (float * * data, int * samples)
 {
-    do_compress (data, samples, 1);
+    DenormalState fpu = denormal_disable ();
+
+    if (current_mode == MODE_LIMITER)
+        limiter_process (data, samples, 1);
+    else if (current_mode == MODE_MULTIBAND)
+        multiband_process (data, samples);
+    else
+        do_compress (data, samples, 1);
+
+    denormal_restore (fpu);
 }
 
 int compressor_adjust_delay (int delay)
 {
-    return delay + (int64_t) (buffer_filled / current_channels) * 1000 / current_rate;
+    int frames = 0;
+
+    if (current_mode == MODE_LIMITER)
+        frames = limiter_latency ();
+    else if (current_mode == MODE_COMPRESSOR)
+        frames = buffer_filled / current_channels;
+
+    return delay + (int64_t) frames * 1000 / current_rate;
 }
@@ -17,7 +17,32 @@
  * the use of this software.
  */
 
+/* scratch slot holding the output of the compressor or the limiter */
+extern int output_slot;
+
+enum {
+    MODE_COMPRESSOR,
+    MODE_LIMITER,
+    MODE_MULTIBAND
+};
+
+/* Settings are cached here rather than looked up while processing.  They are
+ * reread in compressor_start and whenever they are changed in the preferences
+ * window; changes to the mode and lookahead take effect with the next song. */
+typedef struct {
+    int mode;
+    float center, range;  /* compressor and multiband */
+    float ceiling;        /* limiter */
+    int lookahead;        /* ms */
+    int release;          /* ms */
+    int bands;            /* multiband */
+    int crossover[4];     /* Hz */
+} CompressorConfig;
+
+extern CompressorConfig compressor_config;
+
 void compressor_config_load (void);
+void compressor_config_read (void);
 
 int compressor_init (void);
 void compressor_cleanup (void);
@@ -26,3 +51,14 @@ void compressor_process (float * * data, int * samples);
 void compressor_flush (void);
 void compressor_finish (float * * data, int * samples);
 int compressor_adjust_delay (int delay);
+
+void limiter_start (int channels, int rate);
+void limiter_cleanup (void);
+void limiter_flush (void);
+void limiter_process (float * * data, int * samples, int finish);
+int limiter_latency (void);
+
+void multiband_start (int channels, int rate);
+void multiband_cleanup (void);
+void multiband_flush (void);
+void multiband_process (float * * data, int * samples);
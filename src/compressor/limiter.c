@@ -0,0 +1,357 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* The limiter works on the "true" peak of each frame: the largest absolute
+ * value over all channels, both at the sample itself and at three points
+ * interpolated between it and the next sample.  For each frame, the gain needed
+ * to keep that peak under the ceiling is known a few milliseconds (the
+ * lookahead) before the frame is played:
+ *
+ * 1. A sliding-window maximum (a monotonic deque) over the lookahead gives,
+ *    for each frame, the lowest gain required anywhere in the next lookahead.
+ * 2. That gain is allowed to recover only slowly (the release).
+ * 3. A moving average over the lookahead turns the steps into smooth ramps.
+ *    Every value averaged for a given frame already includes that frame's
+ *    requirement, so the averaged gain is never too high.
+ *
+ * Since nothing here averages the signal itself, badly clipped material
+ * (which is loud everywhere) is simply turned down to the ceiling. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "compressor.h"
+#include "scratch.h"
+
+#define TP_TAPS 8      /* taps of the interpolation filter */
+#define TP_PHASES 3    /* points checked between samples */
+#define TP_CENTER 3    /* taps before the frame being checked */
+#define TP_DELAY (TP_TAPS - 1 - TP_CENTER) /* frames of filter lookahead */
+#define CHUNK 1024
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+static int channels, rate;
+static int lookahead, delay; /* frames */
+static float tp_coefs[TP_PHASES][TP_TAPS];
+
+static float * line;      /* delay line: <delay> old frames, then new input */
+static float * scratch;   /* CHUNK frames */
+static float * sample_peak; /* CHUNK frames */
+static float * frame_peak, * gains; /* CHUNK values */
+
+static float * dq_peak;   /* monotonic deque of peaks, ring of lookahead + 1 */
+static int64_t * dq_frame;
+static int dq_head, dq_count;
+
+static float * smooth;    /* ring of lookahead + 1 released gains */
+static double smooth_sum;
+static int smooth_at;
+static float released;
+
+static int64_t frame_count; /* frames taken in */
+static int skip;          /* output frames still to be discarded */
+
+static void init_coefs (void)
+{
+    for (int p = 0; p < TP_PHASES; p ++)
+    {
+        double frac = (double) (p + 1) / (TP_PHASES + 1);
+        double sum = 0;
+
+        for (int t = 0; t < TP_TAPS; t ++)
+        {
+            double x = frac - (t - TP_CENTER);
+            double window = cos (M_PI * x / (TP_TAPS + 1));
+            double val = sin (M_PI * x) / (M_PI * x) * window * window;
+
+            tp_coefs[p][t] = val;
+            sum += val;
+        }
+
+        for (int t = 0; t < TP_TAPS; t ++)
+            tp_coefs[p][t] /= sum;
+    }
+}
+
+void limiter_start (int new_channels, int new_rate)
+{
+    channels = new_channels;
+    rate = new_rate;
+
+    lookahead = MAX (1, rate * compressor_config.lookahead / 1000);
+    delay = lookahead + TP_DELAY;
+
+    init_coefs ();
+
+    line = realloc (line, sizeof (float) * (delay + CHUNK) * channels);
+    scratch = realloc (scratch, sizeof (float) * CHUNK * channels);
+    sample_peak = realloc (sample_peak, sizeof (float) * CHUNK * channels);
+    frame_peak = realloc (frame_peak, sizeof (float) * CHUNK);
+    gains = realloc (gains, sizeof (float) * CHUNK);
+
+    dq_peak = realloc (dq_peak, sizeof (float) * (lookahead + 1));
+    dq_frame = realloc (dq_frame, sizeof (int64_t) * (lookahead + 1));
+    smooth = realloc (smooth, sizeof (float) * (lookahead + 1));
+
+    limiter_flush ();
+}
+
+void limiter_flush (void)
+{
+    memset (line, 0, sizeof (float) * delay * channels);
+
+    dq_head = dq_count = 0;
+
+    for (int i = 0; i <= lookahead; i ++)
+        smooth[i] = 1;
+
+    smooth_sum = lookahead + 1;
+    smooth_at = 0;
+    released = 1;
+
+    frame_count = 0;
+    skip = delay;
+}
+
+void limiter_cleanup (void)
+{
+    free (line);
+    free (scratch);
+    free (sample_peak);
+    free (frame_peak);
+    free (gains);
+    free (dq_peak);
+    free (dq_frame);
+    free (smooth);
+
+    line = scratch = sample_peak = frame_peak = gains = NULL;
+    dq_peak = smooth = NULL;
+    dq_frame = NULL;
+}
+
+int limiter_latency (void)
+{
+    return delay;
+}
+
+/* ---- vector kernels ---- */
+
+/* out[i] = sum of coefs[t] * in[i + t * stride] */
+static void fir_stride (float * out, const float * in, const float * coefs,
+ int stride, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 sum = _mm_setzero_ps ();
+
+        for (int t = 0; t < TP_TAPS; t ++)
+            sum = _mm_add_ps (sum, _mm_mul_ps (_mm_set1_ps (coefs[t]),
+             _mm_loadu_ps (in + i + t * stride)));
+
+        _mm_storeu_ps (out + i, sum);
+    }
+#endif
+
+    for (; i < n; i ++)
+    {
+        float sum = 0;
+
+        for (int t = 0; t < TP_TAPS; t ++)
+            sum += coefs[t] * in[i + t * stride];
+
+        out[i] = sum;
+    }
+}
+
+/* peaks[i] = max (peaks[i], fabs (data[i])) */
+static void abs_max (float * peaks, const float * data, int n)
+{
+    int i = 0;
+
+#ifdef __SSE2__
+    __m128 mask = _mm_castsi128_ps (_mm_set1_epi32 (0x7fffffff));
+
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps (peaks + i, _mm_max_ps (_mm_loadu_ps (peaks + i),
+         _mm_and_ps (_mm_loadu_ps (data + i), mask)));
+#endif
+
+    for (; i < n; i ++)
+        peaks[i] = MAX (peaks[i], fabsf (data[i]));
+}
+
+/* out[f * channels + c] = in[f * channels + c] * gains[f] */
+static void apply_gains (float * out, const float * in, const float * gains,
+ int frames)
+{
+    int f = 0;
+
+#ifdef __SSE2__
+    if (channels == 2)
+    {
+        for (; f + 2 <= frames; f += 2)
+        {
+            __m128 g = _mm_set_ps (gains[f + 1], gains[f + 1], gains[f], gains[f]);
+            _mm_storeu_ps (out + 2 * f, _mm_mul_ps (_mm_loadu_ps (in + 2 * f), g));
+        }
+    }
+#endif
+
+    for (; f < frames; f ++)
+    {
+        for (int c = 0; c < channels; c ++)
+            out[f * channels + c] = in[f * channels + c] * gains[f];
+    }
+}
+
+/* ---- processing ---- */
+
+static void find_peaks (const float * window, int frames)
+{
+    int n = frames * channels;
+
+    /* the sample values themselves */
+    memset (sample_peak, 0, sizeof (float) * n);
+    abs_max (sample_peak, window + TP_CENTER * channels, n);
+
+    /* and the points between them */
+    for (int p = 0; p < TP_PHASES; p ++)
+    {
+        fir_stride (scratch, window, tp_coefs[p], channels, n);
+        abs_max (sample_peak, scratch, n);
+    }
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float peak = 0;
+
+        for (int c = 0; c < channels; c ++)
+            peak = MAX (peak, sample_peak[f * channels + c]);
+
+        frame_peak[f] = peak;
+    }
+}
+
+static void compute_gains (int frames)
+{
+    int size = lookahead + 1;
+    float ceiling = compressor_config.ceiling;
+    float recover = 1 - expf (-1000.0f / (rate * (float) compressor_config.release));
+
+    for (int f = 0; f < frames; f ++)
+    {
+        /* the peak just found belongs to this frame */
+        int64_t frame = frame_count + f - TP_DELAY;
+        float peak = frame_peak[f];
+
+        /* 1. sliding maximum over [frame - lookahead, frame]; the stale
+         * front goes first, so that the ring never holds more than <size> */
+        while (dq_count && dq_frame[dq_head] < frame - lookahead)
+        {
+            dq_head = (dq_head + 1) % size;
+            dq_count --;
+        }
+
+        while (dq_count && dq_peak[(dq_head + dq_count - 1) % size] <= peak)
+            dq_count --;
+
+        int tail = (dq_head + dq_count) % size;
+        dq_peak[tail] = peak;
+        dq_frame[tail] = frame;
+        dq_count ++;
+
+        float max = dq_peak[dq_head];
+        float needed = (max > ceiling) ? ceiling / max : 1;
+
+        /* 2. instant attack, gradual release */
+        if (needed < released)
+            released = needed;
+        else
+            released += (needed - released) * recover;
+
+        /* 3. moving average */
+        smooth_sum += released - smooth[smooth_at];
+        smooth[smooth_at] = released;
+        smooth_at = (smooth_at + 1) % size;
+
+        gains[f] = MIN (smooth_sum / size, 1);
+    }
+}
+
+static void run_chunk (const float * data, int frames, float * out)
+{
+    float * new = line + delay * channels;
+
+    if (data)
+        memcpy (new, data, sizeof (float) * frames * channels);
+    else
+        memset (new, 0, sizeof (float) * frames * channels);
+
+    /* the interpolation window for the first new frame starts TP_TAPS - 1
+     * frames before it */
+    find_peaks (new - (TP_TAPS - 1) * channels, frames);
+    compute_gains (frames);
+
+    apply_gains (out, line, gains, frames);
+
+    memmove (line, line + frames * channels, sizeof (float) * delay * channels);
+    frame_count += frames;
+}
+
+void limiter_process (float * * data, int * samples, int finish)
+{
+    int frames = * samples / channels;
+    int total = frames + (finish ? delay : 0);
+    float * out = scratch_get (output_slot, total * channels);
+    const float * get = * data;
+
+    for (int done = 0; done < total; )
+    {
+        int chunk = MIN (CHUNK, total - done);
+
+        /* At the end, push the delay line out with silence. */
+        if (done < frames)
+            chunk = MIN (chunk, frames - done);
+
+        run_chunk ((done < frames) ? get + done * channels : NULL, chunk,
+         out + done * channels);
+
+        done += chunk;
+    }
+
+    int cut = MIN (skip, total);
+    skip -= cut;
+
+    * data = out + cut * channels;
+    * samples = (total - cut) * channels;
+
+    if (finish)
+        limiter_flush ();
+}
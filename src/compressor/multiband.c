@@ -0,0 +1,345 @@
+/*
+ * Dynamic Range Compression Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* The signal is split into 3 to 5 bands by 4th-order Linkwitz-Riley crossovers
+ * (each a pair of cascaded Butterworth biquads).  The crossovers are chained:
+ * the first one splits off the lowest band, the second splits the rest, and so
+ * on.  Since the low and high outputs of a Linkwitz-Riley crossover sum to a
+ * 2nd-order allpass, the bands already split off are passed through the same
+ * allpass for each later crossover, so that all bands stay in phase and sum
+ * back to a flat response.
+ *
+ * Each band is then compressed by the same rule as the single-band mode, using
+ * its own envelope (linked across channels) and a gain updated once per block
+ * and ramped linearly within it.
+ *
+ * Internally, audio is laid out with the channel count padded to a multiple of
+ * four, so that every biquad runs four channels at once in one vector, and each
+ * band has its own buffer. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "compressor.h"
+#include "denormal.h"
+
+#define MAX_BANDS 5
+#define BLOCK 64       /* frames per gain update */
+#define ATTACK_TIME 5  /* ms */
+#define MIN_LEVEL 0.01
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+    float b0, b1, b2, a1, a2;
+    float * s1, * s2; /* state, one per lane */
+} Biquad;
+
+static int channels, rate, lanes, bands;
+
+/* per crossover: two lowpass and two highpass stages, and an allpass for each
+ * band below it */
+static Biquad lowpass[MAX_BANDS - 1][2], highpass[MAX_BANDS - 1][2];
+static Biquad allpass[MAX_BANDS - 1][MAX_BANDS - 1];
+
+static float * input;               /* BLOCK frames of padded lanes */
+static float * band_buf[MAX_BANDS]; /* same */
+static float envelope[MAX_BANDS], gain[MAX_BANDS];
+
+enum {LOWPASS, HIGHPASS, ALLPASS};
+
+static void biquad_init (Biquad * q, int type, float freq)
+{
+    /* RBJ cookbook, Q = 1 / sqrt (2) */
+    double w = 2 * M_PI * freq / rate;
+    double alpha = sin (w) / sqrt (2);
+    double cw = cos (w);
+    double a0 = 1 + alpha;
+
+    switch (type)
+    {
+    case LOWPASS:
+        q->b0 = q->b2 = (1 - cw) / 2 / a0;
+        q->b1 = (1 - cw) / a0;
+        break;
+    case HIGHPASS:
+        q->b0 = q->b2 = (1 + cw) / 2 / a0;
+        q->b1 = -(1 + cw) / a0;
+        break;
+    default:
+        q->b0 = (1 - alpha) / a0;
+        q->b1 = -2 * cw / a0;
+        q->b2 = 1;
+        break;
+    }
+
+    q->a1 = -2 * cw / a0;
+    q->a2 = (1 - alpha) / a0;
+
+    q->s1 = realloc (q->s1, sizeof (float) * lanes);
+    q->s2 = realloc (q->s2, sizeof (float) * lanes);
+    memset (q->s1, 0, sizeof (float) * lanes);
+    memset (q->s2, 0, sizeof (float) * lanes);
+}
+
+static void biquad_reset (Biquad * q)
+{
+    if (q->s1)
+    {
+        memset (q->s1, 0, sizeof (float) * lanes);
+        memset (q->s2, 0, sizeof (float) * lanes);
+    }
+}
+
+static void biquad_free (Biquad * q)
+{
+    free (q->s1);
+    free (q->s2);
+    q->s1 = q->s2 = NULL;
+}
+
+/* Transposed direct form II, in place, four lanes at a time.  The state is
+ * flushed to zero at the end of each block once it has decayed. */
+static void biquad_run (Biquad * q, float * data, int frames)
+{
+#ifdef __SSE__
+    __m128 b0 = _mm_set1_ps (q->b0), b1 = _mm_set1_ps (q->b1);
+    __m128 b2 = _mm_set1_ps (q->b2), a1 = _mm_set1_ps (q->a1);
+    __m128 a2 = _mm_set1_ps (q->a2);
+
+    for (int l = 0; l < lanes; l += 4)
+    {
+        __m128 s1 = _mm_loadu_ps (q->s1 + l);
+        __m128 s2 = _mm_loadu_ps (q->s2 + l);
+        float * p = data + l;
+
+        for (int f = 0; f < frames; f ++, p += lanes)
+        {
+            __m128 x = _mm_loadu_ps (p);
+            __m128 y = _mm_add_ps (_mm_mul_ps (b0, x), s1);
+            s1 = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1, x), _mm_mul_ps (a1, y)), s2);
+            s2 = _mm_sub_ps (_mm_mul_ps (b2, x), _mm_mul_ps (a2, y));
+            _mm_storeu_ps (p, y);
+        }
+
+        _mm_storeu_ps (q->s1 + l, s1);
+        _mm_storeu_ps (q->s2 + l, s2);
+    }
+
+    for (int l = 0; l < lanes; l ++)
+    {
+        q->s1[l] = denormal_guard (q->s1[l]);
+        q->s2[l] = denormal_guard (q->s2[l]);
+    }
+#else
+    for (int l = 0; l < lanes; l ++)
+    {
+        float s1 = q->s1[l], s2 = q->s2[l];
+        float * p = data + l;
+
+        for (int f = 0; f < frames; f ++, p += lanes)
+        {
+            float x = * p;
+            float y = q->b0 * x + s1;
+            s1 = q->b1 * x - q->a1 * y + s2;
+            s2 = q->b2 * x - q->a2 * y;
+            * p = y;
+        }
+
+        q->s1[l] = denormal_guard (s1);
+        q->s2[l] = denormal_guard (s2);
+    }
+#endif
+}
+
+static float block_peak (const float * data, int frames)
+{
+    float peak = 0;
+
+    for (int i = 0; i < frames * lanes; i ++)
+        peak = MAX (peak, fabsf (data[i]));
+
+    return peak;
+}
+
+void multiband_start (int new_channels, int new_rate)
+{
+    channels = new_channels;
+    rate = new_rate;
+    lanes = (channels + 3) & ~3;
+    bands = MIN (MAX (compressor_config.bands, 3), MAX_BANDS);
+
+    /* Keep the crossovers in order and well under the Nyquist frequency. */
+    float freq[MAX_BANDS - 1];
+    float prev = 20;
+
+    for (int x = 0; x < bands - 1; x ++)
+    {
+        freq[x] = MIN (MAX (compressor_config.crossover[x], prev * 1.5f), rate * 0.45f);
+        prev = freq[x];
+    }
+
+    for (int x = 0; x < bands - 1; x ++)
+    {
+        for (int i = 0; i < 2; i ++)
+        {
+            biquad_init (& lowpass[x][i], LOWPASS, freq[x]);
+            biquad_init (& highpass[x][i], HIGHPASS, freq[x]);
+        }
+
+        for (int b = 0; b < x; b ++)
+            biquad_init (& allpass[x][b], ALLPASS, freq[x]);
+    }
+
+    input = realloc (input, sizeof (float) * BLOCK * lanes);
+    memset (input, 0, sizeof (float) * BLOCK * lanes);
+
+    for (int b = 0; b < bands; b ++)
+        band_buf[b] = realloc (band_buf[b], sizeof (float) * BLOCK * lanes);
+
+    multiband_flush ();
+}
+
+void multiband_flush (void)
+{
+    for (int x = 0; x < bands - 1; x ++)
+    {
+        for (int i = 0; i < 2; i ++)
+        {
+            biquad_reset (& lowpass[x][i]);
+            biquad_reset (& highpass[x][i]);
+        }
+
+        for (int b = 0; b < x; b ++)
+            biquad_reset (& allpass[x][b]);
+    }
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+    {
+        envelope[b] = 0;
+        gain[b] = -1; /* not yet known */
+    }
+}
+
+void multiband_cleanup (void)
+{
+    for (int x = 0; x < MAX_BANDS - 1; x ++)
+    {
+        for (int i = 0; i < 2; i ++)
+        {
+            biquad_free (& lowpass[x][i]);
+            biquad_free (& highpass[x][i]);
+        }
+
+        for (int b = 0; b < MAX_BANDS - 1; b ++)
+            biquad_free (& allpass[x][b]);
+    }
+
+    free (input);
+    input = NULL;
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+    {
+        free (band_buf[b]);
+        band_buf[b] = NULL;
+    }
+}
+
+static void split (int frames)
+{
+    float * rest = input;
+
+    for (int x = 0; x < bands - 1; x ++)
+    {
+        float * low = band_buf[x], * high = band_buf[x + 1];
+
+        memcpy (high, rest, sizeof (float) * frames * lanes);
+        if (rest != low)
+            memcpy (low, rest, sizeof (float) * frames * lanes);
+
+        biquad_run (& lowpass[x][0], low, frames);
+        biquad_run (& lowpass[x][1], low, frames);
+        biquad_run (& highpass[x][0], high, frames);
+        biquad_run (& highpass[x][1], high, frames);
+
+        for (int b = 0; b < x; b ++)
+            biquad_run (& allpass[x][b], band_buf[b], frames);
+
+        rest = high;
+    }
+}
+
+static void do_block (float * data, int frames)
+{
+    float center = compressor_config.center;
+    float exponent = compressor_config.range - 1;
+    float block_time = (float) frames / rate;
+    float attack = 1 - expf (-block_time * 1000 / ATTACK_TIME);
+    float release = 1 - expf (-block_time * 1000 / compressor_config.release);
+
+    for (int f = 0; f < frames; f ++)
+    for (int c = 0; c < channels; c ++)
+        input[f * lanes + c] = data[f * channels + c];
+
+    split (frames);
+
+    memset (data, 0, sizeof (float) * frames * channels);
+
+    for (int b = 0; b < bands; b ++)
+    {
+        float peak = block_peak (band_buf[b], frames);
+        envelope[b] += (peak - envelope[b]) * (peak > envelope[b] ? attack : release);
+        envelope[b] = denormal_guard (envelope[b]);
+
+        float new_gain = powf (MAX (envelope[b], MIN_LEVEL) / center, exponent);
+        float old_gain = (gain[b] < 0) ? new_gain : gain[b];
+        float step = (new_gain - old_gain) / frames;
+        float * get = band_buf[b];
+
+        for (int f = 0; f < frames; f ++)
+        {
+            float g = old_gain + step * (f + 1);
+
+            for (int c = 0; c < channels; c ++)
+                data[f * channels + c] += get[f * lanes + c] * g;
+        }
+
+        gain[b] = new_gain;
+    }
+}
+
+void multiband_process (float * * data, int * samples)
+{
+    float * get = * data;
+    int frames = * samples / channels;
+
+    while (frames > 0)
+    {
+        int block = MIN (frames, BLOCK);
+        do_block (get, block);
+        get += block * channels;
+        frames -= block;
+    }
+}
@@ -31,16 +31,72 @@
 static const char * const compressor_defaults[] = {
  "center", "0.5",
  "range", "0.5",
+ "mode", "0", /* MODE_COMPRESSOR */
+ "ceiling", "0.9",
+ "lookahead", "5",
+ "release", "100",
+ "bands", "3",
+ "crossover1", "120",
+ "crossover2", "800",
+ "crossover3", "3000",
+ "crossover4", "8000",
  NULL};
 
+CompressorConfig compressor_config;
+
+static const ComboBoxElements mode_list[] = {
+ {"0", N_("Compressor")}, /* MODE_COMPRESSOR */
+ {"1", N_("Lookahead limiter")}, /* MODE_LIMITER */
+ {"2", N_("Multiband compressor")}}; /* MODE_MULTIBAND */
+
 static const PreferencesWidget compressor_widgets[] = {
+ {WIDGET_COMBO_BOX, N_("Mode:"),
+  .cfg_type = VALUE_STRING, .csect = "compressor", .cname = "mode",
+  .callback = compressor_config_read,
+  .data = {.combo = {mode_list, sizeof mode_list / sizeof mode_list[0]}}},
  {WIDGET_LABEL, N_("<b>Compression</b>")},
  {WIDGET_SPIN_BTN, N_("Center volume:"),
   .cfg_type = VALUE_FLOAT, .csect = "compressor", .cname = "center",
+  .callback = compressor_config_read,
   .data = {.spin_btn = {0.1, 1, 0.1}}},
  {WIDGET_SPIN_BTN, N_("Dynamic range:"),
   .cfg_type = VALUE_FLOAT, .csect = "compressor", .cname = "range",
-  .data = {.spin_btn = {0.0, 3.0, 0.1}}}};
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {0.0, 3.0, 0.1}}},
+ {WIDGET_LABEL, N_("<b>Limiter</b>")},
+ {WIDGET_SPIN_BTN, N_("Ceiling:"),
+  .cfg_type = VALUE_FLOAT, .csect = "compressor", .cname = "ceiling",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {0.1, 1, 0.01}}},
+ {WIDGET_SPIN_BTN, N_("Lookahead:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "lookahead",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {1, 20, 1, N_("ms")}}},
+ {WIDGET_SPIN_BTN, N_("Release:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "release",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {10, 1000, 10, N_("ms")}}},
+ {WIDGET_LABEL, N_("<b>Multiband</b>")},
+ {WIDGET_SPIN_BTN, N_("Bands:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "bands",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {3, 5, 1}}},
+ {WIDGET_SPIN_BTN, N_("Crossover 1:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "crossover1",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {20, 20000, 10, N_("Hz")}}},
+ {WIDGET_SPIN_BTN, N_("Crossover 2:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "crossover2",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {20, 20000, 10, N_("Hz")}}},
+ {WIDGET_SPIN_BTN, N_("Crossover 3:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "crossover3",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {20, 20000, 10, N_("Hz")}}},
+ {WIDGET_SPIN_BTN, N_("Crossover 4:"),
+  .cfg_type = VALUE_INT, .csect = "compressor", .cname = "crossover4",
+  .callback = compressor_config_read,
+  .data = {.spin_btn = {20, 20000, 10, N_("Hz")}}}};
 
 static const PluginPreferences compressor_prefs = {
  .widgets = compressor_widgets,
@@ -49,6 +105,24 @@ static const PluginPreferences compressor_prefs = {
 void compressor_config_load (void)
 {
     aud_config_set_defaults ("compressor", compressor_defaults);
+    compressor_config_read ();
+}
+
+void compressor_config_read (void)
+{
+    compressor_config.mode = aud_get_int ("compressor", "mode");
+    compressor_config.center = aud_get_double ("compressor", "center");
+    compressor_config.range = aud_get_double ("compressor", "range");
+    compressor_config.ceiling = aud_get_double ("compressor", "ceiling");
+    compressor_config.lookahead = CLAMP (aud_get_int ("compressor", "lookahead"), 1, 20);
+    compressor_config.release = CLAMP (aud_get_int ("compressor", "release"), 10, 1000);
+    compressor_config.bands = CLAMP (aud_get_int ("compressor", "bands"), 3, 5);
+
+    for (int i = 0; i < 4; i ++)
+    {
+        SPRINTF (name, "crossover%d", i + 1);
+        compressor_config.crossover[i] = aud_get_int ("compressor", name);
+    }
 }
 
 static const char compressor_about[] =
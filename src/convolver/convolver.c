@@ -0,0 +1,366 @@
+/*
+ * Convolution Reverb Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Uniformly partitioned convolution in the frequency domain: the impulse
+ * response is cut into blocks, each block is transformed once, and each block
+ * of input is transformed once and kept in a "frequency-domain delay line",
+ * so that a whole block of output takes one forward and one inverse FFT plus a
+ * complex multiply-accumulate per partition.
+ *
+ * To keep the latency low without paying for small blocks over the whole
+ * response, it is split into segments with growing block sizes (256, 1024,
+ * 4096, then 16384 frames for the rest).  Each segment starts at least one of
+ * its own blocks into the response, so its output is always computed before it
+ * is due; only the first segment adds latency, one block of 256 frames. */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE__)
+#include <xmmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "convolver.h"
+#include "fft.h"
+
+#define FIRST_BLOCK 256
+#define GROWTH 4
+#define MAX_SEGMENTS 4
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+    int block, bins, parts, offset;
+    RFFTPlan plan;
+    float * * h_re, * * h_im; /* per IR channel, <parts> spectra */
+    float * * x_re, * * x_im; /* per channel, ring of <parts> input spectra */
+    int at;                   /* newest input spectrum */
+} Segment;
+
+struct Convolver {
+    int channels, ir_channels, ir_frames;
+    int n_segments;
+    Segment segments[MAX_SEGMENTS];
+
+    float * * history; /* per channel, ring of input */
+    float * * acc;     /* per channel, ring of output being summed */
+    int history_mask, acc_mask;
+    int64_t pos;       /* frames taken in */
+
+    float * work, * y_re, * y_im; /* scratch, sized for the largest block */
+};
+
+/* y += x * h, over <n> complex values in split form */
+static void cmac (float * y_re, float * y_im, const float * x_re,
+ const float * x_im, const float * h_re, const float * h_im, int n)
+{
+    int i = 0;
+
+#if defined (__SSE__)
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 xr = _mm_loadu_ps (x_re + i), xi = _mm_loadu_ps (x_im + i);
+        __m128 hr = _mm_loadu_ps (h_re + i), hi = _mm_loadu_ps (h_im + i);
+
+        _mm_storeu_ps (y_re + i, _mm_add_ps (_mm_loadu_ps (y_re + i),
+         _mm_sub_ps (_mm_mul_ps (xr, hr), _mm_mul_ps (xi, hi))));
+        _mm_storeu_ps (y_im + i, _mm_add_ps (_mm_loadu_ps (y_im + i),
+         _mm_add_ps (_mm_mul_ps (xr, hi), _mm_mul_ps (xi, hr))));
+    }
+#elif defined (HAVE_NEON)
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t xr = vld1q_f32 (x_re + i), xi = vld1q_f32 (x_im + i);
+        float32x4_t hr = vld1q_f32 (h_re + i), hi = vld1q_f32 (h_im + i);
+
+        float32x4_t yr = vmlaq_f32 (vld1q_f32 (y_re + i), xr, hr);
+        float32x4_t yi = vmlaq_f32 (vld1q_f32 (y_im + i), xr, hi);
+        vst1q_f32 (y_re + i, vmlsq_f32 (yr, xi, hi));
+        vst1q_f32 (y_im + i, vmlaq_f32 (yi, xi, hr));
+    }
+#endif
+
+    for (; i < n; i ++)
+    {
+        y_re[i] += x_re[i] * h_re[i] - x_im[i] * h_im[i];
+        y_im[i] += x_re[i] * h_im[i] + x_im[i] * h_re[i];
+    }
+}
+
+static float * * alloc_planar (int count, int size)
+{
+    float * * bufs = malloc (sizeof (float *) * count);
+
+    for (int i = 0; i < count; i ++)
+        bufs[i] = calloc (size, sizeof (float));
+
+    return bufs;
+}
+
+static void free_planar (float * * bufs, int count)
+{
+    if (! bufs)
+        return;
+
+    for (int i = 0; i < count; i ++)
+        free (bufs[i]);
+
+    free (bufs);
+}
+
+static int round_up_pow2 (int n)
+{
+    int p = 1;
+    while (p < n)
+        p *= 2;
+
+    return p;
+}
+
+static void setup_segment (Convolver * conv, Segment * seg, float * const * ir)
+{
+    int size = 2 * seg->block;
+    float * work = conv->work;
+
+    rfft_plan_init (& seg->plan, size);
+
+    seg->h_re = alloc_planar (conv->ir_channels, seg->parts * seg->bins);
+    seg->h_im = alloc_planar (conv->ir_channels, seg->parts * seg->bins);
+    seg->x_re = alloc_planar (conv->channels, seg->parts * seg->bins);
+    seg->x_im = alloc_planar (conv->channels, seg->parts * seg->bins);
+    seg->at = 0;
+
+    /* The inverse transform is scaled by the block size; undo that here. */
+    float scale = 1.0f / seg->block;
+
+    for (int c = 0; c < conv->ir_channels; c ++)
+    {
+        for (int p = 0; p < seg->parts; p ++)
+        {
+            int start = seg->offset + p * seg->block;
+            int length = MAX (0, MIN (seg->block, conv->ir_frames - start));
+
+            memset (work, 0, sizeof (float) * size);
+            for (int i = 0; i < length; i ++)
+                work[i] = ir[c][start + i] * scale;
+
+            rfft_forward (& seg->plan, work, seg->h_re[c] + p * seg->bins,
+             seg->h_im[c] + p * seg->bins);
+        }
+    }
+}
+
+Convolver * convolver_new (float * const * ir, int ir_frames, int ir_channels,
+ int channels)
+{
+    Convolver * conv = calloc (1, sizeof (Convolver));
+
+    conv->channels = channels;
+    conv->ir_channels = ir_channels;
+    conv->ir_frames = ir_frames;
+
+    /* lay out the segments */
+    int block = FIRST_BLOCK, offset = 0;
+
+    while (conv->n_segments < MAX_SEGMENTS && offset < ir_frames)
+    {
+        int end = (conv->n_segments < MAX_SEGMENTS - 1) ? MIN (ir_frames,
+         block * GROWTH) : ir_frames;
+
+        Segment * seg = & conv->segments[conv->n_segments ++];
+        seg->block = block;
+        seg->bins = block + 1;
+        seg->offset = offset;
+        seg->parts = (end - offset + block - 1) / block;
+
+        offset = end;
+        block *= GROWTH;
+    }
+
+    Segment * last = & conv->segments[MAX (conv->n_segments - 1, 0)];
+    int largest = conv->n_segments ? last->block : FIRST_BLOCK;
+
+    conv->work = malloc (sizeof (float) * 2 * largest);
+    conv->y_re = malloc (sizeof (float) * (largest + 1));
+    conv->y_im = malloc (sizeof (float) * (largest + 1));
+
+    for (int s = 0; s < conv->n_segments; s ++)
+        setup_segment (conv, & conv->segments[s], ir);
+
+    int history_size = round_up_pow2 (2 * largest);
+    int acc_size = round_up_pow2 ((conv->n_segments ? last->offset : 0) + 2 * largest);
+
+    conv->history = alloc_planar (channels, history_size);
+    conv->acc = alloc_planar (channels, acc_size);
+    conv->history_mask = history_size - 1;
+    conv->acc_mask = acc_size - 1;
+
+    return conv;
+}
+
+void convolver_clear (Convolver * conv)
+{
+    for (int c = 0; c < conv->channels; c ++)
+    {
+        memset (conv->history[c], 0, sizeof (float) * (conv->history_mask + 1));
+        memset (conv->acc[c], 0, sizeof (float) * (conv->acc_mask + 1));
+    }
+
+    for (int s = 0; s < conv->n_segments; s ++)
+    {
+        Segment * seg = & conv->segments[s];
+
+        for (int c = 0; c < conv->channels; c ++)
+        {
+            memset (seg->x_re[c], 0, sizeof (float) * seg->parts * seg->bins);
+            memset (seg->x_im[c], 0, sizeof (float) * seg->parts * seg->bins);
+        }
+
+        seg->at = 0;
+    }
+
+    conv->pos = 0;
+}
+
+void convolver_free (Convolver * conv)
+{
+    for (int s = 0; s < conv->n_segments; s ++)
+    {
+        Segment * seg = & conv->segments[s];
+
+        rfft_plan_free (& seg->plan);
+        free_planar (seg->h_re, conv->ir_channels);
+        free_planar (seg->h_im, conv->ir_channels);
+        free_planar (seg->x_re, conv->channels);
+        free_planar (seg->x_im, conv->channels);
+    }
+
+    free_planar (conv->history, conv->channels);
+    free_planar (conv->acc, conv->channels);
+    free (conv->work);
+    free (conv->y_re);
+    free (conv->y_im);
+    free (conv);
+}
+
+int convolver_latency (void)
+{
+    return FIRST_BLOCK;
+}
+
+int convolver_tail (Convolver * conv)
+{
+    return FIRST_BLOCK + conv->ir_frames;
+}
+
+/* Called when a block of the segment has been taken in: adds the output for
+ * that block into the accumulator, <offset> frames later. */
+static void run_segment (Convolver * conv, Segment * seg)
+{
+    int block = seg->block, bins = seg->bins;
+    int history_mask = conv->history_mask, acc_mask = conv->acc_mask;
+    float * work = conv->work, * y_re = conv->y_re, * y_im = conv->y_im;
+    int64_t pos = conv->pos;
+
+    seg->at = (seg->at + 1) % seg->parts;
+
+    for (int c = 0; c < conv->channels; c ++)
+    {
+        /* the last two blocks of input */
+        int start = (pos - 2 * block) & history_mask;
+        int first = MIN (2 * block, history_mask + 1 - start);
+
+        memcpy (work, conv->history[c] + start, sizeof (float) * first);
+        memcpy (work + first, conv->history[c], sizeof (float) * (2 * block - first));
+
+        int h = c % conv->ir_channels;
+        float * x_re = seg->x_re[c], * x_im = seg->x_im[c];
+        float * h_re = seg->h_re[h], * h_im = seg->h_im[h];
+
+        rfft_forward (& seg->plan, work, x_re + seg->at * bins, x_im + seg->at * bins);
+
+        memset (y_re, 0, sizeof (float) * bins);
+        memset (y_im, 0, sizeof (float) * bins);
+
+        for (int p = 0; p < seg->parts; p ++)
+        {
+            int slot = (seg->at - p + seg->parts) % seg->parts;
+            cmac (y_re, y_im, x_re + slot * bins, x_im + slot * bins,
+             h_re + p * bins, h_im + p * bins, bins);
+        }
+
+        rfft_inverse (& seg->plan, y_re, y_im, work);
+
+        /* overlap-save: only the second half is valid */
+        float * out = conv->acc[c];
+        int64_t time = pos - block + seg->offset;
+
+        for (int i = 0; i < block; i ++)
+            out[(time + i) & acc_mask] += work[block + i];
+    }
+}
+
+void convolver_run (Convolver * conv, float * data, int frames, float dry,
+ float wet)
+{
+    int channels = conv->channels;
+    int history_mask = conv->history_mask, acc_mask = conv->acc_mask;
+
+    while (frames > 0)
+    {
+        int64_t pos = conv->pos;
+        int chunk = MIN (frames, FIRST_BLOCK - (int) (pos % FIRST_BLOCK));
+
+        for (int c = 0; c < channels; c ++)
+        {
+            float * hist = conv->history[c], * out = conv->acc[c];
+            float * get = data + c;
+
+            for (int f = 0; f < chunk; f ++, get += channels)
+            {
+                int64_t time = pos + f;
+                int now = time & history_mask;
+                int then = (time - FIRST_BLOCK) & history_mask;
+                int then_acc = (time - FIRST_BLOCK) & acc_mask;
+
+                hist[now] = * get;
+                * get = dry * hist[then] + wet * out[then_acc];
+                out[then_acc] = 0;
+            }
+        }
+
+        data += chunk * channels;
+        frames -= chunk;
+        conv->pos = (pos += chunk);
+
+        if (pos % FIRST_BLOCK)
+            continue;
+
+        for (int s = 0; s < conv->n_segments; s ++)
+        {
+            if (pos % conv->segments[s].block == 0)
+                run_segment (conv, & conv->segments[s]);
+        }
+    }
+}
@@ -0,0 +1,53 @@
+/*
+ * Convolution Reverb Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef CONVOLVER_H
+#define CONVOLVER_H
+
+/* convolver.c */
+
+typedef struct Convolver Convolver;
+
+/* Prepares to convolve <channels> channels with an impulse response given as
+ * <ir_channels> separate arrays.  Channel c uses IR channel c % ir_channels.
+ * This transforms the whole response, so it is not for the audio thread.  With
+ * no response (<ir_frames> 0), the result only delays the dry signal. */
+Convolver * convolver_new (float * const * ir, int ir_frames, int ir_channels,
+ int channels);
+void convolver_clear (Convolver * conv);
+void convolver_free (Convolver * conv);
+
+/* The output is delayed by this many frames. */
+int convolver_latency (void);
+
+/* Frames of silence needed to push out everything still held. */
+int convolver_tail (Convolver * conv);
+
+/* Processes interleaved frames in place. */
+void convolver_run (Convolver * conv, float * data, int frames, float dry,
+ float wet);
+
+/* ir.c */
+
+/* Reads a WAV file through VFS and converts it to <rate>.  Returns one array
+ * per channel, to be freed with ir_free(), or NULL on error. */
+float * * ir_load (const char * filename, int rate, int * channels, int * frames);
+void ir_free (float * * ir, int channels);
+
+#endif
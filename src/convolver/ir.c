@@ -0,0 +1,225 @@
+/*
+ * Convolution Reverb Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <libaudcore/audstrings.h>
+#include <libaudcore/vfs.h>
+
+#include "convolver.h"
+
+#define MAX_IR_CHANNELS 8
+#define MAX_IR_TIME 20 /* seconds */
+#define SINC_ZEROS 16  /* zero crossings on each side of the resampling filter */
+
+#define FORMAT_PCM 1
+#define FORMAT_FLOAT 3
+#define FORMAT_EXTENSIBLE 0xfffe
+
+static int get16 (const unsigned char * p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get32 (const unsigned char * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static float get_sample (const unsigned char * p, int format, int bits)
+{
+    if (format == FORMAT_FLOAT)
+    {
+        if (bits == 64)
+        {
+            union {uint64_t i; double f;} u = {.i = get32 (p) | ((uint64_t) get32 (p + 4) << 32)};
+            return u.f;
+        }
+
+        union {uint32_t i; float f;} u = {.i = get32 (p)};
+        return u.f;
+    }
+
+    switch (bits)
+    {
+    case 8:
+        return (p[0] - 128) / 128.0f;
+    case 16:
+        return (int16_t) get16 (p) / 32768.0f;
+    case 24:
+        return (int32_t) ((p[0] << 8) | (p[1] << 16) | ((uint32_t) p[2] << 24)) /
+         2147483648.0f;
+    default:
+        return (int32_t) get32 (p) / 2147483648.0f;
+    }
+}
+
+/* Windowed-sinc interpolation, low-passed below the lower of the two Nyquist
+ * frequencies.  The result is scaled by the ratio of the rates, so that the
+ * response keeps its level in continuous time. */
+static float * resample (const float * in, int in_frames, int in_rate,
+ int out_rate, int * out_frames)
+{
+    double ratio = (double) out_rate / in_rate;
+    double cutoff = MIN (1, ratio);
+    int width = ceil (SINC_ZEROS / cutoff);
+
+    * out_frames = in_frames * ratio;
+    float * out = malloc (sizeof (float) * MAX (* out_frames, 1));
+
+    for (int i = 0; i < * out_frames; i ++)
+    {
+        double center = i / ratio;
+        int first = MAX (0, (int) ceil (center - width));
+        int last = MIN (in_frames - 1, (int) floor (center + width));
+        double sum = 0;
+
+        for (int k = first; k <= last; k ++)
+        {
+            double x = (k - center) * cutoff;
+            double w = cos (M_PI / 2 * (k - center) / (width + 1));
+            double sinc = (x == 0) ? 1 : sin (M_PI * x) / (M_PI * x);
+
+            sum += in[k] * sinc * w * w;
+        }
+
+        out[i] = sum * cutoff / ratio;
+    }
+
+    return out;
+}
+
+static float * * parse_wav (const unsigned char * data, int64_t size,
+ int * channels, int * rate, int * frames)
+{
+    if (size < 12 || memcmp (data, "RIFF", 4) || memcmp (data + 8, "WAVE", 4))
+        return NULL;
+
+    int format = 0, bits = 0, align = 0;
+    const unsigned char * samples = NULL;
+    int64_t samples_size = 0;
+
+    * channels = 0;
+
+    for (int64_t at = 12; at + 8 <= size; )
+    {
+        const unsigned char * chunk = data + at + 8;
+        int64_t length = MIN (get32 (data + at + 4), size - at - 8);
+
+        if (! memcmp (data + at, "fmt ", 4) && length >= 16)
+        {
+            format = get16 (chunk);
+            * channels = get16 (chunk + 2);
+            * rate = get32 (chunk + 4);
+            align = get16 (chunk + 12);
+            bits = get16 (chunk + 14);
+
+            if (format == FORMAT_EXTENSIBLE && length >= 26)
+                format = get16 (chunk + 24);
+        }
+        else if (! memcmp (data + at, "data", 4))
+        {
+            samples = chunk;
+            samples_size = length;
+        }
+
+        at += 8 + length + (length & 1);
+    }
+
+    int bytes = bits / 8;
+
+    if (format == FORMAT_PCM ? (bits % 8 || bytes < 1 || bytes > 4) :
+     format == FORMAT_FLOAT ? (bits != 32 && bits != 64) : 1)
+        return NULL;
+
+    if (! samples || * channels < 1 || * channels > MAX_IR_CHANNELS ||
+     * rate < 1 || align < bytes * * channels)
+        return NULL;
+
+    * frames = MIN (samples_size / align, (int64_t) * rate * MAX_IR_TIME);
+    if (* frames < 1)
+        return NULL;
+
+    float * * ir = malloc (sizeof (float *) * * channels);
+
+    for (int c = 0; c < * channels; c ++)
+    {
+        ir[c] = malloc (sizeof (float) * * frames);
+
+        for (int f = 0; f < * frames; f ++)
+            ir[c][f] = get_sample (samples + (int64_t) f * align + c * bytes, format, bits);
+    }
+
+    return ir;
+}
+
+float * * ir_load (const char * filename, int rate, int * channels, int * frames)
+{
+    char * uri = strstr (filename, "://") ? g_strdup (filename) : filename_to_uri (filename);
+    if (! uri)
+        return NULL;
+
+    void * data = NULL;
+    int64_t size = 0;
+    vfs_file_get_contents (uri, & data, & size);
+    g_free (uri);
+
+    if (! data)
+    {
+        fprintf (stderr, "convolver: Failed to read %s.\n", filename);
+        return NULL;
+    }
+
+    int file_rate = 0;
+    float * * ir = parse_wav (data, size, channels, & file_rate, frames);
+    g_free (data);
+
+    if (! ir)
+    {
+        fprintf (stderr, "convolver: %s is not a supported WAV file.\n", filename);
+        return NULL;
+    }
+
+    if (file_rate != rate)
+    {
+        int in_frames = * frames;
+
+        for (int c = 0; c < * channels; c ++)
+        {
+            float * converted = resample (ir[c], in_frames, file_rate, rate, frames);
+            free (ir[c]);
+            ir[c] = converted;
+        }
+    }
+
+    return ir;
+}
+
+void ir_free (float * * ir, int channels)
+{
+    for (int c = 0; c < channels; c ++)
+        free (ir[c]);
+
+    free (ir);
+}
@@ -0,0 +1,554 @@
+/*
+ * Convolution Reverb Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* The impulse response is read, resampled, and transformed on a thread of its
+ * own, so that neither a new file nor a new format holds up the audio.  The
+ * audio thread asks for a response by bumping <want_serial>, after setting the
+ * format it needs; the loader hands each result over through <fresh> and
+ * takes back those no longer in use through <retired>.  Both are swapped
+ * atomically, so the audio thread never waits for the loader.
+ *
+ * With no response (none chosen, or the new one not yet loaded), the audio
+ * still goes through a convolver, which is then just a delay line, so that the
+ * latency stays the same whether or not a response is applied.  The response
+ * it replaces (after a format change, say) rings out into the new audio, with
+ * its channels mapped onto the new ones, rather than being cut off.  Since the
+ * one taking over starts out silent for the length of the delay, this also
+ * carries the dry signal across the handoff. */
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include <audacious/i18n.h>
+#include <audacious/misc.h>
+#include <audacious/plugin.h>
+#include <audacious/preferences.h>
+
+#include "config.h"
+#include "convolver.h"
+#include "pump.h"
+#include "scratch.h"
+
+#define MAX_FADING 3
+
+typedef struct Reverb {
+    Convolver * conv;
+    int channels, rate;
+    int left; /* frames, while ringing out */
+    struct Reverb * next; /* while ringing out or once retired */
+} Reverb;
+
+static const char * const convolver_defaults[] = {
+ "file", "",
+ "dry", "100",
+ "wet", "30",
+ "normalize", "TRUE",
+ NULL};
+
+static int current_channels, current_rate;
+static bool_t ending;
+static float dry, wet;
+
+static Reverb * active;
+static Reverb * fading; /* newest first */
+static Reverb * graveyard; /* retired, not yet handed to the loader */
+
+static pthread_t loader_thread;
+static WakePipe loader_pipe;
+static int loader_quit;
+static int want_serial, want_channels, want_rate;
+static Reverb * fresh, * retired;
+
+static float * buffer;
+static int buffer_size;
+
+static int ring_out_slot; /* scratch */
+
+static void config_read (void)
+{
+    dry = aud_get_int ("convolver", "dry") / 100.0f;
+    wet = aud_get_int ("convolver", "wet") / 100.0f;
+}
+
+static void request_load (void)
+{
+    ATOMIC_ADD (want_serial, 1);
+    wake_up (& loader_pipe);
+}
+
+/* scales the response to unit energy per channel */
+static void normalize (float * * ir, int channels, int frames)
+{
+    double energy = 0;
+
+    for (int c = 0; c < channels; c ++)
+    {
+        for (int f = 0; f < frames; f ++)
+            energy += ir[c][f] * ir[c][f];
+    }
+
+    if (energy <= 0)
+        return;
+
+    float scale = 1 / sqrt (energy / channels);
+
+    for (int c = 0; c < channels; c ++)
+    {
+        for (int f = 0; f < frames; f ++)
+            ir[c][f] *= scale;
+    }
+}
+
+static Reverb * load_reverb (int channels, int rate)
+{
+    Reverb * reverb = calloc (1, sizeof (Reverb));
+    reverb->channels = channels;
+    reverb->rate = rate;
+
+    char * file = aud_get_string ("convolver", "file");
+
+    if (file[0])
+    {
+        int ir_channels, ir_frames;
+        float * * ir = ir_load (file, rate, & ir_channels, & ir_frames);
+
+        if (ir)
+        {
+            if (aud_get_bool ("convolver", "normalize"))
+                normalize (ir, ir_channels, ir_frames);
+
+            reverb->conv = convolver_new (ir, ir_frames, ir_channels, channels);
+            ir_free (ir, ir_channels);
+        }
+    }
+
+    g_free (file);
+
+    if (! reverb->conv)
+        reverb->conv = convolver_new (NULL, 0, 0, channels);
+
+    return reverb;
+}
+
+/* A delay line only, cheap enough to set up on the audio thread. */
+static Reverb * dry_reverb (int channels, int rate)
+{
+    Reverb * reverb = calloc (1, sizeof (Reverb));
+    reverb->conv = convolver_new (NULL, 0, 0, channels);
+    reverb->channels = channels;
+    reverb->rate = rate;
+    return reverb;
+}
+
+/* frees a whole list of retired reverbs */
+static void free_reverbs (Reverb * reverb)
+{
+    while (reverb)
+    {
+        Reverb * next = reverb->next;
+        convolver_free (reverb->conv);
+        free (reverb);
+        reverb = next;
+    }
+}
+
+static void * loader (void * unused)
+{
+    int done = 0; /* serial of the last request served */
+
+    while (! ATOMIC_GET (loader_quit))
+    {
+        free_reverbs (ATOMIC_SWAP (retired, NULL));
+
+        int serial = ATOMIC_GET (want_serial);
+        int channels = ATOMIC_GET (want_channels);
+        int rate = ATOMIC_GET (want_rate);
+
+        if (serial == done || ! channels)
+        {
+            ATOMIC_SET (loader_pipe.waiting, 1);
+
+            if (! ATOMIC_GET (loader_quit) && ATOMIC_GET (want_serial) == serial
+             && ! ATOMIC_GET (retired))
+                wake_sleep (& loader_pipe);
+
+            ATOMIC_SET (loader_pipe.waiting, 0);
+            continue;
+        }
+
+        Reverb * reverb = load_reverb (channels, rate);
+        done = serial;
+
+        /* a newer request will be served instead */
+        if (ATOMIC_GET (want_serial) != serial)
+        {
+            free_reverbs (reverb);
+            continue;
+        }
+
+        free_reverbs (ATOMIC_SWAP (fresh, reverb));
+    }
+
+    return NULL;
+}
+
+/* Called from the audio thread.  The reverbs (a list, if any) are queued and
+ * passed on to the loader to be freed as soon as the loader has taken the last
+ * batch. */
+static void retire (Reverb * reverb)
+{
+    while (reverb)
+    {
+        Reverb * next = reverb->next;
+        reverb->next = graveyard;
+        graveyard = reverb;
+        reverb = next;
+    }
+
+    if (graveyard && ! ATOMIC_GET (retired))
+    {
+        ATOMIC_SET (retired, graveyard);
+        graveyard = NULL;
+        wake_up (& loader_pipe);
+    }
+}
+
+/* Starts the reverb in use ringing out, cutting off the oldest of those
+ * already doing so if there are too many. */
+static void fade_out (void)
+{
+    if (! active)
+        return;
+
+    active->left = convolver_tail (active->conv);
+    active->next = fading;
+    fading = active;
+    active = NULL;
+
+    Reverb * * link = & fading;
+
+    for (int count = 0; * link && count < MAX_FADING; count ++)
+        link = & (* link)->next;
+
+    retire (* link);
+    * link = NULL;
+}
+
+static void take_fresh (void)
+{
+    Reverb * reverb = ATOMIC_SWAP (fresh, NULL);
+
+    if (! reverb)
+        return;
+
+    if (reverb->channels != current_channels || reverb->rate != current_rate)
+    {
+        retire (reverb);
+        return;
+    }
+
+    fade_out ();
+    active = reverb;
+}
+
+/* mixes the next <frames> of a fading reverb into <data> */
+static void ring_out (Reverb * reverb, float * data, int frames)
+{
+    int channels = reverb->channels;
+    int run = MIN (frames, reverb->left);
+    float * get = scratch_get (ring_out_slot, run * channels);
+
+    memset (get, 0, sizeof (float) * run * channels);
+    convolver_run (reverb->conv, get, run, dry, wet);
+
+    for (int f = 0; f < run; f ++)
+    {
+        for (int c = 0; c < current_channels; c ++)
+            data[c] += get[c % channels];
+
+        data += current_channels;
+        get += channels;
+    }
+
+    reverb->left -= run;
+}
+
+static void ring_out_all (float * data, int frames)
+{
+    Reverb * * link = & fading;
+
+    while (* link)
+    {
+        Reverb * reverb = * link;
+        ring_out (reverb, data, frames);
+
+        if (reverb->left)
+            link = & reverb->next;
+        else
+        {
+            * link = reverb->next;
+            reverb->next = NULL;
+            retire (reverb);
+        }
+    }
+}
+
+static bool_t convolver_init (void)
+{
+    aud_config_set_defaults ("convolver", convolver_defaults);
+    config_read ();
+
+    if ((ring_out_slot = scratch_reserve (1)) < 0)
+        return FALSE;
+
+    if (! wake_init (& loader_pipe))
+        goto ERR;
+
+    loader_quit = FALSE;
+
+    if (pthread_create (& loader_thread, NULL, loader, NULL))
+    {
+        wake_free (& loader_pipe);
+        goto ERR;
+    }
+
+    return TRUE;
+
+ERR:
+    scratch_release (ring_out_slot, 1);
+    return FALSE;
+}
+
+static void convolver_cleanup (void)
+{
+    ATOMIC_SET (loader_quit, TRUE);
+    wake_signal (& loader_pipe);
+    pthread_join (loader_thread, NULL);
+    wake_free (& loader_pipe);
+
+    free_reverbs (active);
+    free_reverbs (fading);
+    free_reverbs (graveyard);
+    free_reverbs (retired);
+    free_reverbs (fresh);
+
+    active = fading = graveyard = retired = fresh = NULL;
+    want_serial = want_channels = want_rate = 0;
+    current_channels = current_rate = 0;
+
+    free (buffer);
+    buffer = NULL;
+    buffer_size = 0;
+
+    scratch_release (ring_out_slot, 1);
+}
+
+static void convolver_start (int * channels, int * rate)
+{
+    ending = FALSE;
+    current_channels = * channels;
+    current_rate = * rate;
+
+    take_fresh ();
+
+    /* keep the reverb going into the next song if nothing has changed */
+    if (active && active->channels == * channels && active->rate == * rate)
+        return;
+
+    /* delay the audio as a response would until one is loaded */
+    fade_out ();
+    active = dry_reverb (* channels, * rate);
+
+    /* unless the loader is already at work on this format */
+    if (ATOMIC_GET (want_channels) != * channels || ATOMIC_GET (want_rate) != * rate)
+    {
+        ATOMIC_SET (want_channels, * channels);
+        ATOMIC_SET (want_rate, * rate);
+        request_load ();
+    }
+}
+
+static void convolver_process (float * * data, int * samples)
+{
+    int frames = * samples / current_channels;
+
+    take_fresh ();
+    retire (NULL);
+
+    if (active)
+        convolver_run (active->conv, * data, frames, dry, wet);
+
+    ring_out_all (* data, frames);
+}
+
+static void convolver_flush (void)
+{
+    if (active)
+        convolver_clear (active->conv);
+
+    retire (fading);
+    fading = NULL;
+}
+
+static void convolver_finish (float * * data, int * samples)
+{
+    take_fresh ();
+
+    int tail = active ? convolver_tail (active->conv) : 0;
+
+    for (Reverb * reverb = fading; reverb; reverb = reverb->next)
+        tail = MAX (tail, reverb->left);
+
+    /* The first call comes at the end of each song; the reverb carries on into
+     * the next one.  The second call, at the end of the playlist, lets it ring
+     * out. */
+    if (! ending || ! tail)
+    {
+        ending = TRUE;
+        convolver_process (data, samples);
+        return;
+    }
+
+    tail *= current_channels;
+
+    if (buffer_size < * samples + tail)
+    {
+        buffer_size = * samples + tail;
+        buffer = realloc (buffer, sizeof (float) * buffer_size);
+    }
+
+    memcpy (buffer, * data, sizeof (float) * * samples);
+    memset (buffer + * samples, 0, sizeof (float) * tail);
+
+    * data = buffer;
+    * samples += tail;
+
+    convolver_process (data, samples);
+    convolver_flush ();
+    ending = FALSE;
+}
+
+static int convolver_adjust_delay (int delay)
+{
+    if (! current_rate)
+        return delay;
+
+    return delay + (int64_t) convolver_latency () * 1000 / current_rate;
+}
+
+static void file_set (GtkFileChooser * chooser)
+{
+    char * uri = gtk_file_chooser_get_uri (chooser);
+    aud_set_string ("convolver", "file", uri ? uri : "");
+    g_free (uri);
+
+    request_load ();
+}
+
+static void file_clear (GtkButton * button, GtkFileChooser * chooser)
+{
+    gtk_file_chooser_unselect_all (chooser);
+    aud_set_string ("convolver", "file", "");
+
+    request_load ();
+}
+
+static void /* GtkWidget */ * file_chooser_new (void)
+{
+    GtkWidget * hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 6);
+    gtk_box_pack_start ((GtkBox *) hbox, gtk_label_new (_("WAV file:")), FALSE, FALSE, 0);
+
+    GtkWidget * chooser = gtk_file_chooser_button_new (_("Choose Impulse Response"),
+     GTK_FILE_CHOOSER_ACTION_OPEN);
+    gtk_box_pack_start ((GtkBox *) hbox, chooser, TRUE, TRUE, 0);
+
+    GtkFileFilter * filter = gtk_file_filter_new ();
+    gtk_file_filter_set_name (filter, _("WAV files"));
+    gtk_file_filter_add_pattern (filter, "*.wav");
+    gtk_file_filter_add_pattern (filter, "*.WAV");
+    gtk_file_chooser_add_filter ((GtkFileChooser *) chooser, filter);
+
+    char * file = aud_get_string ("convolver", "file");
+
+    if (strstr (file, "://"))
+        gtk_file_chooser_set_uri ((GtkFileChooser *) chooser, file);
+    else if (file[0])
+        gtk_file_chooser_set_filename ((GtkFileChooser *) chooser, file);
+
+    g_free (file);
+
+    GtkWidget * button = gtk_button_new ();
+    gtk_container_add ((GtkContainer *) button, gtk_image_new_from_stock
+     (GTK_STOCK_CLEAR, GTK_ICON_SIZE_BUTTON));
+    gtk_button_set_relief ((GtkButton *) button, GTK_RELIEF_NONE);
+    gtk_box_pack_start ((GtkBox *) hbox, button, FALSE, FALSE, 0);
+
+    g_signal_connect (chooser, "file-set", (GCallback) file_set, NULL);
+    g_signal_connect (button, "clicked", (GCallback) file_clear, chooser);
+
+    return hbox;
+}
+
+static const char convolver_about[] =
+ N_("Convolution Reverb Plugin for Audacious\n"
+    "Copyright 2013 Audacious developers\n\n"
+    "Applies the impulse response of a room, speaker cabinet, or correction "
+    "filter, read from a WAV file.");
+
+static const PreferencesWidget convolver_widgets[] = {
+ {WIDGET_LABEL, N_("<b>Impulse Response</b>")},
+ {WIDGET_CUSTOM, .data = {.populate = file_chooser_new}},
+ {WIDGET_CHK_BTN, N_("Normalize level"),
+  .cfg_type = VALUE_BOOLEAN, .csect = "convolver", .cname = "normalize",
+  .callback = request_load},
+ {WIDGET_LABEL, N_("<b>Mix</b>")},
+ {WIDGET_SPIN_BTN, N_("Dry:"),
+  .cfg_type = VALUE_INT, .csect = "convolver", .cname = "dry",
+  .callback = config_read,
+  .data = {.spin_btn = {0, 100, 1, "%"}}},
+ {WIDGET_SPIN_BTN, N_("Wet:"),
+  .cfg_type = VALUE_INT, .csect = "convolver", .cname = "wet",
+  .callback = config_read,
+  .data = {.spin_btn = {0, 200, 1, "%"}}}};
+
+static const PluginPreferences convolver_prefs = {
+ .widgets = convolver_widgets,
+ .n_widgets = sizeof convolver_widgets / sizeof convolver_widgets[0]};
+
+AUD_EFFECT_PLUGIN
+(
+    .name = N_("Convolution Reverb"),
+    .domain = PACKAGE,
+    .about_text = convolver_about,
+    .prefs = & convolver_prefs,
+    .init = convolver_init,
+    .cleanup = convolver_cleanup,
+    .start = convolver_start,
+    .process = convolver_process,
+    .flush = convolver_flush,
+    .finish = convolver_finish,
+    .adjust_delay = convolver_adjust_delay,
+    .preserves_format = TRUE
+)
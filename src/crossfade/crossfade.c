@@ -26,6 +26,8 @@
 #include <audacious/preferences.h>
 
 #include "config.h"
+#include "chanmix.h"
+#include "scratch.h"
 
 enum
 {
@@ -43,10 +45,20 @@ static const char * const crossfade_defaults[] = {
 static char state = STATE_OFF;
 static int current_channels = 0, current_rate = 0;
 static float * buffer = NULL;
-static int buffer_size = 0, buffer_filled = 0;
+static int buffer_size = 0, buffer_start = 0, buffer_filled = 0;
 static int prebuffer_filled = 0;
-static float * output = NULL;
-static int output_size = 0;
+static int join_slot; /* scratch */
+
+/* The buffer is a ring: the audio in it starts at <buffer_start> and may wrap
+ * around to the beginning.  It holds the overlap (plus whatever has just been
+ * added), and audio leaving it is returned in place whenever it does not
+ * wrap, so that nothing needs to be copied or moved in the common case. */
+
+#define RING(pos) ((buffer_start + (pos)) % buffer_size)
+
+/* Room for a second of audio on top of the overlap, so that the ring seldom
+ * needs to grow while running. */
+#define HEADROOM 1 /* seconds */
 
 static void reset (void)
 {
@@ -56,47 +68,144 @@ static void reset (void)
     free (buffer);
     buffer = NULL;
     buffer_size = 0;
+    buffer_start = 0;
     buffer_filled = 0;
     prebuffer_filled = 0;
-    free (output);
-    output = NULL;
-    output_size = 0;
 }
 
 static bool_t crossfade_init (void)
 {
     aud_config_set_defaults ("crossfade", crossfade_defaults);
-    return TRUE;
+    return (join_slot = scratch_reserve (1)) >= 0;
 }
 
 static void crossfade_cleanup (void)
 {
     reset ();
+    scratch_release (join_slot, 1);
 }
 
-static void crossfade_start (int * channels, int * rate)
+static void enlarge_buffer (int length)
 {
-    if (state != STATE_BETWEEN)
-        reset ();
-    else if (* channels != current_channels)
+    if (length <= buffer_size)
+        return;
+
+    /* Unwrap the audio into the start of the new buffer. */
+    float * new = malloc (sizeof (float) * length);
+    int first = MIN (buffer_filled, buffer_size - buffer_start);
+
+    if (buffer_filled)
     {
-        aud_interface_show_error (_("Crossfading failed because the songs had "
-         "a different number of channels.  You can use the Channel Mixer to "
-         "convert the songs to the same number of channels."));
-        reset ();
+        memcpy (new, buffer + buffer_start, sizeof (float) * first);
+        memcpy (new + first, buffer, sizeof (float) * (buffer_filled - first));
     }
-    else if (* rate != current_rate)
+
+    free (buffer);
+    buffer = new;
+    buffer_size = length;
+    buffer_start = 0;
+}
+
+/* The usual speaker downmix (or upmix) from libfx; beyond the layouts it
+ * knows, channels are simply matched by position. */
+static void build_matrix (int in_channels, int out_channels,
+ float matrix[CHANMIX_MAX][CHANMIX_MAX])
+{
+    if (in_channels <= CHANMIX_MAX && out_channels <= CHANMIX_MAX)
     {
-        aud_interface_show_error (_("Crossfading failed because the songs had "
-         "different sample rates.  You can use the Sample Rate Converter to "
-         "convert the songs to the same sample rate."));
-        reset ();
+        chanmix_matrix (in_channels, out_channels, matrix);
+        return;
+    }
+
+    memset (matrix, 0, sizeof (float) * CHANMIX_MAX * CHANMIX_MAX);
+
+    for (int c = 0; c < MIN (MIN (in_channels, out_channels), CHANMIX_MAX); c ++)
+        matrix[c][c] = 1;
+}
+
+/* Catmull-Rom interpolation between b and c. */
+static float cubic (float a, float b, float c, float d, float t)
+{
+    return b + 0.5f * t * (c - a + t * (2 * a - 5 * b + 4 * c - d + t * (3 *
+     (b - c) + d - a)));
+}
+
+/* Converts the end of the last song, still held in the ring, to the format of
+ * the next one.  Only the overlap is converted, so songs in different formats
+ * can be crossfaded without converting every song in full. */
+static void convert_buffer (int channels, int rate)
+{
+    int in_frames = buffer_filled / current_channels;
+    int out_frames = (int64_t) in_frames * rate / current_rate;
+
+    /* first the channels, at the old rate */
+    float * mapped = malloc (sizeof (float) * MAX (in_frames, 1) * channels);
+    float matrix[CHANMIX_MAX][CHANMIX_MAX];
+    int in_used = MIN (current_channels, CHANMIX_MAX);
+    float frame[in_used];
+
+    build_matrix (current_channels, channels, matrix);
+
+    for (int f = 0; f < in_frames; f ++)
+    {
+        for (int i = 0; i < in_used; i ++)
+            frame[i] = buffer[RING (f * current_channels + i)];
+
+        for (int c = 0; c < channels; c ++)
+        {
+            float sum = 0;
+
+            if (c < CHANMIX_MAX)
+            {
+                for (int i = 0; i < in_used; i ++)
+                    sum += matrix[c][i] * frame[i];
+            }
+
+            mapped[f * channels + c] = sum;
+        }
     }
 
+    /* then the rate */
+    float * converted = malloc (sizeof (float) * MAX (out_frames, 1) * channels);
+
+    for (int f = 0; f < out_frames; f ++)
+    {
+        double pos = (double) f * current_rate / rate;
+        int i = (int) pos;
+        float t = pos - i;
+
+        int i0 = MAX (i - 1, 0), i2 = MIN (i + 1, in_frames - 1);
+        int i3 = MIN (i + 2, in_frames - 1);
+
+        for (int c = 0; c < channels; c ++)
+            converted[f * channels + c] = cubic (mapped[i0 * channels + c],
+             mapped[i * channels + c], mapped[i2 * channels + c],
+             mapped[i3 * channels + c], t);
+    }
+
+    free (mapped);
+    free (buffer);
+
+    buffer = converted;
+    buffer_size = MAX (out_frames, 1) * channels;
+    buffer_start = 0;
+    buffer_filled = out_frames * channels;
+}
+
+static void crossfade_start (int * channels, int * rate)
+{
+    if (state != STATE_BETWEEN)
+        reset ();
+    else if (* channels != current_channels || * rate != current_rate)
+        convert_buffer (* channels, * rate);
+
     state = STATE_PREBUFFER;
     current_channels = * channels;
     current_rate = * rate;
     prebuffer_filled = 0;
+
+    enlarge_buffer (current_channels * current_rate * (aud_get_int ("crossfade",
+     "length") + HEADROOM));
 }
 
 static void do_ramp (float * data, int length, float a, float b)
@@ -116,13 +225,69 @@ static void mix (float * data, float * new, int length)
         (* data ++) += (* new ++);
 }
 
-static void enlarge_buffer (int length)
+/* The following operate on <length> samples starting <pos> samples into the
+ * audio held in the ring, splitting the work where the ring wraps. */
+
+static void ring_ramp (int pos, int length, float a, float b)
+{
+    if (! length)
+        return;
+
+    int at = RING (pos);
+    int first = MIN (length, buffer_size - at);
+    float mid = a + (b - a) * first / length;
+
+    do_ramp (buffer + at, first, a, mid);
+
+    if (first < length)
+        do_ramp (buffer, length - first, mid, b);
+}
+
+static void ring_mix (int pos, float * data, int length)
 {
-    if (length > buffer_size)
+    int at = RING (pos);
+    int first = MIN (length, buffer_size - at);
+
+    mix (buffer + at, data, first);
+    mix (buffer, data + first, length - first);
+}
+
+static void ring_write (int pos, float * data, int length)
+{
+    int at = RING (pos);
+    int first = MIN (length, buffer_size - at);
+
+    if (data)
+    {
+        memcpy (buffer + at, data, sizeof (float) * first);
+        memcpy (buffer, data + first, sizeof (float) * (length - first));
+    }
+    else
+    {
+        memset (buffer + at, 0, sizeof (float) * first);
+        memset (buffer, 0, sizeof (float) * (length - first));
+    }
+}
+
+/* Removes <length> samples from the front of the ring.  The returned pointer
+ * stays valid until the next call into the plugin, since nothing is written
+ * into the ring before then.  Audio that wraps is joined in a scratch slot. */
+static float * ring_take (int length)
+{
+    float * get = buffer + buffer_start;
+    int first = MIN (length, buffer_size - buffer_start);
+
+    if (first < length)
     {
-        buffer = realloc (buffer, sizeof (float) * length);
-        buffer_size = length;
+        float * output = scratch_get (join_slot, length);
+        memcpy (output, get, sizeof (float) * first);
+        memcpy (output + first, buffer, sizeof (float) * (length - first));
+        get = output;
     }
+
+    buffer_start = RING (length);
+    buffer_filled -= length;
+    return get;
 }
 
 static void add_data (float * data, int length)
@@ -140,13 +305,13 @@ static void add_data (float * data, int length)
             if (prebuffer_filled + copy > buffer_filled)
             {
                 enlarge_buffer (prebuffer_filled + copy);
-                memset (buffer + buffer_filled, 0, sizeof (float) *
-                 (prebuffer_filled + copy - buffer_filled));
+                ring_write (buffer_filled, NULL, prebuffer_filled + copy -
+                 buffer_filled);
                 buffer_filled = prebuffer_filled + copy;
             }
 
             do_ramp (data, copy, a, b);
-            mix (buffer + prebuffer_filled, data, copy);
+            ring_mix (prebuffer_filled, data, copy);
             prebuffer_filled += copy;
             data += copy;
             length -= copy;
@@ -159,7 +324,7 @@ static void add_data (float * data, int length)
         {
             int copy = MIN (length, buffer_filled - prebuffer_filled);
 
-            mix (buffer + prebuffer_filled, data, copy);
+            ring_mix (prebuffer_filled, data, copy);
             prebuffer_filled += copy;
             data += copy;
             length -= copy;
@@ -175,37 +340,23 @@ static void add_data (float * data, int length)
         return;
 
     enlarge_buffer (buffer_filled + length);
-    memcpy (buffer + buffer_filled, data, sizeof (float) * length);
+    ring_write (buffer_filled, data, length);
     buffer_filled += length;
 }
 
-static void enlarge_output (int length)
-{
-    if (length > output_size)
-    {
-        output = realloc (output, sizeof (float) * length);
-        output_size = length;
-    }
-}
-
 static void return_data (float * * data, int * length)
 {
     int full = current_channels * current_rate * aud_get_int ("crossfade", "length");
     int copy = buffer_filled - full;
 
-    /* only return if we have at least 1/2 second -- this reduces memmove's */
-    if (state != STATE_RUNNING || copy < current_channels * (current_rate / 2))
+    if (state != STATE_RUNNING || copy <= 0)
     {
         * data = NULL;
         * length = 0;
         return;
     }
 
-    enlarge_output (copy);
-    memcpy (output, buffer, sizeof (float) * copy);
-    buffer_filled -= copy;
-    memmove (buffer, buffer + copy, sizeof (float) * buffer_filled);
-    * data = output;
+    * data = ring_take (copy);
     * length = copy;
 }
 
@@ -220,6 +371,7 @@ static void crossfade_flush (void)
     if (state == STATE_PREBUFFER || state == STATE_RUNNING)
     {
         state = STATE_RUNNING;
+        buffer_start = 0;
         buffer_filled = 0;
     }
 }
@@ -228,11 +380,8 @@ static void crossfade_finish (float * * data, int * samples)
 {
     if (state == STATE_BETWEEN) /* second call, end of last song */
     {
-        enlarge_output (buffer_filled);
-        memcpy (output, buffer, sizeof (float) * buffer_filled);
-        * data = output;
         * samples = buffer_filled;
-        buffer_filled = 0;
+        * data = ring_take (buffer_filled);
         state = STATE_OFF;
         return;
     }
@@ -242,7 +391,7 @@ static void crossfade_finish (float * * data, int * samples)
 
     if (state == STATE_PREBUFFER || state == STATE_RUNNING)
     {
-        do_ramp (buffer, buffer_filled, 1.0, 0.0);
+        ring_ramp (0, buffer_filled, 1.0, 0.0);
         state = STATE_BETWEEN;
     }
 }
@@ -7,6 +7,7 @@
 #include <audacious/preferences.h>
 
 #include "config.h"
+#include "denormal.h"
 
 #define MAX_DELAY 1000
 #define MAX_SRATE 50000
@@ -77,6 +78,8 @@ static void echo_start(int *channels, int *rate)
 
 static void echo_process(float **d, int *samples)
 {
+    DenormalState fpu = denormal_disable ();
+
     int delay = aud_get_int ("echo_plugin", "delay");
     int feedback = aud_get_int ("echo_plugin", "feedback");
     int volume = aud_get_int ("echo_plugin", "volume");
@@ -97,7 +100,7 @@ static void echo_process(float **d, int *samples)
         buf = buffer[r_ofs];
         out = in + buf * volume / 100;
         buf = in + buf * feedback / 100;
-        buffer[w_ofs] = buf;
+        buffer[w_ofs] = denormal_guard (buf);
         *data = out;
 
         if (++r_ofs >= BUFFER_SHORTS)
@@ -105,6 +108,8 @@ static void echo_process(float **d, int *samples)
         if (++w_ofs >= BUFFER_SHORTS)
             w_ofs -= BUFFER_SHORTS;
     }
+
+    denormal_restore (fpu);
 }
 
 static void echo_finish(float **d, int *samples)
@@ -0,0 +1,708 @@
+/*
+ * Effect Benchmark for Audacious Plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Measures the cost of effect plugins outside of the player.  Each plugin is
+ * loaded from its module and handed a stand-in for the player's API, which
+ * keeps the configuration in memory (starting from the plugin's own defaults,
+ * with overrides from the command line).  Synthetic audio is then fed through
+ * the plugin's start/process/finish callbacks a block at a time, and the time
+ * and heap allocations of each call are recorded.
+ *
+ * Each plugin is measured alone, or with --chain all of them are measured in
+ * order as one chain.  One line of JSON is printed per plugin:
+ *
+ *   {"plugin": "echo.so", "rate": 44100, "channels": 2, "block": 512, ...}
+ *
+ * For feedback effects, --signal burst feeds a loud second followed by
+ * silence and reports the cost of the silent part relative to the loud part;
+ * with --max-silence-ratio, a larger ratio (a denormal slowdown, typically)
+ * makes the program exit with an error.
+ *
+ * Anything else a plugin may ask of the player (playback and playlist
+ * control, the rest of the misc API, file access) ends the run with an error
+ * naming the plugin, rather than handing it a null pointer.
+ *
+ * Built along with the plugins when configured with --enable-fxbench; it is
+ * not installed.  The plugins look for libfx where it is installed, so that
+ * has to be done first. */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <glib.h>
+
+#include <audacious/misc.h>
+#include <audacious/plugin.h>
+#include <libaudcore/vfs.h>
+
+#define MAX_PLUGINS 32
+#define MAX_SETTINGS 1024
+#define BURST_TIME 1 /* seconds of loud audio in the burst signal */
+#define MAX_API_FUNCS 512 /* more than any one API of the player has */
+
+enum {SIGNAL_NOISE, SIGNAL_SINE, SIGNAL_BURST};
+
+typedef struct {
+    char * section, * name, * value;
+} Setting;
+
+typedef struct {
+    const char * path;
+    void * handle;
+    EffectPlugin * header;
+
+    int in_channels, in_rate;   /* format given to the plugin */
+    int64_t frames_in;
+    double total_ns, loud_ns, quiet_ns, worst_ns, finish_ns;
+    int64_t loud_frames, quiet_frames;
+    int64_t blocks, allocs;
+} Stage;
+
+static Setting settings[MAX_SETTINGS];
+static int n_settings;
+
+static Stage stages[MAX_PLUGINS];
+static int n_stages;
+
+static int opt_rate = 44100, opt_channels = 2, opt_block = 512;
+static double opt_seconds = 10, opt_warmup = 1;
+static int opt_signal = SIGNAL_NOISE;
+static int opt_chain, opt_units;
+static double opt_max_silence_ratio;
+
+/* ---- heap allocations ---- */
+
+/* Calls into the C library allocator are counted while a plugin runs.  This
+ * relies on glibc's internal entry points; elsewhere the count is reported as
+ * -1. */
+
+static int counting;
+static int64_t alloc_count;
+
+#ifdef __GLIBC__
+#define COUNT_ALLOCS 1
+
+extern void * __libc_malloc (size_t size);
+extern void * __libc_calloc (size_t n, size_t size);
+extern void * __libc_realloc (void * mem, size_t size);
+extern void * __libc_memalign (size_t align, size_t size);
+
+void * malloc (size_t size)
+{
+    if (counting)
+        alloc_count ++;
+
+    return __libc_malloc (size);
+}
+
+void * calloc (size_t n, size_t size)
+{
+    if (counting)
+        alloc_count ++;
+
+    return __libc_calloc (n, size);
+}
+
+void * realloc (void * mem, size_t size)
+{
+    if (counting)
+        alloc_count ++;
+
+    return __libc_realloc (mem, size);
+}
+
+int posix_memalign (void * * mem, size_t align, size_t size)
+{
+    if (counting)
+        alloc_count ++;
+
+    * mem = __libc_memalign (align, size);
+    return * mem ? 0 : ENOMEM;
+}
+#else
+#define COUNT_ALLOCS 0
+#endif
+
+/* ---- configuration ---- */
+
+static Setting * find_setting (const char * section, const char * name)
+{
+    for (int i = 0; i < n_settings; i ++)
+    {
+        if (! strcmp (settings[i].section, section) && ! strcmp (settings[i].name, name))
+            return & settings[i];
+    }
+
+    return NULL;
+}
+
+static void put_setting (const char * section, const char * name,
+ const char * value, bool_t replace)
+{
+    Setting * s = find_setting (section, name);
+
+    if (s)
+    {
+        if (replace)
+        {
+            g_free (s->value);
+            s->value = g_strdup (value);
+        }
+
+        return;
+    }
+
+    if (n_settings == MAX_SETTINGS)
+    {
+        fprintf (stderr, "fxbench: too many settings\n");
+        exit (1);
+    }
+
+    s = & settings[n_settings ++];
+    s->section = g_strdup (section);
+    s->name = g_strdup (name);
+    s->value = g_strdup (value);
+}
+
+static const char * get_value (const char * section, const char * name)
+{
+    Setting * s = find_setting (section, name);
+    return s ? s->value : "";
+}
+
+static void stub_set_defaults (const char * section, const char * const * entries)
+{
+    for (; entries[0]; entries += 2)
+        put_setting (section, entries[0], entries[1], FALSE);
+}
+
+static void stub_clear_section (const char * section)
+{
+    for (int i = 0; i < n_settings; )
+    {
+        if (strcmp (settings[i].section, section))
+        {
+            i ++;
+            continue;
+        }
+
+        g_free (settings[i].section);
+        g_free (settings[i].name);
+        g_free (settings[i].value);
+        settings[i] = settings[-- n_settings];
+    }
+}
+
+static void stub_set_string (const char * section, const char * name, const char * value)
+    { put_setting (section, name, value, TRUE); }
+static char * stub_get_string (const char * section, const char * name)
+    { return g_strdup (get_value (section, name)); }
+
+static void stub_set_bool (const char * section, const char * name, bool_t value)
+    { put_setting (section, name, value ? "TRUE" : "FALSE", TRUE); }
+static bool_t stub_get_bool (const char * section, const char * name)
+    { return ! strcmp (get_value (section, name), "TRUE"); }
+
+static void stub_set_int (const char * section, const char * name, int value)
+{
+    char buf[16];
+    snprintf (buf, sizeof buf, "%d", value);
+    put_setting (section, name, buf, TRUE);
+}
+
+static int stub_get_int (const char * section, const char * name)
+    { return atoi (get_value (section, name)); }
+
+static void stub_set_double (const char * section, const char * name, double value)
+{
+    char buf[32];
+    snprintf (buf, sizeof buf, "%g", value);
+    put_setting (section, name, buf, TRUE);
+}
+
+static double stub_get_double (const char * section, const char * name)
+    { return strtod (get_value (section, name), NULL); }
+
+static const char * stub_get_path (int id)
+{
+    return g_get_tmp_dir ();
+}
+
+/* ---- everything else ---- */
+
+static const char * running = "fxbench"; /* the plugin being called */
+
+static void unsupported (void)
+{
+    fprintf (stderr, "fxbench: %s called a player function that fxbench does "
+     "not provide\n", running);
+    exit (1);
+}
+
+static VFSConstructor * unsupported_vfs (const char * scheme)
+{
+    fprintf (stderr, "fxbench: %s tried to open a %s:// file; fxbench does not "
+     "provide file access\n", running, scheme);
+    exit (1);
+}
+
+/* The API tables hold nothing but function pointers. */
+static void fill_unsupported (void (* * funcs) (void), int count)
+{
+    for (int i = 0; i < count; i ++)
+        funcs[i] = unsupported;
+}
+
+static void (* unsupported_api[MAX_API_FUNCS]) (void);
+static MiscAPI misc_api;
+static AudAPITable api_table;
+
+static void setup_api (void)
+{
+    fill_unsupported (unsupported_api, MAX_API_FUNCS);
+    fill_unsupported ((void (* *) (void)) & misc_api,
+     sizeof misc_api / sizeof unsupported_api[0]);
+
+    misc_api.config_set_defaults = stub_set_defaults;
+    misc_api.config_clear_section = stub_clear_section;
+    misc_api.set_string = stub_set_string;
+    misc_api.get_string = stub_get_string;
+    misc_api.set_bool = stub_set_bool;
+    misc_api.get_bool = stub_get_bool;
+    misc_api.set_int = stub_set_int;
+    misc_api.get_int = stub_get_int;
+    misc_api.set_double = stub_set_double;
+    misc_api.get_double = stub_get_double;
+    misc_api.get_path = stub_get_path;
+
+    api_table.drct_api = (void *) unsupported_api;
+    api_table.misc_api = & misc_api;
+    api_table.playlist_api = (void *) unsupported_api;
+    api_table.plugins_api = (void *) unsupported_api;
+
+    vfs_set_lookup_func (unsupported_vfs);
+}
+
+/* ---- signals ---- */
+
+static float * signal_buf;
+static int64_t signal_frames;
+
+static void make_signal (int channels, int rate, int64_t frames)
+{
+    uint32_t seed = 12345;
+
+    signal_buf = g_malloc (sizeof (float) * frames * channels);
+    signal_frames = frames;
+
+    for (int64_t f = 0; f < frames; f ++)
+    {
+        for (int c = 0; c < channels; c ++)
+        {
+            float val;
+
+            if (opt_signal == SIGNAL_SINE)
+                val = 0.5f * sinf (2 * M_PI * 440 * (c + 1) * f / rate);
+            else
+            {
+                seed = seed * 1664525 + 1013904223;
+                val = (int32_t) seed * (0.5f / 2147483648.0f);
+            }
+
+            if (opt_signal == SIGNAL_BURST)
+                val = (f < (int64_t) rate * (opt_warmup + BURST_TIME)) ? val * 1.8f : 0;
+
+            signal_buf[f * channels + c] = val;
+        }
+    }
+}
+
+/* ---- measurement ---- */
+
+static const char * base_name (const char * path)
+{
+    const char * slash = strrchr (path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static double now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool_t load_stage (Stage * stage, const char * path)
+{
+    memset (stage, 0, sizeof (Stage));
+    stage->path = path;
+    running = base_name (path);
+
+    if (! (stage->handle = dlopen (path, RTLD_NOW | RTLD_LOCAL)))
+    {
+        fprintf (stderr, "fxbench: %s\n", dlerror ());
+        return FALSE;
+    }
+
+    Plugin * (* get_info) (AudAPITable * table) = (Plugin * (*) (AudAPITable *))
+     dlsym (stage->handle, "get_plugin_info");
+    Plugin * header = get_info ? get_info (& api_table) : NULL;
+
+    if (! header || header->type != PLUGIN_TYPE_EFFECT)
+    {
+        fprintf (stderr, "fxbench: %s is not an effect plugin\n", path);
+        return FALSE;
+    }
+
+    stage->header = (EffectPlugin *) header;
+
+    if (stage->header->init && ! stage->header->init ())
+    {
+        fprintf (stderr, "fxbench: %s failed to initialize\n", path);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void unload_stage (Stage * stage)
+{
+    running = base_name (stage->path);
+
+    if (stage->header && stage->header->cleanup)
+        stage->header->cleanup ();
+
+    if (stage->handle)
+        dlclose (stage->handle);
+}
+
+static void add_time (Stage * stage, int frames, double time, bool_t quiet)
+{
+    stage->frames_in += frames;
+    stage->total_ns += time;
+    stage->worst_ns = MAX (stage->worst_ns, time);
+    stage->blocks ++;
+
+    if (quiet)
+    {
+        stage->quiet_ns += time;
+        stage->quiet_frames += frames;
+    }
+    else
+    {
+        stage->loud_ns += time;
+        stage->loud_frames += frames;
+    }
+}
+
+/* Runs one call of a stage, timing it once <measure> is set. */
+static double run_stage (Stage * stage, void (* func) (float * *, int *),
+ float * * data, int * samples, bool_t measure, bool_t quiet)
+{
+    int frames = * samples / stage->in_channels;
+
+    running = base_name (stage->path);
+    counting = measure;
+    alloc_count = 0;
+
+    double start = now_ns ();
+    func (data, samples);
+    double time = now_ns () - start;
+
+    counting = FALSE;
+
+    if (measure)
+    {
+        add_time (stage, frames, time, quiet);
+        stage->allocs += alloc_count;
+    }
+
+    return time;
+}
+
+/* <total>, if given, collects the time of the whole chain. */
+static void run_chain (Stage * chain, int count, Stage * total)
+{
+    int channels = opt_channels, rate = opt_rate;
+
+    for (int i = 0; i < count; i ++)
+    {
+        chain[i].in_channels = channels;
+        chain[i].in_rate = rate;
+        running = base_name (chain[i].path);
+
+        if (chain[i].header->start)
+            chain[i].header->start (& channels, & rate);
+    }
+
+    int64_t warmup = opt_rate * opt_warmup;
+    int64_t burst_end = opt_rate * (opt_warmup + BURST_TIME);
+    float * block = g_malloc (sizeof (float) * opt_block * opt_channels);
+
+    for (int64_t at = 0; at < signal_frames; at += opt_block)
+    {
+        int frames = MIN (opt_block, signal_frames - at);
+        bool_t measure = (at >= warmup);
+        bool_t quiet = (opt_signal == SIGNAL_BURST && at >= burst_end);
+
+        memcpy (block, signal_buf + at * opt_channels, sizeof (float) * frames * opt_channels);
+
+        float * data = block;
+        int samples = frames * opt_channels;
+        double time = 0;
+
+        for (int i = 0; i < count; i ++)
+        {
+            if (chain[i].header->process)
+                time += run_stage (& chain[i], chain[i].header->process,
+                 & data, & samples, measure, quiet);
+        }
+
+        if (total && measure)
+            add_time (total, frames, time, quiet);
+    }
+
+    /* end of song, then end of playlist */
+    for (int pass = 0; pass < 2; pass ++)
+    {
+        float * data = block;
+        int samples = 0;
+
+        for (int i = 0; i < count; i ++)
+        {
+            void (* func) (float * *, int *) = chain[i].header->finish ?
+             chain[i].header->finish : chain[i].header->process;
+
+            if (! func)
+                continue;
+
+            running = base_name (chain[i].path);
+            double start = now_ns ();
+            func (& data, & samples);
+            double time = now_ns () - start;
+
+            chain[i].finish_ns += time;
+            if (total)
+                total->finish_ns += time;
+        }
+    }
+
+    g_free (block);
+}
+
+static bool_t report (const Stage * stage, const char * name)
+{
+    double frames = MAX (stage->frames_in, 1);
+    double ns_per_frame = stage->total_ns / frames;
+    bool_t ok = TRUE;
+
+    printf ("{\"plugin\": \"%s\", \"rate\": %d, \"channels\": %d, \"block\": %d, "
+     "\"blocks\": %" G_GINT64_FORMAT ", \"ns_per_frame\": %.3f, "
+     "\"ns_per_sample\": %.3f, \"worst_block_us\": %.3f, \"finish_us\": %.3f, ",
+     name, stage->in_rate, stage->in_channels, opt_block, stage->blocks,
+     ns_per_frame, ns_per_frame / stage->in_channels, stage->worst_ns / 1000,
+     stage->finish_ns / 1000);
+
+    if (COUNT_ALLOCS)
+        printf ("\"allocs_per_block\": %.3f", (double) stage->allocs / MAX (stage->blocks, 1));
+    else
+        printf ("\"allocs_per_block\": -1");
+
+    if (opt_units > 0)
+        printf (", \"units\": %d, \"ns_per_unit_channel_frame\": %.4f", opt_units,
+         ns_per_frame / stage->in_channels / opt_units);
+
+    if (opt_signal == SIGNAL_BURST && stage->loud_frames && stage->quiet_frames)
+    {
+        double loud = stage->loud_ns / stage->loud_frames;
+        double quiet = stage->quiet_ns / stage->quiet_frames;
+        double ratio = quiet / loud;
+
+        printf (", \"loud_ns_per_frame\": %.3f, \"silent_ns_per_frame\": %.3f, "
+         "\"silence_ratio\": %.3f", loud, quiet, ratio);
+
+        if (opt_max_silence_ratio > 0 && ratio > opt_max_silence_ratio)
+            ok = FALSE;
+    }
+
+    printf ("}\n");
+    return ok;
+}
+
+/* ---- command line ---- */
+
+static void usage (void)
+{
+    fprintf (stderr,
+     "Usage: fxbench [options] plugin.so ...\n"
+     "  --rate N              sample rate (44100)\n"
+     "  --channels N          channel count (2)\n"
+     "  --block N             frames per block (512)\n"
+     "  --seconds S           length of audio measured (10)\n"
+     "  --warmup S            audio run before measuring (1)\n"
+     "  --signal TYPE         noise, sine or burst (noise)\n"
+     "  --chain               run all plugins as one chain\n"
+     "  --set SECT:NAME=VAL   override a setting\n"
+     "  --units N             also report cost per unit (band, etc.)\n"
+     "  --eq-bands N          enable N parametric-eq bands (implies --units N)\n"
+     "  --max-silence-ratio R fail if silence costs more than R times audio\n");
+    exit (1);
+}
+
+static void parse_set (const char * arg)
+{
+    const char * colon = strchr (arg, ':');
+    const char * equals = colon ? strchr (colon, '=') : NULL;
+
+    if (! equals)
+        usage ();
+
+    char * section = g_strndup (arg, colon - arg);
+    char * name = g_strndup (colon + 1, equals - colon - 1);
+
+    put_setting (section, name, equals + 1, TRUE);
+
+    g_free (section);
+    g_free (name);
+}
+
+static void set_eq_bands (int bands)
+{
+    for (int b = 0; b < bands; b ++)
+    {
+        char name[32];
+        snprintf (name, sizeof name, "band%d_gain", b + 1);
+        put_setting ("parametric-eq", name, (b & 1) ? "-3" : "3", TRUE);
+    }
+
+    opt_units = bands;
+}
+
+int main (int argc, char * * argv)
+{
+    const char * paths[MAX_PLUGINS];
+    int n_paths = 0;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        const char * arg = argv[i];
+        const char * val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (! strcmp (arg, "--chain"))
+        {
+            opt_chain = TRUE;
+            continue;
+        }
+
+        if (arg[0] != '-')
+        {
+            if (n_paths == MAX_PLUGINS)
+                usage ();
+
+            paths[n_paths ++] = arg;
+            continue;
+        }
+
+        if (! val)
+            usage ();
+
+        i ++;
+
+        if (! strcmp (arg, "--rate"))
+            opt_rate = atoi (val);
+        else if (! strcmp (arg, "--channels"))
+            opt_channels = atoi (val);
+        else if (! strcmp (arg, "--block"))
+            opt_block = atoi (val);
+        else if (! strcmp (arg, "--seconds"))
+            opt_seconds = atof (val);
+        else if (! strcmp (arg, "--warmup"))
+            opt_warmup = atof (val);
+        else if (! strcmp (arg, "--set"))
+            parse_set (val);
+        else if (! strcmp (arg, "--units"))
+            opt_units = atoi (val);
+        else if (! strcmp (arg, "--eq-bands"))
+            set_eq_bands (atoi (val));
+        else if (! strcmp (arg, "--max-silence-ratio"))
+            opt_max_silence_ratio = atof (val);
+        else if (! strcmp (arg, "--signal"))
+        {
+            if (! strcmp (val, "noise"))
+                opt_signal = SIGNAL_NOISE;
+            else if (! strcmp (val, "sine"))
+                opt_signal = SIGNAL_SINE;
+            else if (! strcmp (val, "burst"))
+                opt_signal = SIGNAL_BURST;
+            else
+                usage ();
+        }
+        else
+            usage ();
+    }
+
+    if (! n_paths || opt_rate < 1 || opt_channels < 1 || opt_block < 1 ||
+     opt_seconds <= 0 || opt_warmup < 0)
+        usage ();
+
+    setup_api ();
+    make_signal (opt_channels, opt_rate, opt_rate * (opt_warmup + opt_seconds));
+
+    bool_t ok = TRUE;
+
+    for (int i = 0; i < n_paths; i ++)
+    {
+        if (! load_stage (& stages[n_stages], paths[i]))
+            return 1;
+
+        n_stages ++;
+
+        if (opt_chain)
+            continue;
+
+        run_chain (& stages[n_stages - 1], 1, NULL);
+        ok = report (& stages[n_stages - 1], base_name (paths[i])) && ok;
+    }
+
+    if (opt_chain)
+    {
+        Stage total = {.in_channels = opt_channels, .in_rate = opt_rate};
+
+        run_chain (stages, n_stages, & total);
+
+        for (int i = 0; i < n_stages; i ++)
+        {
+            ok = report (& stages[i], base_name (stages[i].path)) && ok;
+            total.allocs += stages[i].allocs;
+        }
+
+        ok = report (& total, "chain") && ok;
+    }
+
+    for (int i = n_stages; i --; )
+        unload_stage (& stages[i]);
+
+    return ok ? 0 : 2;
+}
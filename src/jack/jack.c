@@ -1,410 +1,847 @@
-/*      xmms - jack output plugin
- *    Copyright 2002 Chris Morgan<cmorgan@alum.wpi.edu>
+/*
+ * JACK Output Plugin for Audacious
+ * Copyright 2002 Chris Morgan <cmorgan@alum.wpi.edu>
+ * Audacious port (2005-2006) by Giacomo Lozito from develia.org
+ * Copyright 2013 Audacious developers
  *
- *      audacious port (2005-2006) by Giacomo Lozito from develia.org
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
  *
- *    This code maps xmms calls into the jack translation library
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
  */
 
-#include <dlfcn.h>
-#include <limits.h>
+/* Each port has its own ring of float samples at the server's rate.  The
+ * playback thread does all the work: it converts the data to float, resamples
+ * it if the server runs at another rate, and splits the channels into the
+ * rings.  The process callback then only copies each ring into its port
+ * (applying the volume on the way); it never blocks, allocates, or takes a
+ * lock.
+ *
+ * Anything that must not overlap with the process callback (emptying or
+ * replacing the rings) is done by the playback thread after a handshake: it
+ * bumps sync_serial and waits for the callback to acknowledge it in sync_done.
+ * The callback drops whatever is in the rings when it does so.  If it does not
+ * answer in time, the client is treated as dead; the rings are freed only
+ * after it has been closed, since a stalled callback may yet resume.
+ *
+ * Buffer size and sample rate changes reported by the server are picked up
+ * by the playback thread on its next write; the connection stays open. */
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <jack/jack.h>
+#include <samplerate.h>
 
+#include <audacious/debug.h>
 #include <audacious/i18n.h>
 #include <audacious/misc.h>
 #include <audacious/plugin.h>
+#include <libaudcore/audio.h>
 
 #include "config.h"
-#include "bio2jack.h" /* includes for the bio2jack library */
-#include "jack.h"
+#include "outstats.h"
+#include "ring.h"
+#include "scratch.h"
+
+#define MAX_CHANNELS 10
+#define RING_SLACK 256 /* frames of room beyond the fill target, for the resampler */
+#define WAIT_TIMEOUT 100 /* milliseconds */
+#define SYNC_TRIES 10
+#define RECONNECT_DELAY 250 /* milliseconds */
+#define DEAD_CHUNK 10 /* milliseconds of audio dropped per write while disconnected */
+
+enum {CONNECT_ALL, CONNECT_OUTPUT, CONNECT_NONE};
+
+static const char * const jack_defaults[] = {
+ "port_connection_mode", "CONNECT_ALL",
+ "volume_left", "25",
+ "volume_right", "25",
+ NULL};
 
-/* set to 1 for verbose output */
-#define VERBOSE_OUTPUT          0
+/* owned by the playback thread */
+static jack_client_t * client;
+static int client_channels; /* ports registered */
+static int64_t last_reconnect;
 
-jackconfig jack_cfg;
+static int in_format, in_rate, in_channels, in_frame_size;
+static int out_rate, out_period; /* server settings the rings were set up for */
+static int buffer_frames, ring_frames;
+static SRC_STATE * resampler;
+static double resample_ratio;
 
-#define OUTFILE stderr
+static int flush_time; /* milliseconds */
+static int64_t written; /* input frames since flush_time */
+static int64_t played_base; /* server frames at flush_time */
+
+/* shared with the process callback */
+static jack_port_t * ports[MAX_CHANNELS];
+static Ring rings[MAX_CHANNELS];
+static int active_channels; /* rings the callback may use */
+static int fill_target; /* frames */
+static char prebuffer, paused, draining;
+static int sync_serial, sync_done;
+static int64_t played; /* frames taken from the rings, ever */
+static int64_t played_at; /* when played last grew, in microseconds */
+static int played_seq; /* odd while the two above are being changed */
+static int volume_left, volume_right;
+
+/* set by the other server callbacks */
+static int server_rate, server_period, server_latency;
+static char client_dead;
+
+static char writer_waiting;
+static sem_t writer_sem, sync_sem;
+
+/* last time reported, in the low half; bumped by flush in the high half */
+static int64_t reported;
+
+static OutputStats jack_stats;
+
+static int slots; /* scratch: converted, then resampled audio */
+
+static int64_t now_ms (void)
+{
+    return stats_now () / 1000;
+}
+
+static void sem_wait_ms (sem_t * sem, int ms)
+{
+    struct timespec ts;
+    clock_gettime (CLOCK_REALTIME, & ts);
+
+    ts.tv_nsec += (long) ms * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    while (sem_timedwait (sem, & ts) < 0 && errno == EINTR)
+        ;
+}
 
-#define TRACE(...)                                      \
-    if(jack_cfg.isTraceEnabled) {                       \
-        fprintf(OUTFILE, "%s:", __FUNCTION__),          \
-        fprintf(OUTFILE, __VA_ARGS__),                    \
-        fflush(OUTFILE);                                \
+/* The last ring is filled last and emptied last, so from either side it never
+ * holds more (for the writer) or less (for the callback) than the others. */
+static int filled_frames (int channels)
+{
+    if (! channels)
+        return 0;
+
+    return ring_filled (& rings[channels - 1]) / sizeof (float);
+}
+
+static void read_port (Ring * ring, float * out, int frames, float gain)
+{
+    while (frames)
+    {
+        void * data;
+        int avail = ring_peek (ring, & data) / sizeof (float);
+        int copy = MIN (avail, frames);
+        const float * in = data;
+
+        if (gain == 1)
+            memcpy (out, in, sizeof (float) * copy);
+        else
+        {
+            for (int i = 0; i < copy; i ++)
+                out[i] = in[i] * gain;
+        }
+
+        ring_consume (ring, sizeof (float) * copy);
+        out += copy;
+        frames -= copy;
     }
+}
 
-#define ERR(...)                                        \
-    if(jack_cfg.isTraceEnabled) {                       \
-        fprintf(OUTFILE, "ERR: %s:", __FUNCTION__),     \
-        fprintf(OUTFILE, __VA_ARGS__),                    \
-        fflush(OUTFILE);                                \
+static int process_cb (jack_nframes_t nframes, void * unused)
+{
+    static char starved;
+
+    /* the serial must be read before the channel count; see sync_callback */
+    int serial = ATOMIC_GET (sync_serial);
+    int channels = ATOMIC_GET (active_channels);
+
+    stats_count (& jack_stats.wakeups);
+
+    if (serial != ATOMIC_GET (sync_done))
+    {
+        for (int c = 0; c < channels; c ++)
+            ring_consume (& rings[c], ring_filled (& rings[c]));
+
+        starved = 0;
+        ATOMIC_SET (sync_done, serial);
+        sem_post (& sync_sem);
     }
 
+    int avail = filled_frames (channels);
+    int target = ATOMIC_GET (fill_target);
+    int copy = 0;
 
-static int driver = 0; /* handle to the jack output device */
+    if (channels)
+        stats_fill (& jack_stats.ring, avail, target);
 
-typedef struct format_info {
-  int format;
-  long    frequency;
-  int     channels;
-  long    bps;
-} format_info_t;
+    if (ATOMIC_GET (prebuffer) && (avail >= target || ATOMIC_GET (draining)))
+        ATOMIC_SET (prebuffer, 0);
 
-static format_info_t input;
-static format_info_t effect;
-static format_info_t output;
+    if (channels && ! ATOMIC_GET (paused) && ! ATOMIC_GET (prebuffer))
+    {
+        copy = MIN (avail, (int) nframes);
 
-static bool_t output_opened; /* true if we have a connection to jack */
-static bool_t paused;
+        if (copy < (int) nframes)
+        {
+            if (! starved && ! ATOMIC_GET (draining))
+                stats_count (& jack_stats.starvations);
 
+            starved = 1;
+        }
+        else
+            starved = 0;
+    }
 
-/* Giacomo's note: removed the destructor from the original xmms-jack, cause
-   destructors + thread join + NPTL currently leads to problems; solved this
-   by adding a cleanup function callback for output plugins in Audacious, this
-   is used to close the JACK connection and to perform a correct shutdown */
-static void jack_cleanup(void)
-{
-  int errval;
-  TRACE("cleanup\n");
+    float gain_left = ATOMIC_GET (volume_left) / 100.0f;
+    float gain_right = ATOMIC_GET (volume_right) / 100.0f;
+
+    for (int c = 0; c < client_channels; c ++)
+    {
+        float * out = jack_port_get_buffer (ports[c], nframes);
+        int part = (c < channels) ? copy : 0;
 
-  if((errval = JACK_Close(driver)))
-    ERR("error closing device, errval of %d\n", errval);
+        if (part)
+            read_port (& rings[c], out, part, (c & 1) ? gain_right : gain_left);
 
-  return;
+        memset (out + part, 0, sizeof (float) * (nframes - part));
+    }
+
+    if (copy)
+    {
+        ATOMIC_ADD (played_seq, 1);
+        ATOMIC_SET (played_at, stats_now ());
+        ATOMIC_ADD (played, copy);
+        ATOMIC_ADD (played_seq, 1);
+
+        if (ATOMIC_GET (writer_waiting))
+        {
+            ATOMIC_SET (writer_waiting, 0);
+            sem_post (& writer_sem);
+        }
+    }
+
+    return 0;
 }
 
+static int xrun_cb (void * unused)
+{
+    stats_count (& jack_stats.underruns);
+    return 0;
+}
 
-/* Set the volume */
-static void jack_set_volume(int l, int r)
+static int bufsize_cb (jack_nframes_t nframes, void * unused)
 {
-  if(output.channels == 1)
-  {
-    TRACE("l(%d)\n", l);
-  } else if(output.channels > 1)
-  {
-    TRACE("l(%d), r(%d)\n", l, r);
-  }
+    ATOMIC_SET (server_period, (int) nframes);
+    return 0;
+}
+
+static int srate_cb (jack_nframes_t nframes, void * unused)
+{
+    ATOMIC_SET (server_rate, (int) nframes);
+    return 0;
+}
+
+static void latency_cb (jack_latency_callback_mode_t mode, void * unused)
+{
+    if (mode != JackPlaybackLatency || ! client_channels)
+        return;
 
-  if(output.channels > 0) {
-      JACK_SetVolumeForChannel(driver, 0, l);
-      jack_cfg.volume_left = l;
-  }
-  if(output.channels > 1) {
-      JACK_SetVolumeForChannel(driver, 1, r);
-      jack_cfg.volume_right = r;
-  }
+    jack_latency_range_t range;
+    jack_port_get_latency_range (ports[0], JackPlaybackLatency, & range);
+    ATOMIC_SET (server_latency, (int) range.max);
 }
 
+static void shutdown_cb (void * unused)
+{
+    ATOMIC_SET (client_dead, 1);
+    sem_post (& writer_sem);
+    sem_post (& sync_sem);
+}
 
-/* Get the current volume setting */
-static void jack_get_volume(int *l, int *r)
+/* Waits until the process callback has seen everything changed so far and has
+ * emptied the rings.  Afterwards it does not touch rings beyond
+ * active_channels until the next cycle.  Returns 0 if that cannot be known, in
+ * which case the client is marked dead. */
+static int sync_callback (void)
 {
-  unsigned int _l, _r;
+    int serial = ATOMIC_ADD (sync_serial, 1);
+
+    for (int tries = 0; tries < SYNC_TRIES; tries ++)
+    {
+        if (! client || ATOMIC_GET (sync_done) == serial)
+            return 1;
+        if (ATOMIC_GET (client_dead))
+            return 0;
+
+        sem_wait_ms (& sync_sem, WAIT_TIMEOUT);
+    }
 
-  if(output.channels > 0)
-  {
-      JACK_GetVolumeForChannel(driver, 0, &_l);
-      (*l) = _l;
-  }
-  if(output.channels > 1)
-  {
-      JACK_GetVolumeForChannel(driver, 1, &_r);
-      (*r) = _r;
-  }
+    fprintf (stderr, "jack: The process callback is not running.\n");
+    ATOMIC_SET (client_dead, 1);
+    return 0;
+}
+
+static void connect_ports (int channels)
+{
+    char * mode_name = aud_get_string ("jack", "port_connection_mode");
+    int mode = ! strcmp (mode_name, "CONNECT_NONE") ? CONNECT_NONE :
+     ! strcmp (mode_name, "CONNECT_OUTPUT") ? CONNECT_OUTPUT : CONNECT_ALL;
+    free (mode_name);
+
+    if (mode == CONNECT_NONE)
+        return;
+
+    const char * * targets = jack_get_ports (client, NULL, NULL,
+     JackPortIsPhysical | JackPortIsInput);
+    int count = 0;
+
+    while (targets && targets[count])
+        count ++;
+
+    if (count < channels)
+        fprintf (stderr, "jack: Found only %d physical ports for %d channels.\n",
+         count, channels);
+
+    /* In CONNECT_ALL mode, the extra physical ports (or our extra channels)
+     * are connected round-robin; JACK does the mixing. */
+    int links = (mode == CONNECT_ALL && count) ? MAX (count, channels) : MIN (count, channels);
+
+    for (int i = 0; i < links; i ++)
+    {
+        jack_port_t * port = ports[i % channels];
+        const char * target = targets[i % count];
+
+        if (jack_connect (client, jack_port_name (port), target))
+            fprintf (stderr, "jack: Cannot connect to %s.\n", target);
+    }
 
-#if VERBOSE_OUTPUT
-  if(output.channels == 1)
-      TRACE("l(%d)\n", *l);
-  else if(output.channels > 1)
-      TRACE("l(%d), r(%d)\n", *l, *r);
-#endif
+    jack_free (targets);
 }
 
+static void close_client (void)
+{
+    if (! client)
+        return;
+
+    jack_client_close (client);
+    client = NULL;
+    client_channels = 0;
+    ATOMIC_SET (client_dead, 0);
+}
 
-/* Return the current number of milliseconds of audio data that has */
-/* been played out of the audio device, not including the buffer */
-static int jack_get_output_time(void)
+static int open_client (int channels)
 {
-  int return_val;
+    if (! (client = jack_client_open ("audacious-jack", JackNoStartServer, NULL)))
+    {
+        fprintf (stderr, "jack: Cannot connect to the JACK server.\n");
+        return 0;
+    }
+
+    ATOMIC_SET (client_dead, 0);
+
+    jack_set_process_callback (client, process_cb, NULL);
+    jack_set_xrun_callback (client, xrun_cb, NULL);
+    jack_set_buffer_size_callback (client, bufsize_cb, NULL);
+    jack_set_sample_rate_callback (client, srate_cb, NULL);
+    jack_set_latency_callback (client, latency_cb, NULL);
+    jack_on_shutdown (client, shutdown_cb, NULL);
+
+    for (int c = 0; c < channels; c ++)
+    {
+        char name[16];
+        snprintf (name, sizeof name, "out_%d", c);
+
+        if (! (ports[c] = jack_port_register (client, name,
+         JACK_DEFAULT_AUDIO_TYPE, JackPortIsOutput, 0)))
+        {
+            fprintf (stderr, "jack: Cannot register port %s.\n", name);
+            goto FAILED;
+        }
+    }
+
+    client_channels = channels;
+    ATOMIC_SET (server_rate, (int) jack_get_sample_rate (client));
+    ATOMIC_SET (server_period, (int) jack_get_buffer_size (client));
+    ATOMIC_SET (server_latency, 0);
+
+    if (jack_activate (client))
+    {
+        fprintf (stderr, "jack: Cannot activate the client.\n");
+        goto FAILED;
+    }
 
-  /* don't try to get any values if the device is still closed */
-  if(JACK_GetState(driver) == CLOSED)
-    return_val = 0;
-  else
-    return_val = JACK_GetPosition(driver, MILLISECONDS, PLAYED); /* get played position in terms of milliseconds */
+    connect_ports (channels);
+    return 1;
 
-  TRACE("returning %d milliseconds\n", return_val);
-  return return_val;
+FAILED:
+    close_client ();
+    return 0;
 }
 
+static void reset_reported (int time)
+{
+    int64_t old = ATOMIC_GET (reported);
+    ATOMIC_SET (reported, ((old >> 32) + 1) << 32 | (uint32_t) time);
+}
 
-/* returns TRUE if we are currently playing */
-/* NOTE: this was confusing at first BUT, if the device is open and there */
-/* is no more audio to be played, then the device is NOT PLAYING */
-#if 0
-static int jack_playing(void)
+static int output_time (void)
 {
-  int return_val;
+    int64_t old = ATOMIC_GET (reported);
+    int time = flush_time;
 
-  /* If we are playing see if we ACTUALLY have something to play */
-  if(JACK_GetState(driver) == PLAYING)
-  {
-    /* If we have zero bytes stored, we are done playing */
-    if(JACK_GetBytesStored(driver) == 0)
-      return_val = FALSE;
+    if (! out_rate)
+    {
+        /* disconnected; the time follows what was written */
+        if (in_rate)
+            time += written * 1000 / in_rate;
+    }
     else
-      return_val = TRUE;
-  }
-  else
-    return_val = FALSE;
+    {
+        int64_t total, at;
+        int seq;
+
+        /* read until both are from the same cycle */
+        do
+        {
+            seq = ATOMIC_GET (played_seq);
+            total = ATOMIC_GET (played);
+            at = ATOMIC_GET (played_at);
+        }
+        while ((seq & 1) || seq != ATOMIC_GET (played_seq));
+
+        /* what the server holds plays out at its rate after the last cycle */
+        int64_t delay = ATOMIC_GET (server_latency) - (stats_now () - at) * out_rate / 1000000;
+        int64_t frames = total - played_base - MAX (delay, 0);
+
+        time += MAX (frames, 0) * 1000 / out_rate;
+    }
 
-  TRACE("returning %d\n", return_val);
-  return return_val;
+    /* never go back between flushes, e.g. when the server latency grows */
+    while (time > (int) (uint32_t) old)
+    {
+        int64_t now = (old & ~ (int64_t) 0xffffffff) | (uint32_t) time;
+
+        if (__atomic_compare_exchange_n (& reported, & old, now, 0,
+         __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+            return time;
+    }
+
+    return (int) (uint32_t) old;
 }
-#endif
 
-void jack_set_port_connection_mode()
+/* Restarts the time from the end of what has been written, skipping whatever
+ * was still buffered. */
+static void rebase_time (void)
 {
-  /* setup the port connection mode that determines how bio2jack will connect ports */
-  enum JACK_PORT_CONNECTION_MODE mode;
+    if (in_rate)
+        flush_time += written * 1000 / in_rate;
 
-  if(strcmp(jack_cfg.port_connection_mode, "CONNECT_ALL") == 0)
-      mode = CONNECT_ALL;
-  else if(strcmp(jack_cfg.port_connection_mode, "CONNECT_OUTPUT") == 0)
-      mode = CONNECT_OUTPUT;
-  else if(strcmp(jack_cfg.port_connection_mode, "CONNECT_NONE") == 0)
-      mode = CONNECT_NONE;
-  else
-  {
-      TRACE("Defaulting to CONNECT_ALL");
-      mode = CONNECT_ALL;
-  }
-  JACK_SetPortConnectionMode(mode);
+    written = 0;
+    played_base = ATOMIC_GET (played);
 }
 
-static const char * const jack_defaults[] = {
- "isTraceEnabled", "FALSE",
- "port_connection_mode", "CONNECT_ALL",
- "volume_left", "25",
- "volume_right", "25",
- NULL};
+/* Returns 0 if the callback may still be using the rings; they are then kept
+ * until the client has been closed. */
+static int free_rings (void)
+{
+    ATOMIC_SET (active_channels, 0);
 
-/* Initialize necessary things */
-static bool_t jack_init (void)
+    if (resampler)
+    {
+        src_delete (resampler);
+        resampler = NULL;
+    }
+
+    if (! sync_callback ())
+        return 0;
+
+    for (int c = 0; c < MAX_CHANNELS; c ++)
+        ring_free (& rings[c]);
+
+    return 1;
+}
+
+/* (Re)builds the rings for the server's current rate and buffer size.  Any
+ * buffered audio is lost; playback carries on from the current position. */
+static void setup_rings (void)
 {
-  aud_config_set_defaults ("jack", jack_defaults);
+    if (! free_rings ())
+        return; /* check_server will reconnect */
 
-  jack_cfg.isTraceEnabled = aud_get_bool ("jack", "isTraceEnabled");
-  jack_cfg.port_connection_mode = aud_get_string ("jack", "port_connection_mode");
-  jack_cfg.volume_left = aud_get_int ("jack", "volume_left");
-  jack_cfg.volume_right = aud_get_int ("jack", "volume_right");
+    rebase_time ();
 
-  TRACE("initializing\n");
-  JACK_Init(); /* initialize the driver */
+    out_rate = ATOMIC_GET (server_rate);
+    out_period = ATOMIC_GET (server_period);
 
-  /* set the bio2jack name so users will see xmms-jack in their */
-  /* jack client list */
-  JACK_SetClientName("audacious-jack");
+    buffer_frames = aud_get_int (NULL, "output_buffer_size") * out_rate / 1000;
+    int target = MAX (buffer_frames, 2 * out_period);
+    ring_frames = target + RING_SLACK;
 
-  /* set the port connection mode */
-  jack_set_port_connection_mode();
+    for (int c = 0; c < in_channels; c ++)
+        ring_init (& rings[c], sizeof (float) * ring_frames);
 
-  output_opened = FALSE;
+    if (out_rate != in_rate)
+    {
+        int error;
 
-  /* Always return OK, as we don't know about physical devices here */
-  return TRUE;
-}
+        if (! (resampler = src_new (SRC_SINC_FASTEST, in_channels, & error)))
+            fprintf (stderr, "jack: %s.\n", src_strerror (error));
 
+        resample_ratio = (double) out_rate / in_rate;
+        AUDDBG ("Resampling from %d to %d Hz.\n", in_rate, out_rate);
+    }
+
+    AUDDBG ("Ring of %d frames for a %d-frame period.\n", ring_frames, out_period);
+
+    ATOMIC_SET (fill_target, target);
+    ATOMIC_SET (prebuffer, 1);
+    ATOMIC_SET (active_channels, in_channels);
+}
 
-/* Return the amount of data that can be written to the device */
-static int audacious_jack_free(void)
+/* Reconnects after the server has gone away, and follows its settings. */
+static void check_server (void)
 {
-  unsigned long return_val = JACK_GetBytesFreeSpace(driver);
-  unsigned long tmp;
+    if (client && ATOMIC_GET (client_dead))
+    {
+        close_client ();
+        free_rings ();
+        rebase_time ();
+
+        out_rate = 0;
+    }
+
+    if (! client)
+    {
+        int64_t now = now_ms ();
+
+        if (now - last_reconnect < RECONNECT_DELAY)
+            return;
+
+        last_reconnect = now;
+
+        if (! open_client (in_channels))
+            return;
+
+        setup_rings ();
+        return;
+    }
 
-  /* adjust for frequency differences, otherwise xmms could send us */
-  /* as much data as we have free, then we go to convert this to */
-  /* the output frequency and won't have enough space, so adjust */
-  /* by the ratio of the two */
-  if(effect.frequency != output.frequency)
-  {
-    tmp = return_val;
-    return_val = (return_val * effect.frequency) / output.frequency;
-    TRACE("adjusting from %ld to %ld free bytes to compensate for frequency differences\n", tmp, return_val);
-  }
+    int rate = ATOMIC_GET (server_rate);
+    int period = ATOMIC_GET (server_period);
 
-  if(return_val > INT_MAX)
-  {
-      TRACE("Warning: return_val > INT_MAX\n");
-      return_val = INT_MAX;
-  }
+    if (rate == out_rate && period == out_period)
+        return;
 
-  TRACE("free space of %ld bytes\n", return_val);
+    /* a new period that still fits in the rings just moves the target */
+    int target = MAX (buffer_frames, 2 * period);
 
-  return return_val;
+    if (rate == out_rate && target + RING_SLACK <= ring_frames)
+    {
+        out_period = period;
+        ATOMIC_SET (fill_target, target);
+        return;
+    }
+
+    setup_rings ();
 }
 
+static void store (const float * data, int frames)
+{
+    for (int c = 0; c < in_channels; c ++)
+    {
+        const float * in = data + c;
+        int left = frames;
+
+        while (left)
+        {
+            void * space;
+            int avail = ring_reserve (& rings[c], & space) / sizeof (float);
+            int copy = MIN (avail, left);
+            float * out = space;
+
+            if (! copy)
+                break; /* cannot happen as long as buffer_free is obeyed */
+
+            for (int i = 0; i < copy; i ++)
+            {
+                out[i] = * in;
+                in += in_channels;
+            }
+
+            ring_commit (& rings[c], sizeof (float) * copy);
+            left -= copy;
+        }
+    }
+}
 
-/* Close the device */
-static void jack_close(void)
+static void resample_store (const float * data, int frames)
 {
-  aud_set_int ("jack", "volume_left", jack_cfg.volume_left);
-  aud_set_int ("jack", "volume_right", jack_cfg.volume_right);
+    int out_max = frames * resample_ratio + 16;
+    float * out = scratch_get (slots + 1, out_max * in_channels);
 
-  JACK_Reset(driver); /* flush buffers, reset position and set state to STOPPED */
-  TRACE("resetting driver, not closing now, destructor will close for us\n");
+    while (frames)
+    {
+        SRC_DATA d = {
+         .data_in = data,
+         .data_out = out,
+         .input_frames = frames,
+         .output_frames = out_max,
+         .src_ratio = resample_ratio};
+
+        int error = src_process (resampler, & d);
+
+        if (error)
+        {
+            fprintf (stderr, "jack: %s.\n", src_strerror (error));
+            return;
+        }
+
+        store (out, d.output_frames_gen);
+
+        if (! d.input_frames_used && ! d.output_frames_gen)
+            break;
+
+        data += d.input_frames_used * in_channels;
+        frames -= d.input_frames_used;
+    }
 }
 
+static int jack_buffer_free (void)
+{
+    check_server ();
+
+    if (! client)
+        return DEAD_CHUNK * in_rate / 1000 * in_frame_size;
+
+    int space = ATOMIC_GET (fill_target) - filled_frames (in_channels);
+
+    if (space <= 0)
+        return 0;
+
+    /* round up so that the target is always reached; the slack in the rings
+     * takes the few extra frames */
+    if (resampler)
+        space = (int64_t) space * in_rate / out_rate + 1;
+
+    return space * in_frame_size;
+}
 
-/* Open the device up */
-static int jack_open(int fmt, int sample_rate, int num_channels)
+static void jack_write (void * data, int length)
 {
-  int bits_per_sample;
-  int floating_point = FALSE;
-  int retval;
-  unsigned long rate;
+    int frames = length / in_frame_size;
+    int64_t start = stats_now ();
 
-  TRACE("fmt == %d, sample_rate == %d, num_channels == %d\n",
-    fmt, sample_rate, num_channels);
+    if (ATOMIC_GET (draining))
+        ATOMIC_SET (draining, 0);
 
-  if((fmt == FMT_U8) || (fmt == FMT_S8))
-  {
-    bits_per_sample = 8;
-  } else if(fmt == FMT_S16_NE)
-  {
-    bits_per_sample = 16;
-  } else if (fmt == FMT_S24_NE)
-  {
-    /* interpreted by bio2jack as 24 bit values packed to 32 bit samples */
-    bits_per_sample = 24;
-  } else if (fmt == FMT_S32_NE)
-  {
-    bits_per_sample = 32;
-  } else if (fmt == FMT_FLOAT)
-  {
-    bits_per_sample = 32;
-    floating_point = TRUE;
-  } else {
-    TRACE("sample format not supported\n");
-    return 0;
-  }
-
-  /* record some useful information */
-  input.format    = fmt;
-  input.frequency = sample_rate;
-  input.bps       = bits_per_sample * sample_rate * num_channels;
-  input.channels  = num_channels;
-
-  /* setup the effect as matching the input format */
-  effect.format    = input.format;
-  effect.frequency = input.frequency;
-  effect.channels  = input.channels;
-  effect.bps       = input.bps;
-
-  /* if we are already opened then don't open again */
-  if(output_opened)
-  {
-    /* if something has changed we should close and re-open the connect to jack */
-    if((output.channels != input.channels) ||
-       (output.frequency != input.frequency) ||
-       (output.format != input.format))
+    written += frames;
+
+    if (! client)
+        return; /* disconnected; just keep the time moving */
+
+    float * buf = data;
+
+    if (in_format != FMT_FLOAT)
     {
-      TRACE("output.channels is %d, jack_open called with %d channels\n", output.channels, input.channels);
-      TRACE("output.frequency is %ld, jack_open called with %ld\n", output.frequency, input.frequency);
-      TRACE("output.format is %d, jack_open called with %d\n", output.format, input.format);
-      jack_close();
-      JACK_Close(driver);
-    } else
+        buf = scratch_get (slots, frames * in_channels);
+        audio_from_int (data, in_format, buf, frames * in_channels);
+    }
+
+    if (resampler)
+        resample_store (buf, frames);
+    else
+        store (buf, frames);
+
+    stats_write_done (& jack_stats, start);
+    stats_poll (& jack_stats);
+}
+
+static void jack_period_wait (void)
+{
+    if (! client)
     {
-        TRACE("output_opened is TRUE and no options changed, not reopening\n");
-        paused = FALSE;
-        return 1;
+        usleep (DEAD_CHUNK * 1000);
+        return;
     }
-  }
-
-  /* try to open the jack device with the requested rate at first */
-  output.frequency = input.frequency;
-  output.bps       = input.bps;
-  output.channels  = input.channels;
-  output.format    = input.format;
-
-  rate = output.frequency;
-  retval = JACK_Open(&driver, bits_per_sample, floating_point, &rate, output.channels);
-  output.frequency = rate; /* avoid compile warning as output.frequency differs in type
-                              from what JACK_Open() wants for the type of the rate parameter */
-  if(retval == ERR_RATE_MISMATCH)
-  {
-    TRACE("set the resampling rate properly");
-    return 0;
-  } else if(retval != ERR_SUCCESS)
-  {
-    TRACE("failed to open jack with JACK_Open(), error %d\n", retval);
-    return 0;
-  }
 
-  jack_set_volume(jack_cfg.volume_left, jack_cfg.volume_right); /* sets the volume to stored value */
-  output_opened = TRUE;
-  paused = FALSE;
+    while (filled_frames (ATOMIC_GET (active_channels)) >= ATOMIC_GET (fill_target))
+    {
+        if (ATOMIC_GET (client_dead))
+            return;
+
+        ATOMIC_SET (writer_waiting, 1);
 
-  return 1;
+        if (filled_frames (ATOMIC_GET (active_channels)) >= ATOMIC_GET (fill_target))
+            sem_wait_ms (& writer_sem, WAIT_TIMEOUT);
+
+        ATOMIC_SET (writer_waiting, 0);
+    }
 }
 
+static void jack_drain (void)
+{
+    AUDDBG ("Drain.\n");
+
+    ATOMIC_SET (draining, 1);
 
-/* write some audio out to the device */
-static void jack_write(void * ptr, int length)
+    while (client && ! ATOMIC_GET (client_dead) && filled_frames
+     (ATOMIC_GET (active_channels)))
+    {
+        ATOMIC_SET (writer_waiting, 1);
+
+        if (filled_frames (ATOMIC_GET (active_channels)))
+            sem_wait_ms (& writer_sem, WAIT_TIMEOUT);
+
+        ATOMIC_SET (writer_waiting, 0);
+    }
+
+    /* let the last period make it out of the server */
+    if (client && out_rate)
+        usleep ((int64_t) ATOMIC_GET (server_latency) * 1000000 / out_rate);
+}
+
+static int jack_get_output_time (void)
 {
-  long written;
+    return output_time ();
+}
 
-  TRACE("starting length of %d\n", length);
+static void jack_flush (int time)
+{
+    AUDDBG ("Flush.\n");
+
+    ATOMIC_SET (prebuffer, 1);
+    ATOMIC_SET (draining, 0);
+    sync_callback ();
+
+    if (resampler)
+        src_reset (resampler);
+
+    flush_time = time;
+    written = 0;
+    played_base = ATOMIC_GET (played);
+    reset_reported (time);
+
+    sem_post (& writer_sem); /* wake up period wait */
+}
 
-  /* loop until we have written all the data out to the jack device */
-  /* this is due to xmms' audio driver api */
-  char *buf = (char*)ptr;
-  while(length > 0)
-  {
-    TRACE("writing %d bytes\n", length);
-    written = JACK_Write(driver, (unsigned char*)buf, length);
-    length-=written;
-    buf+=written;
-  }
-  TRACE("finished\n");
+static void jack_pause (bool_t pause)
+{
+    AUDDBG ("%sause.\n", pause ? "P" : "Unp");
+    ATOMIC_SET (paused, pause);
 }
 
+static int jack_open (int format, int rate, int channels)
+{
+    AUDDBG ("Opening audio for %d channels, %d Hz.\n", channels, rate);
+
+    if (format != FMT_FLOAT && (format < FMT_S8 || format > FMT_U32_BE))
+    {
+        fprintf (stderr, "jack: Unsupported audio format.\n");
+        return 0;
+    }
+
+    if (channels < 1 || channels > MAX_CHANNELS)
+    {
+        fprintf (stderr, "jack: Cannot play %d channels.\n", channels);
+        return 0;
+    }
+
+    /* the connection is kept from song to song unless the channels change */
+    if (client && (ATOMIC_GET (client_dead) || client_channels != channels))
+        close_client ();
+
+    if (! client && ! open_client (channels))
+        return 0;
+
+    in_format = format;
+    in_rate = rate;
+    in_channels = channels;
+    in_frame_size = FMT_SIZEOF (format) * channels;
 
-/* Flush any output currently buffered */
-/* and set the number of bytes written based on ms_offset_time, */
-/* the number of milliseconds of offset passed in */
-/* This is done so the driver itself keeps track of */
-/* current playing position of the mp3 */
-static void jack_flush(int ms_offset_time)
+    ATOMIC_SET (volume_left, aud_get_int ("jack", "volume_left"));
+    ATOMIC_SET (volume_right, aud_get_int ("jack", "volume_right"));
+    ATOMIC_SET (paused, 0);
+    ATOMIC_SET (draining, 0);
+
+    flush_time = 0;
+    written = 0;
+    setup_rings ();
+    reset_reported (0);
+
+    stats_reset (& jack_stats, "jack");
+    return 1;
+}
+
+static void jack_close (void)
 {
-  TRACE("setting values for ms_offset_time of %d\n", ms_offset_time);
+    AUDDBG ("Closing audio.\n");
 
-  JACK_Reset(driver); /* flush buffers and set state to STOPPED */
+    free_rings ();
+    stats_dump (& jack_stats);
 
-  /* update the internal driver values to correspond to the input time given */
-  JACK_SetPosition(driver, MILLISECONDS, ms_offset_time);
+    aud_set_int ("jack", "volume_left", ATOMIC_GET (volume_left));
+    aud_set_int ("jack", "volume_right", ATOMIC_GET (volume_right));
+}
 
-  if (paused)
-    JACK_SetState(driver, PAUSED);
-  else
-    JACK_SetState(driver, PLAYING);
+static void jack_get_volume (int * left, int * right)
+{
+    * left = ATOMIC_GET (volume_left);
+    * right = ATOMIC_GET (volume_right);
 }
 
+static void jack_set_volume (int left, int right)
+{
+    if (in_channels == 1)
+        left = right = MAX (left, right);
 
-/* Pause the jack device */
-static void jack_pause (bool_t p)
+    ATOMIC_SET (volume_left, left);
+    ATOMIC_SET (volume_right, right);
+}
+
+static bool_t jack_init (void)
 {
-  TRACE("p == %d\n", p);
+    if ((slots = scratch_reserve (2)) < 0)
+        return FALSE;
 
-  paused = p;
+    aud_config_set_defaults ("jack", jack_defaults);
+
+    volume_left = aud_get_int ("jack", "volume_left");
+    volume_right = aud_get_int ("jack", "volume_right");
+
+    sem_init (& writer_sem, 0, 0);
+    sem_init (& sync_sem, 0, 0);
+
+    /* Always return OK, as we don't know about physical devices here */
+    return TRUE;
+}
+
+static void jack_cleanup (void)
+{
+    close_client ();
+    free_rings ();
+    scratch_release (slots, 2);
 
-  /* pause the device if p is non-zero, unpause the device if p is zero and */
-  /* we are currently paused */
-  if(p)
-    JACK_SetState(driver, PAUSED);
-  else if(JACK_GetState(driver) == PAUSED)
-    JACK_SetState(driver, PLAYING);
+    sem_destroy (& writer_sem);
+    sem_destroy (& sync_sem);
 }
 
 static const char jack_about[] =
@@ -419,9 +856,6 @@ AUD_OUTPUT_PLUGIN
     .about_text = jack_about,
     .init = jack_init,
     .cleanup = jack_cleanup,
-#if 0
-    .configure = jack_configure,
-#endif
     .get_volume = jack_get_volume,
     .set_volume = jack_set_volume,
     .open_audio = jack_open,
@@ -429,6 +863,8 @@ AUD_OUTPUT_PLUGIN
     .close_audio = jack_close,
     .flush = jack_flush,
     .pause = jack_pause,
-    .buffer_free = audacious_jack_free,
+    .buffer_free = jack_buffer_free,
+    .period_wait = jack_period_wait,
+    .drain = jack_drain,
     .output_time = jack_get_output_time
 )
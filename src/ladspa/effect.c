@@ -20,10 +20,30 @@
 #include <assert.h>
 #include <stdio.h>
 
+#include "denormal.h"
 #include "ladspa.h"
 #include "plugin.h"
 
+/* The chain is run in blocks of LADSPA_BUFLEN frames.  Each block is split into
+ * one buffer per channel once; the input ports of each plugin are connected to
+ * the output buffers of the one before, and only the output of the last plugin
+ * is interleaved again.  The instances of one plugin are independent of each
+ * other, so when the chain takes a good part of the available time, they are
+ * run in parallel. */
+
+#define POOL_ON 4  /* use the pool above 1/4 of real time */
+#define POOL_OFF 8 /* stop using it below 1/8 */
+
+typedef struct {
+    LoadedPlugin * loaded;
+    float * * in_bufs;
+    int frames;
+} Stage;
+
 static int ladspa_channels, ladspa_rate;
+static float * * planar;
+static int busy; /* microseconds spent in plugins this block */
+static int use_pool;
 
 static void start_plugin (LoadedPlugin * loaded)
 {
@@ -53,7 +73,6 @@ static void start_plugin (LoadedPlugin * loaded)
     int instances = ladspa_channels / ports;
 
     loaded->instances = index_new ();
-    loaded->in_bufs = g_malloc (sizeof (float *) * ladspa_channels);
     loaded->out_bufs = g_malloc (sizeof (float *) * ladspa_channels);
 
     for (int i = 0; i < instances; i ++)
@@ -72,11 +91,7 @@ static void start_plugin (LoadedPlugin * loaded)
         {
             int channel = ports * i + p;
 
-            float * in = g_malloc (sizeof (float) * LADSPA_BUFLEN);
-            loaded->in_bufs[channel] = in;
-            int in_port = g_array_index (plugin->in_ports, int, p);
-            desc->connect_port (handle, in_port, in);
-
+            /* input ports are connected in run_instance() */
             float * out = g_malloc (sizeof (float) * LADSPA_BUFLEN);
             loaded->out_bufs[channel] = out;
             int out_port = g_array_index (plugin->out_ports, int, p);
@@ -88,60 +103,107 @@ static void start_plugin (LoadedPlugin * loaded)
     }
 }
 
-static void run_plugin (LoadedPlugin * loaded, float * data, int samples)
+static void run_instance (void * data, int i)
 {
-    if (! loaded->instances)
-        return;
-
+    Stage * stage = data;
+    LoadedPlugin * loaded = stage->loaded;
     PluginData * plugin = loaded->plugin;
     const LADSPA_Descriptor * desc = plugin->desc;
 
     int ports = plugin->in_ports->len;
+    LADSPA_Handle * handle = index_get (loaded->instances, i);
+
+    for (int p = 0; p < ports; p ++)
+    {
+        int in_port = g_array_index (plugin->in_ports, int, p);
+        desc->connect_port (handle, in_port, stage->in_bufs[ports * i + p]);
+    }
+
+    gint64 start = g_get_monotonic_time ();
+    desc->run (handle, stage->frames);
+    g_atomic_int_add (& busy, g_get_monotonic_time () - start);
+}
+
+/* Returns the buffers holding the plugin's output. */
+static float * * run_plugin (LoadedPlugin * loaded, float * * in_bufs, int frames)
+{
+    if (! loaded->instances)
+        return in_bufs;
+
     int instances = index_count (loaded->instances);
-    assert (ports * instances == ladspa_channels);
+    assert (loaded->plugin->in_ports->len * instances == ladspa_channels);
+
+    Stage stage = {loaded, in_bufs, frames};
+
+    if (use_pool)
+        pool_run (run_instance, & stage, instances);
+    else
+    {
+        for (int i = 0; i < instances; i ++)
+            run_instance (& stage, i);
+    }
+
+    return loaded->out_bufs;
+}
+
+static void run_chain (float * data, int samples)
+{
+    int count = index_count (loadeds);
+    DenormalState fpu = denormal_disable ();
 
     while (samples / ladspa_channels > 0)
     {
         int frames = MIN (samples / ladspa_channels, LADSPA_BUFLEN);
 
-        for (int i = 0; i < instances; i ++)
+        for (int channel = 0; channel < ladspa_channels; channel ++)
         {
-            LADSPA_Handle * handle = index_get (loaded->instances, i);
+            float * get = data + channel;
+            float * in = planar[channel];
+            float * in_end = in + frames;
 
-            for (int p = 0; p < ports; p ++)
+            while (in < in_end)
             {
-                int channel = ports * i + p;
-                float * get = data + channel;
-                float * in = loaded->in_bufs[channel];
-                float * in_end = in + frames;
-
-                while (in < in_end)
-                {
-                    * in ++ = * get;
-                    get += ladspa_channels;
-                }
+                * in ++ = * get;
+                get += ladspa_channels;
             }
+        }
+
+        float * * bufs = planar;
+        busy = 0;
 
-            desc->run (handle, frames);
+        for (int i = 0; i < count; i ++)
+        {
+            LoadedPlugin * loaded = index_get (loadeds, i);
+            start_plugin (loaded);
+            bufs = run_plugin (loaded, bufs, frames);
+        }
 
-            for (int p = 0; p < ports; p ++)
+        for (int channel = 0; channel < ladspa_channels; channel ++)
+        {
+            float * set = data + channel;
+            float * out = bufs[channel];
+            float * out_end = out + frames;
+
+            while (out < out_end)
             {
-                int channel = ports * i + p;
-                float * set = data + channel;
-                float * out = loaded->out_bufs[channel];
-                float * out_end = out + frames;
-
-                while (out < out_end)
-                {
-                    * set = * out ++;
-                    set += ladspa_channels;
-                }
+                * set = * out ++;
+                set += ladspa_channels;
             }
         }
 
+        /* busy is the total time, whether or not the pool was used */
+        int real_time = (gint64) frames * 1000000 / ladspa_rate;
+
+        if (busy > real_time / POOL_ON)
+            use_pool = 1;
+        else if (busy < real_time / POOL_OFF)
+            use_pool = 0;
+
         data += ladspa_channels * frames;
         samples -= ladspa_channels * frames;
     }
+
+    denormal_restore (fpu);
 }
 
 static void flush_plugin (LoadedPlugin * loaded)
@@ -186,19 +248,24 @@ void shutdown_plugin_locked (LoadedPlugin * loaded)
     }
 
     for (int channel = 0; channel < ladspa_channels; channel ++)
-    {
-        g_free (loaded->in_bufs[channel]);
         g_free (loaded->out_bufs[channel]);
-    }
 
     index_free (loaded->instances);
     loaded->instances = NULL;
-    g_free (loaded->in_bufs);
-    loaded->in_bufs = NULL;
     g_free (loaded->out_bufs);
     loaded->out_bufs = NULL;
 }
 
+void free_planar_locked (void)
+{
+    for (int channel = 0; channel < ladspa_channels; channel ++)
+        g_free (planar[channel]);
+
+    g_free (planar);
+    planar = NULL;
+    ladspa_channels = 0;
+}
+
 void ladspa_start (int * channels, int * rate)
 {
     pthread_mutex_lock (& mutex);
@@ -210,9 +277,17 @@ void ladspa_start (int * channels, int * rate)
         shutdown_plugin_locked (loaded);
     }
 
+    free_planar_locked ();
+
     ladspa_channels = * channels;
     ladspa_rate = * rate;
 
+    planar = g_malloc (sizeof (float *) * ladspa_channels);
+    for (int channel = 0; channel < ladspa_channels; channel ++)
+        planar[channel] = g_malloc (sizeof (float) * LADSPA_BUFLEN);
+
+    use_pool = 0;
+
     pthread_mutex_unlock (& mutex);
 }
 
@@ -220,13 +295,7 @@ void ladspa_process (float * * data, int * samples)
 {
     pthread_mutex_lock (& mutex);
 
-    int count = index_count (loadeds);
-    for (int i = 0; i < count; i ++)
-    {
-        LoadedPlugin * loaded = index_get (loadeds, i);
-        start_plugin (loaded);
-        run_plugin (loaded, * data, * samples);
-    }
+    run_chain (* data, * samples);
 
     pthread_mutex_unlock (& mutex);
 }
@@ -249,12 +318,12 @@ void ladspa_finish (float * * data, int * samples)
 {
     pthread_mutex_lock (& mutex);
 
+    run_chain (* data, * samples);
+
     int count = index_count (loadeds);
     for (int i = 0; i < count; i ++)
     {
         LoadedPlugin * loaded = index_get (loadeds, i);
-        start_plugin (loaded);
-        run_plugin (loaded, * data, * samples);
         shutdown_plugin_locked (loaded);
     }
 
@@ -27,7 +27,7 @@ static void get_value (void * user, int row, int column, GValue * value)
     g_return_if_fail (column == 0);
 
     PluginData * plugin = index_get (plugins, row);
-    g_value_set_string (value, plugin->desc->Name);
+    g_value_set_string (value, plugin->name);
 }
 
 static int get_selected (void * user, int row)
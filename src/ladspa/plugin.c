@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <gmodule.h>
 #include <gtk/gtk.h>
@@ -42,7 +43,7 @@ static const gchar * const ladspa_defaults[] = {
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 char * module_path;
-Index * modules; /* (void *) */
+Index * modules; /* (GModule *) */
 Index * plugins; /* (PluginData *) */
 Index * loadeds; /* (LoadedPlugin *) */
 
@@ -50,6 +51,12 @@ GtkWidget * config_win;
 GtkWidget * plugin_list;
 GtkWidget * loaded_list;
 
+/* The port layout of every plugin is kept in a cache file, so that modules do
+ * not need to be opened until one of their plugins is enabled.  Each module
+ * has a group, checked against its modification time and size. */
+static GKeyFile * old_cache, * new_cache;
+static int cache_changed;
+
 static ControlData * parse_control (const LADSPA_Descriptor * desc, int port)
 {
     g_return_val_if_fail (desc->PortNames[port], NULL);
@@ -108,20 +115,36 @@ static ControlData * parse_control (const LADSPA_Descriptor * desc, int port)
     return control;
 }
 
-static PluginData * open_plugin (const char * path, const LADSPA_Descriptor * desc)
+static PluginData * new_plugin (const char * filename, int index,
+ const char * label, const char * name)
 {
-    const char * slash = strrchr (path, G_DIR_SEPARATOR);
+    const char * slash = strrchr (filename, G_DIR_SEPARATOR);
     g_return_val_if_fail (slash && slash[1], NULL);
-    g_return_val_if_fail (desc->Label && desc->Name, NULL);
 
     PluginData * plugin = g_slice_new (PluginData);
     plugin->path = g_strdup (slash + 1);
-    plugin->desc = desc;
+    plugin->module = g_strdup (filename);
+    plugin->label = g_strdup (label);
+    plugin->name = g_strdup (name);
+    plugin->index = index;
+    plugin->desc = NULL;
     plugin->controls = index_new ();
     plugin->in_ports = g_array_new (0, 0, sizeof (int));
     plugin->out_ports = g_array_new (0, 0, sizeof (int));
     plugin->selected = 0;
 
+    return plugin;
+}
+
+static PluginData * open_plugin (const char * filename, int index,
+ const LADSPA_Descriptor * desc)
+{
+    g_return_val_if_fail (desc->Label && desc->Name, NULL);
+
+    PluginData * plugin = new_plugin (filename, index, desc->Label, desc->Name);
+    if (! plugin)
+        return NULL;
+
     for (int i = 0; i < desc->PortCount; i ++)
     {
         if (LADSPA_IS_PORT_CONTROL (desc->PortDescriptors[i]))
@@ -152,40 +175,188 @@ static void close_plugin (PluginData * plugin)
     }
 
     g_free (plugin->path);
+    g_free (plugin->module);
+    g_free (plugin->label);
+    g_free (plugin->name);
     index_free (plugin->controls);
     g_array_free (plugin->in_ports, 1);
     g_array_free (plugin->out_ports, 1);
     g_slice_free (PluginData, plugin);
 }
 
-static void * open_module (const char * path)
+static LADSPA_Descriptor_Function open_module (const char * path, GModule * * handle)
 {
-    GModule * handle = g_module_open (path, G_MODULE_BIND_LOCAL);
-    if (! handle)
+    * handle = g_module_open (path, G_MODULE_BIND_LOCAL);
+    if (! * handle)
     {
         fprintf (stderr, "ladspa: Failed to open module %s: %s\n", path, g_module_error ());
         return NULL;
     }
 
     void * sym;
-    if (! g_module_symbol (handle, "ladspa_descriptor", & sym))
+    if (! g_module_symbol (* handle, "ladspa_descriptor", & sym))
     {
         fprintf (stderr, "ladspa: Not a valid LADSPA module: %s\n", path);
-        g_module_close (handle);
+        g_module_close (* handle);
+        * handle = NULL;
         return NULL;
     }
 
-    LADSPA_Descriptor_Function descfun = (LADSPA_Descriptor_Function) sym;
+    return (LADSPA_Descriptor_Function) sym;
+}
+
+/* Opens the module just long enough to read its plugins. */
+static void scan_module (const char * path, Index * found)
+{
+    GModule * handle;
+    LADSPA_Descriptor_Function descfun = open_module (path, & handle);
+    if (! descfun)
+        return;
 
     const LADSPA_Descriptor * desc;
     for (int i = 0; (desc = descfun (i)); i ++)
     {
-        PluginData * plugin = open_plugin (path, desc);
+        PluginData * plugin = open_plugin (path, i, desc);
         if (plugin)
-            index_append (plugins, plugin);
+            index_append (found, plugin);
     }
 
-    return handle;
+    g_module_close (handle);
+}
+
+static int read_cached (const char * path, const struct stat * info, Index * found)
+{
+    if (! old_cache || ! g_key_file_has_group (old_cache, path))
+        return 0;
+
+    if (g_key_file_get_int64 (old_cache, path, "mtime", NULL) != info->st_mtime ||
+     g_key_file_get_int64 (old_cache, path, "size", NULL) != info->st_size)
+        return 0;
+
+    int count = g_key_file_get_integer (old_cache, path, "plugins", NULL);
+
+    for (int i = 0; i < count; i ++)
+    {
+        char key[32];
+        gsize len;
+
+        snprintf (key, sizeof key, "plugin%d", i);
+        char * * strings = g_key_file_get_string_list (old_cache, path, key, & len, NULL);
+
+        snprintf (key, sizeof key, "plugin%d_index", i);
+        int index = g_key_file_get_integer (old_cache, path, key, NULL);
+
+        PluginData * plugin = (strings && len == 2) ?
+         new_plugin (path, index, strings[0], strings[1]) : NULL;
+
+        g_strfreev (strings);
+
+        if (! plugin)
+            goto ERR;
+
+        index_append (found, plugin);
+
+        snprintf (key, sizeof key, "plugin%d_in", i);
+        int * ports = g_key_file_get_integer_list (old_cache, path, key, & len, NULL);
+        if (ports)
+            g_array_append_vals (plugin->in_ports, ports, len);
+        g_free (ports);
+
+        snprintf (key, sizeof key, "plugin%d_out", i);
+        ports = g_key_file_get_integer_list (old_cache, path, key, & len, NULL);
+        if (ports)
+            g_array_append_vals (plugin->out_ports, ports, len);
+        g_free (ports);
+
+        snprintf (key, sizeof key, "plugin%d_controls", i);
+        int ccount = g_key_file_get_integer (old_cache, path, key, NULL);
+
+        for (int c = 0; c < ccount; c ++)
+        {
+            snprintf (key, sizeof key, "plugin%d_control%d", i, c);
+            char * name = g_key_file_get_string (old_cache, path, key, NULL);
+
+            snprintf (key, sizeof key, "plugin%d_control%d_values", i, c);
+            double * values = g_key_file_get_double_list (old_cache, path, key, & len, NULL);
+
+            if (! name || ! values || len != 5)
+            {
+                g_free (name);
+                g_free (values);
+                goto ERR;
+            }
+
+            ControlData * control = g_slice_new (ControlData);
+            control->port = values[0];
+            control->name = name;
+            control->is_toggle = values[1];
+            control->min = values[2];
+            control->max = values[3];
+            control->def = values[4];
+            index_append (plugin->controls, control);
+
+            g_free (values);
+        }
+    }
+
+    return 1;
+
+ERR:
+    fprintf (stderr, "ladspa: Invalid cache entry for %s\n", path);
+
+    count = index_count (found);
+    for (int i = 0; i < count; i ++)
+        close_plugin (index_get (found, i));
+
+    index_delete (found, 0, count);
+    return 0;
+}
+
+static void write_cached (const char * path, const struct stat * info, Index * found)
+{
+    g_key_file_set_int64 (new_cache, path, "mtime", info->st_mtime);
+    g_key_file_set_int64 (new_cache, path, "size", info->st_size);
+
+    int count = index_count (found);
+    g_key_file_set_integer (new_cache, path, "plugins", count);
+
+    for (int i = 0; i < count; i ++)
+    {
+        PluginData * plugin = index_get (found, i);
+        char key[32];
+
+        const char * strings[] = {plugin->label, plugin->name};
+        snprintf (key, sizeof key, "plugin%d", i);
+        g_key_file_set_string_list (new_cache, path, key, strings, 2);
+
+        snprintf (key, sizeof key, "plugin%d_index", i);
+        g_key_file_set_integer (new_cache, path, key, plugin->index);
+
+        snprintf (key, sizeof key, "plugin%d_in", i);
+        g_key_file_set_integer_list (new_cache, path, key,
+         (int *) plugin->in_ports->data, plugin->in_ports->len);
+
+        snprintf (key, sizeof key, "plugin%d_out", i);
+        g_key_file_set_integer_list (new_cache, path, key,
+         (int *) plugin->out_ports->data, plugin->out_ports->len);
+
+        int ccount = index_count (plugin->controls);
+        snprintf (key, sizeof key, "plugin%d_controls", i);
+        g_key_file_set_integer (new_cache, path, key, ccount);
+
+        for (int c = 0; c < ccount; c ++)
+        {
+            ControlData * control = index_get (plugin->controls, c);
+
+            snprintf (key, sizeof key, "plugin%d_control%d", i, c);
+            g_key_file_set_string (new_cache, path, key, control->name);
+
+            double values[] = {control->port, control->is_toggle, control->min,
+             control->max, control->def};
+            snprintf (key, sizeof key, "plugin%d_control%d_values", i, c);
+            g_key_file_set_double_list (new_cache, path, key, values, 5);
+        }
+    }
 }
 
 static void open_modules_for_path (const char * path)
@@ -197,6 +368,8 @@ static void open_modules_for_path (const char * path)
         return;
     }
 
+    Index * found = index_new ();
+
     struct dirent * entry;
     while ((entry = readdir (folder)))
     {
@@ -206,11 +379,24 @@ static void open_modules_for_path (const char * path)
         char filename[strlen (path) + strlen (entry->d_name) + 2];
         snprintf (filename, sizeof filename, "%s" G_DIR_SEPARATOR_S "%s", path, entry->d_name);
 
-        void * handle = open_module (filename);
-        if (handle)
-            index_append (modules, handle);
+        struct stat info;
+        if (stat (filename, & info) < 0)
+            continue;
+
+        /* modules that are not valid are cached too, with no plugins */
+        if (! read_cached (filename, & info, found))
+        {
+            scan_module (filename, found);
+            cache_changed = 1;
+        }
+
+        write_cached (filename, & info, found);
+
+        index_merge_append (plugins, found);
+        index_delete (found, 0, index_count (found));
     }
 
+    index_free (found);
     closedir (folder);
 }
 
@@ -229,8 +415,75 @@ static void open_modules_for_paths (const char * paths)
 
 static void open_modules (void)
 {
+    char * cache_path = g_build_filename (aud_get_path (AUD_PATH_USER_DIR),
+     "ladspa-cache", NULL);
+
+    old_cache = g_key_file_new ();
+    new_cache = g_key_file_new ();
+
+    if (! g_key_file_load_from_file (old_cache, cache_path, G_KEY_FILE_NONE, NULL))
+    {
+        g_key_file_free (old_cache);
+        old_cache = NULL;
+    }
+
+    cache_changed = 0;
+
     open_modules_for_paths (getenv ("LADSPA_PATH"));
     open_modules_for_paths (module_path);
+
+    /* also rewrite the cache if modules have been removed */
+    gsize old_groups = 0, new_groups = 0;
+    g_strfreev (old_cache ? g_key_file_get_groups (old_cache, & old_groups) : NULL);
+    g_strfreev (g_key_file_get_groups (new_cache, & new_groups));
+
+    if (cache_changed || old_groups != new_groups)
+    {
+        char * data = g_key_file_to_data (new_cache, NULL, NULL);
+        GError * error = NULL;
+
+        if (! g_file_set_contents (cache_path, data, -1, & error))
+        {
+            fprintf (stderr, "ladspa: Failed to write %s: %s\n", cache_path, error->message);
+            g_error_free (error);
+        }
+
+        g_free (data);
+    }
+
+    if (old_cache)
+        g_key_file_free (old_cache);
+
+    g_key_file_free (new_cache);
+    old_cache = new_cache = NULL;
+
+    g_free (cache_path);
+}
+
+/* Opens the plugin's module, if that has not been done yet. */
+static int load_descriptor (PluginData * plugin)
+{
+    if (plugin->desc)
+        return 1;
+
+    GModule * handle;
+    LADSPA_Descriptor_Function descfun = open_module (plugin->module, & handle);
+    if (! descfun)
+        return 0;
+
+    const LADSPA_Descriptor * desc = descfun (plugin->index);
+
+    if (! desc || ! desc->Label || strcmp (desc->Label, plugin->label))
+    {
+        fprintf (stderr, "ladspa: Module has changed since it was scanned: %s\n",
+         plugin->module);
+        g_module_close (handle);
+        return 0;
+    }
+
+    plugin->desc = desc;
+    index_append (modules, handle);
+    return 1;
 }
 
 static void close_modules (void)
@@ -250,6 +503,9 @@ static void close_modules (void)
 
 LoadedPlugin * enable_plugin_locked (PluginData * plugin)
 {
+    if (! load_descriptor (plugin))
+        return NULL;
+
     LoadedPlugin * loaded = g_slice_new (LoadedPlugin);
     loaded->plugin = plugin;
     loaded->selected = 0;
@@ -265,7 +521,6 @@ LoadedPlugin * enable_plugin_locked (PluginData * plugin)
 
     loaded->active = 0;
     loaded->instances = NULL;
-    loaded->in_bufs = NULL;
     loaded->out_bufs = NULL;
 
     loaded->settings_win = NULL;
@@ -295,7 +550,7 @@ static PluginData * find_plugin (const char * path, const char * label)
     for (int i = 0; i < count; i ++)
     {
         PluginData * plugin = index_get (plugins, i);
-        if (! strcmp (plugin->path, path) && ! strcmp (plugin->desc->Label, label))
+        if (! strcmp (plugin->path, path) && ! strcmp (plugin->label, label))
             return plugin;
     }
 
@@ -316,7 +571,7 @@ static void save_enabled_to_config (void)
         aud_set_string ("ladspa", key, loaded->plugin->path);
 
         snprintf (key, sizeof key, "plugin%d_label", i);
-        aud_set_string ("ladspa", key, loaded->plugin->desc->Label);
+        aud_set_string ("ladspa", key, loaded->plugin->label);
 
         int ccount = index_count (loaded->plugin->controls);
         for (int ci = 0; ci < ccount; ci ++)
@@ -344,10 +599,10 @@ static void load_enabled_from_config (void)
         char * label = aud_get_string ("ladspa", key);
 
         PluginData * plugin = find_plugin (path, label);
-        if (plugin)
-        {
-            LoadedPlugin * loaded = enable_plugin_locked (plugin);
+        LoadedPlugin * loaded = plugin ? enable_plugin_locked (plugin) : NULL;
 
+        if (loaded)
+        {
             int ccount = index_count (loaded->plugin->controls);
             for (int ci = 0; ci < ccount; ci ++)
             {
@@ -391,6 +646,8 @@ static void cleanup (void)
     aud_set_string ("ladspa", "module_path", module_path);
     save_enabled_to_config ();
     close_modules ();
+    free_planar_locked ();
+    pool_shutdown ();
 
     index_free (modules);
     modules = NULL;
@@ -491,7 +748,7 @@ static void configure_plugin (LoadedPlugin * loaded)
     PluginData * plugin = loaded->plugin;
     char buf[200];
 
-    snprintf (buf, sizeof buf, _("%s Settings"), plugin->desc->Name);
+    snprintf (buf, sizeof buf, _("%s Settings"), plugin->name);
     loaded->settings_win = gtk_dialog_new_with_buttons (buf, (GtkWindow *)
      config_win, GTK_DIALOG_DESTROY_WITH_PARENT, GTK_STOCK_CLOSE,
      GTK_RESPONSE_CLOSE, NULL);
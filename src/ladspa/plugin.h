@@ -36,8 +36,11 @@ typedef struct {
 } ControlData;
 
 typedef struct {
-    char * path;
-    const LADSPA_Descriptor * desc;
+    char * path; /* file name only, as saved in the config */
+    char * module; /* full path */
+    char * label, * name;
+    int index; /* in the module */
+    const LADSPA_Descriptor * desc; /* NULL until the module is opened */
     Index * controls; /* (ControlData *) */
     GArray * in_ports, * out_ports; /* (int) */
     char selected;
@@ -49,7 +52,7 @@ typedef struct {
     char selected;
     char active;
     Index * instances; /* (LADSPA_Handle) */
-    float * * in_bufs, * * out_bufs; /* (float *) */
+    float * * out_bufs; /* (float *) */
     GtkWidget * settings_win;
 } LoadedPlugin;
 
@@ -76,12 +79,22 @@ void disable_plugin_locked (int i);
 /* effect.c */
 
 void shutdown_plugin_locked (LoadedPlugin * loaded);
+void free_planar_locked (void);
 
 void ladspa_start (gint * channels, gint * rate);
 void ladspa_process (gfloat * * data, gint * samples);
 void ladspa_flush (void);
 void ladspa_finish (gfloat * * data, gint * samples);
 
+/* pool.c */
+
+typedef void (* PoolFunc) (void * data, int item);
+
+/* Calls <func> once for each item from 0 to <count> - 1, spread over the
+ * worker threads, and returns when all calls are done. */
+void pool_run (PoolFunc func, void * data, int count);
+void pool_shutdown (void);
+
 /* plugin-list.c */
 
 GtkWidget * create_plugin_list (void);
@@ -0,0 +1,149 @@
+/*
+ * LADSPA Host for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* A small pool of worker threads, used to run the instances of a plugin in
+ * parallel.  The calling thread takes items as well, so a pool of N threads
+ * runs up to N + 1 items at once. */
+
+#include <unistd.h>
+
+#include "denormal.h"
+#include "plugin.h"
+
+#define MAX_THREADS 7
+
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t threads[MAX_THREADS];
+static int n_threads, quit;
+
+static PoolFunc func;
+static void * func_data;
+static int items, next_item, pending;
+
+static void * worker (void * unused)
+{
+    /* these threads run nothing but plugins */
+    denormal_disable ();
+
+    pthread_mutex_lock (& pool_mutex);
+
+    while (1)
+    {
+        while (! quit && next_item >= items)
+            pthread_cond_wait (& work_cond, & pool_mutex);
+
+        if (quit)
+            break;
+
+        int item = next_item ++;
+
+        pthread_mutex_unlock (& pool_mutex);
+        func (func_data, item);
+        pthread_mutex_lock (& pool_mutex);
+
+        if (! -- pending)
+            pthread_cond_signal (& done_cond);
+    }
+
+    pthread_mutex_unlock (& pool_mutex);
+    return NULL;
+}
+
+static void pool_start (void)
+{
+    int cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    int want = MIN (cpus - 1, MAX_THREADS);
+
+    quit = 0;
+
+    while (n_threads < want)
+    {
+        if (pthread_create (& threads[n_threads], NULL, worker, NULL))
+            break;
+
+        n_threads ++;
+    }
+
+    /* so that we don't try again if there is only one CPU */
+    if (! n_threads)
+        n_threads = -1;
+}
+
+void pool_run (PoolFunc new_func, void * data, int count)
+{
+    if (! n_threads && count > 1)
+        pool_start ();
+
+    if (n_threads < 1 || count < 2)
+    {
+        for (int i = 0; i < count; i ++)
+            new_func (data, i);
+
+        return;
+    }
+
+    pthread_mutex_lock (& pool_mutex);
+
+    func = new_func;
+    func_data = data;
+    items = pending = count;
+    next_item = 0;
+
+    pthread_cond_broadcast (& work_cond);
+
+    while (next_item < items)
+    {
+        int item = next_item ++;
+
+        pthread_mutex_unlock (& pool_mutex);
+        new_func (data, item);
+        pthread_mutex_lock (& pool_mutex);
+
+        pending --;
+    }
+
+    while (pending)
+        pthread_cond_wait (& done_cond, & pool_mutex);
+
+    items = next_item = 0;
+
+    pthread_mutex_unlock (& pool_mutex);
+}
+
+void pool_shutdown (void)
+{
+    if (n_threads < 1)
+    {
+        n_threads = 0;
+        return;
+    }
+
+    pthread_mutex_lock (& pool_mutex);
+    quit = 1;
+    pthread_cond_broadcast (& work_cond);
+    pthread_mutex_unlock (& pool_mutex);
+
+    for (int i = 0; i < n_threads; i ++)
+        pthread_join (threads[i], NULL);
+
+    n_threads = 0;
+}
@@ -0,0 +1,171 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <string.h>
+
+#include "chanmix.h"
+
+#define HALF_POWER 0.7071f /* -3 dB */
+
+enum {FL, FR, FC, LFE, BL, BR, BC, SL, SR};
+
+static const char layouts[CHANMIX_MAX + 1][CHANMIX_MAX] = {
+ [1] = {FC},
+ [2] = {FL, FR},
+ [3] = {FL, FR, FC},
+ [4] = {FL, FR, BL, BR},
+ [5] = {FL, FR, FC, BL, BR},
+ [6] = {FL, FR, FC, LFE, BL, BR},
+ [7] = {FL, FR, FC, LFE, BC, SL, SR},
+ [8] = {FL, FR, FC, LFE, BL, BR, SL, SR}};
+
+/* back and side speakers stand in for each other */
+static const char twins[] = {[BL] = SL, [BR] = SR, [SL] = BL, [SR] = BR};
+
+typedef struct {
+    int in_channels, out_channels;
+    float (* matrix)[CHANMIX_MAX];
+} Mix;
+
+static char in_input (const Mix * mix, int speaker)
+{
+    for (int c = 0; c < mix->in_channels; c ++)
+    {
+        if (layouts[mix->in_channels][c] == speaker)
+            return 1;
+    }
+
+    return 0;
+}
+
+static int find_speaker (const Mix * mix, int speaker)
+{
+    for (int c = 0; c < mix->out_channels; c ++)
+    {
+        if (layouts[mix->out_channels][c] == speaker)
+            return c;
+    }
+
+    return -1;
+}
+
+static void add_route (Mix * mix, int input, int speaker, float weight)
+{
+    int output = find_speaker (mix, speaker);
+
+    if (output >= 0)
+        mix->matrix[output][input] += weight;
+}
+
+/* Only called for an output of at least two channels, which always includes
+ * the front left and right speakers. */
+static void route (Mix * mix, int input, int speaker)
+{
+    char twinned = (speaker == BL || speaker == BR || speaker == SL || speaker
+     == SR);
+
+    if (find_speaker (mix, speaker) >= 0)
+    {
+        /* a back or side speaker shares its output with a folded twin */
+        if (twinned && in_input (mix, twins[speaker]) && find_speaker (mix,
+         twins[speaker]) < 0)
+            add_route (mix, input, speaker, HALF_POWER);
+        else
+            add_route (mix, input, speaker, 1);
+
+        return;
+    }
+
+    switch (speaker)
+    {
+    case FC:
+        add_route (mix, input, FL, HALF_POWER);
+        add_route (mix, input, FR, HALF_POWER);
+        break;
+    case LFE:
+        add_route (mix, input, FL, 0.5);
+        add_route (mix, input, FR, 0.5);
+        break;
+    case BL:
+    case BR:
+    case SL:
+    case SR:
+        if (find_speaker (mix, twins[speaker]) >= 0)
+            add_route (mix, input, twins[speaker], in_input (mix,
+             twins[speaker]) ? HALF_POWER : 1);
+        else
+            add_route (mix, input, (speaker == BL || speaker == SL) ? FL : FR,
+             HALF_POWER);
+        break;
+    case BC:
+        if (find_speaker (mix, BL) >= 0)
+        {
+            add_route (mix, input, BL, HALF_POWER);
+            add_route (mix, input, BR, HALF_POWER);
+        }
+        else if (find_speaker (mix, SL) >= 0)
+        {
+            add_route (mix, input, SL, HALF_POWER);
+            add_route (mix, input, SR, HALF_POWER);
+        }
+        else
+        {
+            add_route (mix, input, FL, 0.5);
+            add_route (mix, input, FR, 0.5);
+        }
+        break;
+    }
+}
+
+void chanmix_matrix (int in_channels, int out_channels,
+ float matrix[CHANMIX_MAX][CHANMIX_MAX])
+{
+    Mix mix = {in_channels, out_channels, matrix};
+
+    memset (matrix, 0, sizeof (float) * CHANMIX_MAX * CHANMIX_MAX);
+
+    if (in_channels == 1)
+    {
+        matrix[0][0] = 1;
+        if (out_channels > 1)
+            matrix[1][0] = 1;
+
+        return;
+    }
+
+    if (out_channels == 1)
+    {
+        /* mono is the average of the stereo downmix */
+        mix.out_channels = 2;
+
+        for (int i = 0; i < in_channels; i ++)
+            route (& mix, i, layouts[in_channels][i]);
+
+        for (int i = 0; i < in_channels; i ++)
+            matrix[0][i] = (matrix[0][i] + matrix[1][i]) / 2;
+
+        for (int i = 0; i < in_channels; i ++)
+            matrix[1][i] = 0;
+
+        return;
+    }
+
+    for (int i = 0; i < in_channels; i ++)
+        route (& mix, i, layouts[in_channels][i]);
+}
@@ -0,0 +1,34 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_CHANMIX_H
+#define LIBFX_CHANMIX_H
+
+#define CHANMIX_MAX 8
+
+/* Fills <matrix>[output][input] for converting between two channel counts,
+ * each from 1 to CHANMIX_MAX, in the usual (WAVE) speaker layouts.  Downmixing
+ * follows the ITU recommendation: a speaker missing from the output is folded
+ * into its neighbors at -3 dB (the LFE at -6 dB), and mono is the average of
+ * the stereo downmix.  Upmixing leaves the extra speakers silent, except that
+ * mono goes to both front speakers. */
+void chanmix_matrix (int in_channels, int out_channels,
+ float matrix[CHANMIX_MAX][CHANMIX_MAX]);
+
+#endif
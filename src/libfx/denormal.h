@@ -0,0 +1,110 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* A feedback loop or recursive filter fed with silence decays towards zero
+ * through subnormal values, which many processors (x86 in particular) handle
+ * tens of times more slowly than normal ones.  Effects bracket their processing
+ * with denormal_disable () and denormal_restore (), which turn on flush-to-zero
+ * (and denormals-are-zero, where available) for the calling thread and then put
+ * back whatever mode it was in.  Since not every processor has such a mode,
+ * state carried from one sample or block to the next should also be passed
+ * through denormal_guard (). */
+
+#ifndef LIBFX_DENORMAL_H
+#define LIBFX_DENORMAL_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined (__SSE__)
+#include <xmmintrin.h>
+#define DENORMAL_FTZ 0x8000
+#define DENORMAL_DAZ 0x0040 /* not on early Pentium 4s; see denormal_bits () */
+#elif defined (__aarch64__) || (defined (__arm__) && defined (__VFP_FP__) && \
+ ! defined (__SOFTFP__))
+#define DENORMAL_BITS (1 << 24) /* FZ */
+#endif
+
+#define DENORMAL_TINY 1e-20f
+
+typedef unsigned long DenormalState;
+
+#if defined (__SSE__)
+/* Setting a bit outside MXCSR_MASK faults, so DAZ is used only if FXSAVE says
+ * the processor has it.  The probe runs once per file; a race just repeats it. */
+static inline unsigned int denormal_bits (void)
+{
+    static unsigned int bits;
+
+    if (! bits)
+    {
+        unsigned char area[512] __attribute__ ((aligned (16)));
+        memset (area, 0, sizeof area);
+        __asm__ __volatile__ ("fxsave %0" : "=m" (area));
+
+        unsigned int mask;
+        memcpy (& mask, area + 28, sizeof mask);
+
+        bits = (mask & DENORMAL_DAZ) ? DENORMAL_FTZ | DENORMAL_DAZ : DENORMAL_FTZ;
+    }
+
+    return bits;
+}
+#endif
+
+static inline DenormalState denormal_disable (void)
+{
+#if defined (__SSE__)
+    DenormalState old = _mm_getcsr ();
+    _mm_setcsr (old | denormal_bits ());
+    return old;
+#elif defined (__aarch64__)
+    DenormalState old;
+    __asm__ __volatile__ ("mrs %0, fpcr" : "=r" (old));
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (old | DENORMAL_BITS));
+    return old;
+#elif defined (DENORMAL_BITS)
+    unsigned int old;
+    __asm__ __volatile__ ("vmrs %0, fpscr" : "=r" (old));
+    __asm__ __volatile__ ("vmsr fpscr, %0" : : "r" (old | DENORMAL_BITS));
+    return old;
+#else
+    return 0;
+#endif
+}
+
+static inline void denormal_restore (DenormalState old)
+{
+#if defined (__SSE__)
+    _mm_setcsr (old);
+#elif defined (__aarch64__)
+    __asm__ __volatile__ ("msr fpcr, %0" : : "r" (old));
+#elif defined (DENORMAL_BITS)
+    __asm__ __volatile__ ("vmsr fpscr, %0" : : "r" ((unsigned int) old));
+#else
+    (void) old;
+#endif
+}
+
+static inline float denormal_guard (float x)
+{
+    return (fabsf (x) < DENORMAL_TINY) ? 0 : x;
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "fft.h"
+
+void rfft_plan_init (RFFTPlan * plan, int size)
+{
+    int n = size / 2;
+    int bits = 0;
+    while ((1 << bits) < n)
+        bits ++;
+
+    plan->size = size;
+    plan->bitrev = realloc (plan->bitrev, sizeof (int) * n);
+    plan->tw_re = realloc (plan->tw_re, sizeof (float) * n);
+    plan->tw_im = realloc (plan->tw_im, sizeof (float) * n);
+    plan->rot_re = realloc (plan->rot_re, sizeof (float) * n);
+    plan->rot_im = realloc (plan->rot_im, sizeof (float) * n);
+    plan->work_re = realloc (plan->work_re, sizeof (float) * n);
+    plan->work_im = realloc (plan->work_im, sizeof (float) * n);
+
+    for (int i = 0; i < n; i ++)
+    {
+        int rev = 0;
+        for (int b = 0; b < bits; b ++)
+            rev |= ((i >> b) & 1) << (bits - 1 - b);
+
+        plan->bitrev[i] = rev;
+    }
+
+    /* The stage combining blocks of <half> uses exp (-i * pi * k / half) for
+     * k < half; these are stored one stage after another, starting at half - 1,
+     * so that each stage reads them in order. */
+    for (int half = 1; half < n; half *= 2)
+    {
+        for (int k = 0; k < half; k ++)
+        {
+            plan->tw_re[half - 1 + k] = cos (M_PI * k / half);
+            plan->tw_im[half - 1 + k] = -sin (M_PI * k / half);
+        }
+    }
+
+    for (int k = 0; k < n; k ++)
+    {
+        plan->rot_re[k] = cos (2 * M_PI * k / size);
+        plan->rot_im[k] = -sin (2 * M_PI * k / size);
+    }
+}
+
+void rfft_plan_free (RFFTPlan * plan)
+{
+    free (plan->bitrev);
+    free (plan->tw_re);
+    free (plan->tw_im);
+    free (plan->rot_re);
+    free (plan->rot_im);
+    free (plan->work_re);
+    free (plan->work_im);
+
+    plan->size = 0;
+    plan->bitrev = NULL;
+    plan->tw_re = plan->tw_im = plan->rot_re = plan->rot_im = NULL;
+    plan->work_re = plan->work_im = NULL;
+}
+
+/* forward complex FFT of size / 2 points, in place on the work arrays */
+static void complex_fft (RFFTPlan * plan)
+{
+    int n = plan->size / 2;
+    float * re = plan->work_re, * im = plan->work_im;
+
+    for (int i = 0; i < n; i ++)
+    {
+        int j = plan->bitrev[i];
+
+        if (j > i)
+        {
+            float t = re[i]; re[i] = re[j]; re[j] = t;
+            t = im[i]; im[i] = im[j]; im[j] = t;
+        }
+    }
+
+    for (int half = 1; half < n; half *= 2)
+    {
+        const float * wr = plan->tw_re + half - 1;
+        const float * wi = plan->tw_im + half - 1;
+
+        for (int start = 0; start < n; start += 2 * half)
+        {
+            float * ar = re + start, * ai = im + start;
+            float * br = ar + half, * bi = ai + half;
+            int k = 0;
+
+#ifdef __SSE__
+            if (half >= 4)
+            {
+                for (; k < half; k += 4)
+                {
+                    __m128 vwr = _mm_loadu_ps (wr + k), vwi = _mm_loadu_ps (wi + k);
+                    __m128 vbr = _mm_loadu_ps (br + k), vbi = _mm_loadu_ps (bi + k);
+                    __m128 var = _mm_loadu_ps (ar + k), vai = _mm_loadu_ps (ai + k);
+
+                    __m128 tr = _mm_sub_ps (_mm_mul_ps (vbr, vwr), _mm_mul_ps (vbi, vwi));
+                    __m128 ti = _mm_add_ps (_mm_mul_ps (vbr, vwi), _mm_mul_ps (vbi, vwr));
+
+                    _mm_storeu_ps (br + k, _mm_sub_ps (var, tr));
+                    _mm_storeu_ps (bi + k, _mm_sub_ps (vai, ti));
+                    _mm_storeu_ps (ar + k, _mm_add_ps (var, tr));
+                    _mm_storeu_ps (ai + k, _mm_add_ps (vai, ti));
+                }
+            }
+#endif
+
+            for (; k < half; k ++)
+            {
+                float tr = br[k] * wr[k] - bi[k] * wi[k];
+                float ti = br[k] * wi[k] + bi[k] * wr[k];
+
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+}
+
+/* The even samples go in the real part and the odd ones in the imaginary part;
+ * the two half-size spectra are then separated and combined. */
+void rfft_forward (RFFTPlan * plan, const float * in, float * re, float * im)
+{
+    int n = plan->size / 2;
+    float * zr = plan->work_re, * zi = plan->work_im;
+
+    for (int i = 0; i < n; i ++)
+    {
+        zr[i] = in[2 * i];
+        zi[i] = in[2 * i + 1];
+    }
+
+    complex_fft (plan);
+
+    re[0] = zr[0] + zi[0];
+    im[0] = 0;
+    re[n] = zr[0] - zi[0];
+    im[n] = 0;
+
+    for (int k = 1; k < n; k ++)
+    {
+        /* even part E = (Z[k] + conj (Z[n - k])) / 2,
+         * odd part O = (Z[k] - conj (Z[n - k])) / 2i */
+        float e_re = (zr[k] + zr[n - k]) / 2, e_im = (zi[k] - zi[n - k]) / 2;
+        float o_re = (zi[k] + zi[n - k]) / 2, o_im = (zr[n - k] - zr[k]) / 2;
+
+        re[k] = e_re + o_re * plan->rot_re[k] - o_im * plan->rot_im[k];
+        im[k] = e_im + o_re * plan->rot_im[k] + o_im * plan->rot_re[k];
+    }
+}
+
+void rfft_inverse (RFFTPlan * plan, const float * re, const float * im, float * out)
+{
+    int n = plan->size / 2;
+    float * zr = plan->work_re, * zi = plan->work_im;
+
+    for (int k = 0; k < n; k ++)
+    {
+        /* E = (X[k] + conj (X[n - k])) / 2,
+         * O = (X[k] - conj (X[n - k])) / 2 * conj (rot[k]) */
+        float e_re = (re[k] + re[n - k]) / 2, e_im = (im[k] - im[n - k]) / 2;
+        float d_re = (re[k] - re[n - k]) / 2, d_im = (im[k] + im[n - k]) / 2;
+        float o_re = d_re * plan->rot_re[k] + d_im * plan->rot_im[k];
+        float o_im = d_im * plan->rot_re[k] - d_re * plan->rot_im[k];
+
+        /* Z = E + iO, conjugated for the inverse transform */
+        zr[k] = e_re - o_im;
+        zi[k] = -(e_im + o_re);
+    }
+
+    complex_fft (plan);
+
+    for (int i = 0; i < n; i ++)
+    {
+        out[2 * i] = zr[i];
+        out[2 * i + 1] = -zi[i];
+    }
+}
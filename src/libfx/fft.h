@@ -0,0 +1,42 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_FFT_H
+#define LIBFX_FFT_H
+
+/* Real-input FFT of a fixed size, computed as a complex FFT of half the size.
+ * Spectra are kept as separate real and imaginary arrays of size / 2 + 1 bins. */
+typedef struct {
+    int size;
+    int * bitrev;          /* size / 2 */
+    float * tw_re, * tw_im; /* complex FFT twiddles, grouped by stage */
+    float * rot_re, * rot_im; /* split/merge twiddles, size / 2 */
+    float * work_re, * work_im; /* size / 2 */
+} RFFTPlan;
+
+/* <size> must be a power of two, at least 8. */
+void rfft_plan_init (RFFTPlan * plan, int size);
+void rfft_plan_free (RFFTPlan * plan);
+
+void rfft_forward (RFFTPlan * plan, const float * in, float * re, float * im);
+
+/* Not normalized: the result is scaled by size / 2. */
+void rfft_inverse (RFFTPlan * plan, const float * re, const float * im, float * out);
+
+#endif
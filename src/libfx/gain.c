@@ -0,0 +1,168 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Since the channel pairs are adjacent in memory, a vector of four samples
+ * always starts on a left channel and takes the gains {left, right, left,
+ * right}, whatever the channel count.  Integer samples are widened to 32 bits,
+ * scaled as floats and narrowed again. */
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "gain.h"
+
+#define S32_MAX_FLOAT 2147483520.0f /* the largest float below 2^31 */
+
+static int setup (int frames, int channels, float * left, float * right)
+{
+    if (channels % 2)
+        * right = * left;
+
+    if (* left == 1 && * right == 1)
+        return 0;
+
+    return frames * channels;
+}
+
+void gain_float (float * data, int frames, int channels, float left, float right)
+{
+    float * end = data + setup (frames, channels, & left, & right);
+
+#if defined (__SSE2__)
+    __m128 g = _mm_setr_ps (left, right, left, right);
+
+    for (; data + 4 <= end; data += 4)
+        _mm_storeu_ps (data, _mm_mul_ps (_mm_loadu_ps (data), g));
+#elif defined (HAVE_NEON)
+    const float lr[4] = {left, right, left, right};
+    float32x4_t g = vld1q_f32 (lr);
+
+    for (; data + 4 <= end; data += 4)
+        vst1q_f32 (data, vmulq_f32 (vld1q_f32 (data), g));
+#endif
+
+    for (; data + 2 <= end; data += 2)
+    {
+        data[0] *= left;
+        data[1] *= right;
+    }
+
+    if (data < end)
+        data[0] *= left;
+}
+
+static int16_t scale_s16 (int16_t sample, float gain)
+{
+    float f = sample * gain;
+    f += (f < 0) ? -0.5f : 0.5f;
+    return (f < -32768) ? -32768 : (f > 32767) ? 32767 : (int16_t) f;
+}
+
+void gain_s16 (int16_t * data, int frames, int channels, float left, float right)
+{
+    int16_t * end = data + setup (frames, channels, & left, & right);
+
+#if defined (__SSE2__)
+    __m128 g = _mm_setr_ps (left, right, left, right);
+
+    for (; data + 8 <= end; data += 8)
+    {
+        __m128i v = _mm_loadu_si128 ((__m128i *) data);
+        __m128i lo = _mm_srai_epi32 (_mm_unpacklo_epi16 (v, v), 16);
+        __m128i hi = _mm_srai_epi32 (_mm_unpackhi_epi16 (v, v), 16);
+        lo = _mm_cvtps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (lo), g));
+        hi = _mm_cvtps_epi32 (_mm_mul_ps (_mm_cvtepi32_ps (hi), g));
+        _mm_storeu_si128 ((__m128i *) data, _mm_packs_epi32 (lo, hi));
+    }
+#elif defined (HAVE_NEON)
+    const float lr[4] = {left, right, left, right};
+    float32x4_t g = vld1q_f32 (lr);
+
+    for (; data + 4 <= end; data += 4)
+    {
+        float32x4_t f = vcvtq_f32_s32 (vmovl_s16 (vld1_s16 (data)));
+        f = vmulq_f32 (f, g);
+        /* round to nearest; the conversion itself truncates */
+        f = vaddq_f32 (f, vbslq_f32 (vcltq_f32 (f, vdupq_n_f32 (0)),
+         vdupq_n_f32 (-0.5f), vdupq_n_f32 (0.5f)));
+        vst1_s16 (data, vqmovn_s32 (vcvtq_s32_f32 (f)));
+    }
+#endif
+
+    for (; data + 2 <= end; data += 2)
+    {
+        data[0] = scale_s16 (data[0], left);
+        data[1] = scale_s16 (data[1], right);
+    }
+
+    if (data < end)
+        data[0] = scale_s16 (data[0], left);
+}
+
+static int32_t scale_s32 (int32_t sample, float gain)
+{
+    float f = (float) sample * gain;
+    f += (f < 0) ? -0.5f : 0.5f;
+    return (f < -S32_MAX_FLOAT) ? INT32_MIN : (f > S32_MAX_FLOAT) ? INT32_MAX :
+     (int32_t) f;
+}
+
+void gain_s32 (int32_t * data, int frames, int channels, float left, float right)
+{
+    int32_t * end = data + setup (frames, channels, & left, & right);
+
+#if defined (__SSE2__)
+    __m128 g = _mm_setr_ps (left, right, left, right);
+    __m128 limit = _mm_set1_ps (2147483648.0f);
+
+    /* The conversion gives INT32_MIN on overflow, which is right only for
+     * negative samples; flipping all its bits gives INT32_MAX. */
+    for (; data + 4 <= end; data += 4)
+    {
+        __m128 f = _mm_mul_ps (_mm_cvtepi32_ps (_mm_loadu_si128 ((__m128i *) data)), g);
+        __m128i over = _mm_castps_si128 (_mm_cmpge_ps (f, limit));
+        _mm_storeu_si128 ((__m128i *) data, _mm_xor_si128 (_mm_cvtps_epi32 (f), over));
+    }
+#elif defined (HAVE_NEON)
+    const float lr[4] = {left, right, left, right};
+    float32x4_t g = vld1q_f32 (lr);
+
+    /* the conversion saturates but truncates */
+    for (; data + 4 <= end; data += 4)
+    {
+        float32x4_t f = vmulq_f32 (vcvtq_f32_s32 (vld1q_s32 (data)), g);
+        f = vaddq_f32 (f, vbslq_f32 (vcltq_f32 (f, vdupq_n_f32 (0)),
+         vdupq_n_f32 (-0.5f), vdupq_n_f32 (0.5f)));
+        vst1q_s32 (data, vcvtq_s32_f32 (f));
+    }
+#endif
+
+    for (; data + 2 <= end; data += 2)
+    {
+        data[0] = scale_s32 (data[0], left);
+        data[1] = scale_s32 (data[1], right);
+    }
+
+    if (data < end)
+        data[0] = scale_s32 (data[0], left);
+}
@@ -0,0 +1,32 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_GAIN_H
+#define LIBFX_GAIN_H
+
+#include <stdint.h>
+
+/* Scale interleaved samples in place, the even channels by <left> and the odd
+ * ones by <right>; with an odd number of channels, all of them by <left>.  The
+ * integer versions round and saturate.  Nothing is done at unity gain. */
+void gain_float (float * data, int frames, int channels, float left, float right);
+void gain_s16 (int16_t * data, int frames, int channels, float left, float right);
+void gain_s32 (int32_t * data, int frames, int channels, float left, float right);
+
+#endif
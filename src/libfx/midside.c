@@ -0,0 +1,71 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Mid/side scaling of a pair of channels is a symmetric 2x2 matrix:
+ *
+ *   L' = a * L + b * R,  R' = b * L + a * R
+ *
+ * with a = (mid + side) / 2 and b = (mid - side) / 2.  Since the pairs are
+ * adjacent in memory, the interleaved data can be taken as one long run of
+ * pairs whatever the channel count, and a vector of two pairs is multiplied by
+ * a and added to a copy of itself with each pair swapped, multiplied by b. */
+
+#if defined (__SSE__)
+#include <xmmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "midside.h"
+
+void midside_run (float * data, int frames, int channels, float mid, float side)
+{
+    if (channels % 2)
+        return;
+
+    float a = (mid + side) / 2, b = (mid - side) / 2;
+    float * end = data + frames * channels;
+
+#if defined (__SSE__)
+    __m128 va = _mm_set1_ps (a), vb = _mm_set1_ps (b);
+
+    for (; data + 4 <= end; data += 4)
+    {
+        __m128 v = _mm_loadu_ps (data);
+        __m128 swapped = _mm_shuffle_ps (v, v, _MM_SHUFFLE (2, 3, 0, 1));
+        _mm_storeu_ps (data, _mm_add_ps (_mm_mul_ps (v, va), _mm_mul_ps (swapped, vb)));
+    }
+#elif defined (HAVE_NEON)
+    float32x4_t va = vdupq_n_f32 (a), vb = vdupq_n_f32 (b);
+
+    for (; data + 4 <= end; data += 4)
+    {
+        float32x4_t v = vld1q_f32 (data);
+        vst1q_f32 (data, vmlaq_f32 (vmulq_f32 (v, va), vrev64q_f32 (v), vb));
+    }
+#endif
+
+    for (; data < end; data += 2)
+    {
+        float left = data[0], right = data[1];
+        data[0] = a * left + b * right;
+        data[1] = b * left + a * right;
+    }
+}
@@ -0,0 +1,28 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_MIDSIDE_H
+#define LIBFX_MIDSIDE_H
+
+/* Scales the mid (L + R) / 2 and side (L - R) / 2 parts of each pair of
+ * channels (0 and 1, 2 and 3, and so on) by <mid> and <side>, in place.  With
+ * an odd number of channels, nothing is done. */
+void midside_run (float * data, int frames, int channels, float mid, float side);
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "outstats.h"
+
+#define GET(x) __atomic_load_n (& (x), __ATOMIC_RELAXED)
+#define ADD(x, v) __atomic_add_fetch (& (x), (v), __ATOMIC_RELAXED)
+
+int64_t stats_now (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, & now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void fill_reset (FillStats * fill)
+{
+    fill->min = 100;
+    fill->max = 0;
+    fill->sum = fill->count = 0;
+}
+
+void stats_reset (OutputStats * stats, const char * name)
+{
+    memset (stats, 0, sizeof (OutputStats));
+    stats->name = name;
+    stats->started = stats->last_dump = stats_now ();
+    fill_reset (& stats->ring);
+    fill_reset (& stats->device);
+}
+
+void stats_fill (FillStats * fill, int64_t filled, int64_t size)
+{
+    if (size <= 0)
+        return;
+
+    int percent = filled * 100 / size;
+    int old;
+
+    if (percent < 0)
+        percent = 0;
+    if (percent > 100)
+        percent = 100;
+
+    old = GET (fill->min);
+    while (percent < old && ! __atomic_compare_exchange_n (& fill->min, & old,
+     percent, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    old = GET (fill->max);
+    while (percent > old && ! __atomic_compare_exchange_n (& fill->max, & old,
+     percent, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+
+    ADD (fill->sum, percent);
+    ADD (fill->count, 1);
+}
+
+void stats_write_done (OutputStats * stats, int64_t start)
+{
+    int64_t elapsed = stats_now () - start;
+    int bucket = 0;
+
+    while (bucket < STATS_BUCKETS - 1 && elapsed >= (int64_t) 1 << bucket)
+        bucket ++;
+
+    ADD (stats->latency[bucket], 1);
+}
+
+int stats_due (OutputStats * stats)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+        enabled = (getenv ("AUD_OUTPUT_STATS") != NULL);
+
+    return enabled && stats_now () - stats->last_dump >= 1000000;
+}
+
+static void print_fill (FILE * file, const char * label, FillStats * fill)
+{
+    int64_t count = GET (fill->count);
+
+    if (count)
+        fprintf (file, ", %s fill %d/%d/%d%%", label, GET (fill->min),
+         (int) (GET (fill->sum) / count), GET (fill->max));
+}
+
+void stats_dump (OutputStats * stats)
+{
+    const char * path = getenv ("AUD_OUTPUT_STATS");
+
+    if (! path)
+        return;
+
+    int64_t now = stats_now ();
+    int64_t wakeups = GET (stats->wakeups);
+    double seconds = (now - stats->started) / 1000000.0;
+    double interval = (now - stats->last_dump) / 1000000.0;
+    double rate = interval > 0 ? (wakeups - stats->wakeups_dumped) / interval : 0;
+
+    stats->last_dump = now;
+    stats->wakeups_dumped = wakeups;
+
+    char temp[strlen (path) + 5];
+    FILE * file;
+
+    if (! strcmp (path, "-"))
+        file = stderr;
+    else
+    {
+        snprintf (temp, sizeof temp, "%s.tmp", path);
+
+        if (! (file = fopen (temp, "w")))
+            return;
+    }
+
+    fprintf (file, "%s: %.1f s, underruns %d, starvations %d, recoveries %d, "
+     "wakeups %.1f/s", stats->name, seconds, (int) GET (stats->underruns),
+     (int) GET (stats->starvations), (int) GET (stats->recoveries), rate);
+
+    print_fill (file, "ring", & stats->ring);
+    print_fill (file, "device", & stats->device);
+
+    fprintf (file, ", write latency (µs):");
+
+    for (int b = 0; b < STATS_BUCKETS; b ++)
+    {
+        int64_t count = GET (stats->latency[b]);
+
+        if (! count)
+            continue;
+
+        if (b == STATS_BUCKETS - 1)
+            fprintf (file, " >=%d:%d", 1 << (b - 1), (int) count);
+        else
+            fprintf (file, " <%d:%d", 1 << b, (int) count);
+    }
+
+    fputc ('\n', file);
+
+    if (file != stderr)
+    {
+        fclose (file);
+        rename (temp, path);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_OUTSTATS_H
+#define LIBFX_OUTSTATS_H
+
+#include <stdint.h>
+
+/* Counters for diagnosing glitches in output plugins.  All updates are single
+ * relaxed atomic operations, safe to make from a real-time thread.
+ *
+ * If $AUD_OUTPUT_STATS names a file, a one-line summary is written to it
+ * (replacing it) about once a second and when the stream is closed; "-" means
+ * stderr.  Nothing is written otherwise. */
+
+#define STATS_BUCKETS 16 /* write latency: < 1, 2, 4, ... 16384, and more µs */
+
+typedef struct {
+    int min, max;         /* percent */
+    int64_t sum, count;
+} FillStats;
+
+typedef struct {
+    const char * name;
+    int64_t started, last_dump;          /* µs */
+    int64_t underruns;   /* the device ran dry */
+    int64_t starvations; /* our own buffer ran dry while playing */
+    int64_t recoveries;  /* errors recovered from by restarting the device */
+    int64_t wakeups;     /* shown as a rate since the previous dump */
+    int64_t wakeups_dumped; /* <wakeups> at <last_dump> */
+    FillStats ring, device;
+    int64_t latency[STATS_BUCKETS];
+} OutputStats;
+
+int64_t stats_now (void); /* µs, monotonic */
+
+void stats_reset (OutputStats * stats, const char * name);
+
+static inline void stats_count (int64_t * counter)
+    { __atomic_add_fetch (counter, 1, __ATOMIC_RELAXED); }
+
+/* <filled> out of <size>, in any unit */
+void stats_fill (FillStats * fill, int64_t filled, int64_t size);
+
+/* a write call that began at <start> (from stats_now) has just returned */
+void stats_write_done (OutputStats * stats, int64_t start);
+
+/* Whether a periodic dump is due; for the playback thread only, since the dump
+ * itself does file I/O. */
+int stats_due (OutputStats * stats);
+
+void stats_dump (OutputStats * stats);
+
+static inline void stats_poll (OutputStats * stats)
+{
+    if (stats_due (stats))
+        stats_dump (stats);
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pump.h"
+
+int wake_init (WakePipe * wake)
+{
+    if (pipe (wake->fds))
+    {
+        fprintf (stderr, "Failed to create pipe: %s.\n", strerror (errno));
+        return 0;
+    }
+
+    if (fcntl (wake->fds[0], F_SETFL, O_NONBLOCK))
+    {
+        fprintf (stderr, "Failed to set O_NONBLOCK on pipe: %s.\n", strerror (errno));
+        close (wake->fds[0]);
+        close (wake->fds[1]);
+        return 0;
+    }
+
+    wake->waiting = 0;
+    return 1;
+}
+
+void wake_free (WakePipe * wake)
+{
+    close (wake->fds[0]);
+    close (wake->fds[1]);
+}
+
+void wake_clear (WakePipe * wake)
+{
+    char c;
+    while (read (wake->fds[0], & c, 1) == 1)
+        ;
+}
+
+void wake_signal (WakePipe * wake)
+{
+    const char c = 0;
+
+    while (write (wake->fds[1], & c, 1) < 0)
+    {
+        if (errno != EINTR)
+        {
+            fprintf (stderr, "Failed to write to pipe: %s.\n", strerror (errno));
+            break;
+        }
+    }
+}
+
+/* A signal may cut the sleep short; callers check their condition anyway. */
+void wake_sleep (WakePipe * wake)
+{
+    struct pollfd handle = {.fd = wake->fds[0], .events = POLLIN};
+
+    if (poll (& handle, 1, -1) < 0 && errno != EINTR)
+        fprintf (stderr, "Failed to poll: %s.\n", strerror (errno));
+
+    wake_clear (wake);
+}
+
+static unsigned int get_timestamp (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, & now);
+    return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+void delay_set (uint64_t * packed, int frames)
+{
+    ATOMIC_SET (* packed, (uint64_t) (frames > 0 ? frames : 0) << 32 | get_timestamp ());
+}
+
+int delay_guess (uint64_t * packed, int rate)
+{
+    uint64_t value = ATOMIC_GET (* packed);
+    int64_t delay = value >> 32;
+    unsigned int elapsed = get_timestamp () - (unsigned int) value;
+
+    delay -= (int64_t) elapsed * rate / 1000;
+    return delay > 0 ? delay : 0;
+}
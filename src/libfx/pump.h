@@ -0,0 +1,64 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_PUMP_H
+#define LIBFX_PUMP_H
+
+#include <stdint.h>
+
+#include "ring.h"
+
+/* Helpers for output plugins that move audio from a ring (see ring.h) to the
+ * device on a "pump" thread of their own.
+ *
+ * A WakePipe lets one thread sleep until another has something for it.  The
+ * sleeper sets <waiting>, checks its condition once more, and only then goes
+ * to sleep; the other side calls wake_up, which writes to the pipe only when
+ * it finds the flag set.  The read end may also be polled along with other
+ * file descriptors (the device's, say), and emptied with wake_clear. */
+
+typedef struct {
+    int fds[2];
+    char waiting;
+} WakePipe;
+
+int wake_init (WakePipe * wake); /* returns 0 on failure */
+void wake_free (WakePipe * wake);
+
+void wake_clear (WakePipe * wake);
+void wake_signal (WakePipe * wake); /* whether anyone is waiting or not */
+void wake_sleep (WakePipe * wake);
+
+static inline void wake_up (WakePipe * wake)
+{
+    if (ATOMIC_SWAP (wake->waiting, 0))
+        wake_signal (wake);
+}
+
+/* The device's delay (in frames), published by the pump together with the
+ * time it was read, so that other threads can work out the output time without
+ * a call into the device.  Packed as frames << 32 | timestamp in milliseconds,
+ * and accessed atomically. */
+
+void delay_set (uint64_t * packed, int frames);
+
+/* the delay last published, less the time passed since then */
+int delay_guess (uint64_t * packed, int rate);
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+
+void ring_init (Ring * ring, int size)
+{
+    ring->data = malloc (size);
+    ring->size = size;
+    ring_reset (ring);
+}
+
+void ring_free (Ring * ring)
+{
+    free (ring->data);
+    ring->data = NULL;
+    ring->size = 0;
+}
+
+void ring_reset (Ring * ring)
+{
+    ring->read = ring->write = 0;
+    ATOMIC_SET (ring->filled, 0);
+}
+
+void ring_write (Ring * ring, const void * data, int length)
+{
+    int part = MIN (length, ring->size - ring->write);
+
+    memcpy (ring->data + ring->write, data, part);
+    memcpy (ring->data, (const char *) data + part, length - part);
+
+    ring->write = (ring->write + length) % ring->size;
+    ATOMIC_ADD (ring->filled, length);
+}
+
+int ring_reserve (Ring * ring, void * * data)
+{
+    * data = ring->data + ring->write;
+    return MIN (ring_space (ring), ring->size - ring->write);
+}
+
+void ring_commit (Ring * ring, int length)
+{
+    ring->write = (ring->write + length) % ring->size;
+    ATOMIC_ADD (ring->filled, length);
+}
+
+void ring_read (Ring * ring, void * data, int length)
+{
+    int part = MIN (length, ring->size - ring->read);
+
+    memcpy (data, ring->data + ring->read, part);
+    memcpy ((char *) data + part, ring->data, length - part);
+
+    ring_consume (ring, length);
+}
+
+int ring_peek (Ring * ring, void * * data)
+{
+    * data = ring->data + ring->read;
+    return MIN (ring_filled (ring), ring->size - ring->read);
+}
+
+void ring_consume (Ring * ring, int length)
+{
+    ring->read = (ring->read + length) % ring->size;
+    ATOMIC_ADD (ring->filled, -length);
+}
@@ -0,0 +1,66 @@
+/*
+ * Shared helpers for Audacious plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_RING_H
+#define LIBFX_RING_H
+
+/* A ring buffer of bytes for exactly one writer thread and one reader thread,
+ * which never blocks either of them.  Each side keeps its own position; the
+ * only shared state is the count of bytes filled, which the writer increases
+ * (after copying data in) and the reader decreases (after copying data out).
+ * Waking a side that has gone to sleep is left to the caller. */
+
+#define ATOMIC_GET(x) __atomic_load_n (& (x), __ATOMIC_SEQ_CST)
+#define ATOMIC_SET(x, v) __atomic_store_n (& (x), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(x, v) __atomic_add_fetch (& (x), (v), __ATOMIC_SEQ_CST)
+#define ATOMIC_SWAP(x, v) __atomic_exchange_n (& (x), (v), __ATOMIC_SEQ_CST)
+
+typedef struct {
+    char * data;
+    int size;
+    int read, write; /* owned by the reader and the writer */
+    int filled;      /* shared */
+} Ring;
+
+void ring_init (Ring * ring, int size);
+void ring_free (Ring * ring);
+
+/* Empties the ring; neither side may be using it meanwhile. */
+void ring_reset (Ring * ring);
+
+static inline int ring_filled (Ring * ring)
+    { return ATOMIC_GET (ring->filled); }
+static inline int ring_space (Ring * ring)
+    { return ring->size - ATOMIC_GET (ring->filled); }
+
+/* writer side; <length> must not exceed ring_space () */
+void ring_write (Ring * ring, const void * data, int length);
+
+/* Gives the contiguous part of the free space, to be written in place and then
+ * handed to ring_commit. */
+int ring_reserve (Ring * ring, void * * data);
+void ring_commit (Ring * ring, int length);
+
+/* reader side; ring_read copies out, ring_peek gives the contiguous part of the
+ * data to be used in place and then handed to ring_consume */
+void ring_read (Ring * ring, void * data, int length);
+int ring_peek (Ring * ring, void * * data);
+void ring_consume (Ring * ring, int length);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Growth is geometric, so that a stream whose block size creeps upwards does
+ * not cause a string of reallocations.  Each thread finds its arena through a
+ * thread-local pointer, so scratch_get takes no lock.  The arenas of all
+ * threads are also kept in a list, under the mutex, so that scratch_release
+ * can free a plugin's buffers from whichever thread it is called in; an arena
+ * itself is freed when its thread exits, or when libfx is unloaded. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scratch.h"
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+typedef struct Arena {
+    struct Arena * prev, * next;
+    float * slots[SCRATCH_SLOTS];
+    int sizes[SCRATCH_SLOTS];
+} Arena;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t key;
+static char key_made;
+static Arena * arenas;
+static char reserved[SCRATCH_SLOTS];
+
+static __thread Arena * my_arena;
+
+static float * alloc_aligned (int size)
+{
+    void * mem;
+
+    if (posix_memalign (& mem, SCRATCH_ALIGN, sizeof (float) * size))
+        abort ();
+
+    return mem;
+}
+
+/* called with the mutex held */
+static void free_arena (Arena * arena)
+{
+    for (int s = 0; s < SCRATCH_SLOTS; s ++)
+        free (arena->slots[s]);
+
+    if (arena->prev)
+        arena->prev->next = arena->next;
+    else
+        arenas = arena->next;
+
+    if (arena->next)
+        arena->next->prev = arena->prev;
+
+    free (arena);
+}
+
+static void thread_exit (void * arena)
+{
+    pthread_mutex_lock (& mutex);
+    free_arena (arena);
+    pthread_mutex_unlock (& mutex);
+
+    my_arena = NULL;
+}
+
+static void make_key (void)
+{
+    key_made = ! pthread_key_create (& key, thread_exit);
+}
+
+/* The key must not outlive libfx, since its destructor is in here. */
+__attribute__ ((destructor)) static void unload (void)
+{
+    pthread_mutex_lock (& mutex);
+
+    while (arenas)
+        free_arena (arenas);
+
+    pthread_mutex_unlock (& mutex);
+
+    if (key_made)
+        pthread_key_delete (key);
+}
+
+static Arena * new_arena (void)
+{
+    pthread_once (& key_once, make_key);
+
+    Arena * arena = calloc (1, sizeof (Arena));
+
+    pthread_mutex_lock (& mutex);
+
+    arena->next = arenas;
+
+    if (arenas)
+        arenas->prev = arena;
+
+    arenas = arena;
+
+    pthread_mutex_unlock (& mutex);
+
+    if (key_made)
+        pthread_setspecific (key, arena);
+
+    return arena;
+}
+
+float * scratch_get (int slot, int size)
+{
+    Arena * arena = my_arena;
+
+    if (! arena)
+        arena = my_arena = new_arena ();
+
+    if (arena->sizes[slot] < size)
+    {
+        int new_size = MAX (size, 2 * arena->sizes[slot]);
+
+        free (arena->slots[slot]);
+        arena->slots[slot] = alloc_aligned (new_size);
+        arena->sizes[slot] = new_size;
+    }
+
+    return arena->slots[slot];
+}
+
+int scratch_reserve (int count)
+{
+    int first = -1;
+
+    pthread_mutex_lock (& mutex);
+
+    for (int s = 0, run = 0; s < SCRATCH_SLOTS; s ++)
+    {
+        run = reserved[s] ? 0 : run + 1;
+
+        if (run == count)
+        {
+            first = s + 1 - count;
+            memset (reserved + first, 1, count);
+            break;
+        }
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return first;
+}
+
+void scratch_release (int first, int count)
+{
+    pthread_mutex_lock (& mutex);
+
+    for (Arena * arena = arenas; arena; arena = arena->next)
+    {
+        for (int s = first; s < first + count; s ++)
+        {
+            free (arena->slots[s]);
+            arena->slots[s] = NULL;
+            arena->sizes[s] = 0;
+        }
+    }
+
+    memset (reserved + first, 0, count);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+float * aligned_reserve (AlignedBuf * buf, int size)
+{
+    if (buf->size < size)
+    {
+        int new_size = MAX (size, 2 * buf->size);
+        float * mem = alloc_aligned (new_size);
+
+        if (buf->mem)
+            memcpy (mem, buf->mem, sizeof (float) * buf->size);
+
+        free (buf->mem);
+        buf->mem = mem;
+        buf->size = new_size;
+    }
+
+    return buf->mem;
+}
+
+void aligned_free (AlignedBuf * buf)
+{
+    free (buf->mem);
+    buf->mem = NULL;
+    buf->size = 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * Shared helpers for Audacious effect plugins
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBFX_SCRATCH_H
+#define LIBFX_SCRATCH_H
+
+#define SCRATCH_ALIGN 64 /* bytes; a cache line, and enough for any SIMD */
+#define SCRATCH_SLOTS 64 /* for all plugins together */
+
+/* Each thread has its own arena of scratch buffers, in numbered slots.  libfx
+ * is a shared library, so the slots are shared by all the plugins; each plugin
+ * reserves its own from init, so that the output one effect hands on is never
+ * another effect's scratch space.  Effects that never run at once (the modes
+ * of one plugin, say) should share slots.
+ *
+ * scratch_get returns the buffer in a slot, grown if needed to hold at least
+ * <size> floats; its contents are lost when it grows.  The buffer stays valid
+ * until the same thread asks for the same slot again, so it suits data handed
+ * back from an effect's process function, but not data kept between calls. */
+float * scratch_get (int slot, int size);
+
+/* Reserves <count> consecutive slots and returns the first, or -1 if there are
+ * not enough left. */
+int scratch_reserve (int count);
+
+/* Frees the buffers in the given slots, in all threads, and gives the slots
+ * back.  Called from the plugin's cleanup. */
+void scratch_release (int first, int count);
+
+/* An aligned buffer owned by one effect, for data kept between calls. */
+typedef struct {
+    float * mem;
+    int size; /* floats */
+} AlignedBuf;
+
+/* Grows <buf> if needed to hold at least <size> floats, keeping its contents,
+ * and returns it. */
+float * aligned_reserve (AlignedBuf * buf, int size);
+void aligned_free (AlignedBuf * buf);
+
+#endif
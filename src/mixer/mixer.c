@@ -17,10 +17,17 @@
  * the use of this software.
  */
 
-/* TODO: implement more surround converters */
+/* Any number of channels (up to MAX_CHANNELS) is converted to any other by a
+ * coefficient matrix, from libfx/chanmix.c.  Common conversions have their own
+ * (vectorized) kernels; the rest use a generic one. */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 #include <audacious/i18n.h>
 #include <audacious/misc.h>
@@ -28,96 +35,143 @@
 #include <audacious/preferences.h>
 
 #include "config.h"
+#include "chanmix.h"
+#include "scratch.h"
 
-#define MAX_CHANNELS 8
+#define MAX_CHANNELS CHANMIX_MAX
 
-typedef void (* Converter) (float * * data, int * samples);
+typedef void (* Kernel) (const float * get, float * set, int frames);
 
-static float * mixer_buf;
+static int input_channels, output_channels;
+static float matrix[MAX_CHANNELS][MAX_CHANNELS]; /* [output][input] */
+static Kernel kernel;
+static int mixer_slot; /* scratch, for the output */
 
-static void mono_to_stereo (float * * data, int * samples)
+static void mix_generic (const float * get, float * set, int frames)
 {
-    int frames = * samples;
-    float * get = * data;
-    float * set = mixer_buf = realloc (mixer_buf, sizeof (float) * 2 * frames);
-
-    * data = mixer_buf;
-    * samples = 2 * frames;
-
     while (frames --)
     {
-        float val = * get ++;
-        * set ++ = val;
-        * set ++ = val;
+        for (int o = 0; o < output_channels; o ++)
+        {
+            float sum = 0;
+
+            for (int i = 0; i < input_channels; i ++)
+                sum += matrix[o][i] * get[i];
+
+            * set ++ = sum;
+        }
+
+        get += input_channels;
     }
 }
 
-static void stereo_to_mono (float * * data, int * samples)
+static void mix_mono_to_stereo (const float * get, float * set, int frames)
 {
-    int frames = * samples / 2;
-    float * get = * data;
-    float * set = mixer_buf = realloc (mixer_buf, sizeof (float) * frames);
+    float left = matrix[0][0], right = matrix[1][0];
 
-    * data = mixer_buf;
-    * samples = frames;
+#ifdef __SSE__
+    __m128 coefs = _mm_set_ps (right, left, right, left);
+
+    for (; frames >= 4; frames -= 4, get += 4, set += 8)
+    {
+        __m128 val = _mm_loadu_ps (get);
+        _mm_storeu_ps (set, _mm_mul_ps (_mm_unpacklo_ps (val, val), coefs));
+        _mm_storeu_ps (set + 4, _mm_mul_ps (_mm_unpackhi_ps (val, val), coefs));
+    }
+#endif
 
     while (frames --)
     {
         float val = * get ++;
-        val += * get ++;
-        * set ++ = val / 2;
+        * set ++ = val * left;
+        * set ++ = val * right;
     }
 }
 
-static void quadro_to_stereo (float * * data, int * samples)
+static void mix_stereo_to_mono (const float * get, float * set, int frames)
 {
-    int frames = * samples / 4;
-    float * get = * data;
-    float * set = mixer_buf = realloc (mixer_buf, sizeof (float) * 2 * frames);
+    float left = matrix[0][0], right = matrix[0][1];
 
-    * data = mixer_buf;
-    * samples = 2 * frames;
+#ifdef __SSE__
+    __m128 vleft = _mm_set1_ps (left), vright = _mm_set1_ps (right);
+
+    for (; frames >= 4; frames -= 4, get += 8, set += 4)
+    {
+        __m128 a = _mm_loadu_ps (get), b = _mm_loadu_ps (get + 4);
+        __m128 even = _mm_shuffle_ps (a, b, _MM_SHUFFLE (2, 0, 2, 0));
+        __m128 odd = _mm_shuffle_ps (a, b, _MM_SHUFFLE (3, 1, 3, 1));
+        _mm_storeu_ps (set, _mm_add_ps (_mm_mul_ps (even, vleft),
+         _mm_mul_ps (odd, vright)));
+    }
+#endif
 
     while (frames --)
     {
-        float front_left  = * get ++;
-        float front_right = * get ++;
-        float back_left   = * get ++;
-        float back_right  = * get ++;
-        * set ++ = front_left + (back_left * 0.7);
-        * set ++ = front_right + (back_right * 0.7);
+        float val = get[0] * left + get[1] * right;
+        get += 2;
+        * set ++ = val;
     }
 }
 
-static void surround_5p1_to_stereo (float * * data, int * samples)
+/* Any layout down to stereo.  The SSE path works on two frames at once, with
+ * the left and right outputs of both in one vector. */
+static void mix_to_stereo (const float * get, float * set, int frames)
 {
-    int frames = * samples / 6;
-    float * get = * data;
-    float * set = mixer_buf = realloc (mixer_buf, sizeof (float) * 2 * frames);
+    int channels = input_channels;
 
-    * data = mixer_buf;
-    * samples = 2 * frames;
+#ifdef __SSE__
+    __m128 coefs[MAX_CHANNELS];
 
-    while (frames --)
+    for (int i = 0; i < MAX_CHANNELS; i ++)
     {
-        float front_left  = * get ++;
-        float front_right = * get ++;
-        float center = * get ++;
-        float lfe    = * get ++;
-        float rear_left   = * get ++;
-        float rear_right  = * get ++;
-        * set ++ = front_left + (center * 0.5) + (lfe * 0.5) + (rear_left * 0.5);
-        * set ++ = front_right + (center * 0.5) + (lfe * 0.5) + (rear_right * 0.5);
+        float left = (i < channels) ? matrix[0][i] : 0;
+        float right = (i < channels) ? matrix[1][i] : 0;
+        coefs[i] = _mm_set_ps (right, left, right, left);
     }
-}
 
-static const Converter converters[MAX_CHANNELS + 1][MAX_CHANNELS + 1] = {
- [1][2] = mono_to_stereo,
- [2][1] = stereo_to_mono,
- [4][2] = quadro_to_stereo,
- [6][2] = surround_5p1_to_stereo};
+    /* Each frame is read in groups of four channels, which may run past its
+     * end (into the following frames, with zero coefficients); stop early
+     * enough that this stays inside the buffer. */
+    for (; frames >= 4; frames -= 2, get += 2 * channels, set += 4)
+    {
+        const float * next = get + channels;
+        __m128 sum = _mm_setzero_ps ();
+
+        for (int i = 0; i < channels; i += 4)
+        {
+            __m128 a = _mm_loadu_ps (get + i), b = _mm_loadu_ps (next + i);
+            __m128 lo = _mm_unpacklo_ps (a, b); /* a0 b0 a1 b1 */
+            __m128 hi = _mm_unpackhi_ps (a, b); /* a2 b2 a3 b3 */
+
+            sum = _mm_add_ps (sum, _mm_mul_ps (coefs[i], _mm_shuffle_ps (lo, lo,
+             _MM_SHUFFLE (1, 1, 0, 0))));
+            sum = _mm_add_ps (sum, _mm_mul_ps (coefs[i + 1], _mm_shuffle_ps (lo, lo,
+             _MM_SHUFFLE (3, 3, 2, 2))));
+            sum = _mm_add_ps (sum, _mm_mul_ps (coefs[i + 2], _mm_shuffle_ps (hi, hi,
+             _MM_SHUFFLE (1, 1, 0, 0))));
+            sum = _mm_add_ps (sum, _mm_mul_ps (coefs[i + 3], _mm_shuffle_ps (hi, hi,
+             _MM_SHUFFLE (3, 3, 2, 2))));
+        }
+
+        _mm_storeu_ps (set, sum);
+    }
+#endif
 
-static int input_channels, output_channels;
+    while (frames --)
+    {
+        float left = 0, right = 0;
+
+        for (int i = 0; i < channels; i ++)
+        {
+            left += matrix[0][i] * get[i];
+            right += matrix[1][i] * get[i];
+        }
+
+        get += channels;
+        * set ++ = left;
+        * set ++ = right;
+    }
+}
 
 void mixer_start (int * channels, int * rate)
 {
@@ -128,14 +182,25 @@ void mixer_start (int * channels, int * rate)
     if (input_channels == output_channels)
         return;
 
-    if (input_channels < 1 || input_channels > MAX_CHANNELS ||
-     ! converters[input_channels][output_channels])
+    if (input_channels < 1 || input_channels > MAX_CHANNELS)
     {
         fprintf (stderr, "Converting %d to %d channels is not implemented.\n",
          input_channels, output_channels);
+        output_channels = input_channels;
         return;
     }
 
+    chanmix_matrix (input_channels, output_channels, matrix);
+
+    if (input_channels == 1 && output_channels == 2)
+        kernel = mix_mono_to_stereo;
+    else if (input_channels == 2 && output_channels == 1)
+        kernel = mix_stereo_to_mono;
+    else if (output_channels == 2)
+        kernel = mix_to_stereo;
+    else
+        kernel = mix_generic;
+
     * channels = output_channels;
 }
 
@@ -144,11 +209,13 @@ void mixer_process (float * * data, int * samples)
     if (input_channels == output_channels)
         return;
 
-    if (input_channels < 1 || input_channels > MAX_CHANNELS ||
-     ! converters[input_channels][output_channels])
-        return;
+    int frames = * samples / input_channels;
+    float * mixer_buf = scratch_get (mixer_slot, frames * output_channels);
 
-    converters[input_channels][output_channels] (data, samples);
+    kernel (* data, mixer_buf, frames);
+
+    * data = mixer_buf;
+    * samples = frames * output_channels;
 }
 
 static const char * const mixer_defaults[] = {
@@ -158,13 +225,12 @@ static const char * const mixer_defaults[] = {
 static bool_t mixer_init (void)
 {
     aud_config_set_defaults ("mixer", mixer_defaults);
-    return TRUE;
+    return (mixer_slot = scratch_reserve (1)) >= 0;
 }
 
 static void mixer_cleanup (void)
 {
-    free (mixer_buf);
-    mixer_buf = 0;
+    scratch_release (mixer_slot, 1);
 }
 
 static const char mixer_about[] =
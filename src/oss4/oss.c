@@ -22,6 +22,15 @@
 
 #include "oss.h"
 
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "outstats.h"
+#include "pump.h"
+#include "ring.h"
+
 static const char * const oss_defaults[] = {
  "device", DEFAULT_DSP,
  "use_alt_device", "FALSE",
@@ -33,12 +42,35 @@ static const char * const oss_defaults[] = {
  NULL};
 
 oss_data_t *oss_data;
-static int64_t oss_time; /* microseconds */
-static bool_t oss_paused;
-static int oss_paused_time;
-static int oss_delay; /* miliseconds */
 static bool_t oss_ioctl_vol = FALSE;
 
+/* The decoder thread only fills oss_ring; the pump thread moves the data on to
+ * the device, sleeping in poll() until there is room for another fragment.
+ * The pipes are used as in the ALSA plugin (see alsa.c and pump.h).  If the
+ * pump gives up, it sets pump_failed and wakes the writer, which then stops
+ * waiting for it until the next flush. */
+static pthread_mutex_t oss_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t oss_cond = PTHREAD_COND_INITIALIZER;
+
+static Ring oss_ring;
+static int oss_hw_buffer; /* bytes */
+
+/* The following are shared with the pump (or with callers of output_time) and
+ * are accessed only through ATOMIC_GET and ATOMIC_SET. */
+static int64_t oss_written; /* frames */
+static char oss_prebuffer, oss_paused;
+static int oss_paused_delay; /* frames */
+static uint64_t oss_delay; /* see delay_set () */
+
+static WakePipe pump_pipe, writer_pipe;
+static struct pollfd poll_handles[2];
+static char oss_draining;
+
+static OutputStats oss_stats;
+
+static char pump_quit, pump_failed;
+static pthread_t pump_thread;
+
 bool_t oss_init(void)
 {
     AUDDBG("Init.\n");
@@ -57,6 +89,206 @@ void oss_cleanup(void)
     free(oss_data);
 }
 
+static bool_t poll_setup(void)
+{
+    if (!wake_init(&pump_pipe))
+        return FALSE;
+
+    if (!wake_init(&writer_pipe))
+    {
+        wake_free(&pump_pipe);
+        return FALSE;
+    }
+
+    poll_handles[0].fd = pump_pipe.fds[0];
+    poll_handles[0].events = POLLIN;
+    poll_handles[1].fd = oss_data->fd;
+    poll_handles[1].events = POLLOUT;
+
+    return TRUE;
+}
+
+/* until there is room for a fragment, or we are woken */
+static void poll_sleep(void)
+{
+    if (poll(poll_handles, N_ELEMENTS(poll_handles), -1) < 0)
+    {
+        if (errno != EINTR)
+            DESCRIBE_ERROR;
+
+        return;
+    }
+
+    if (poll_handles[0].revents & POLLIN)
+        wake_clear(&pump_pipe);
+}
+
+static void poll_cleanup(void)
+{
+    wake_free(&pump_pipe);
+    wake_free(&writer_pipe);
+}
+
+static void pump_wake(void)
+{
+    wake_up(&pump_pipe);
+}
+
+static void writer_wake(void)
+{
+    wake_up(&writer_pipe);
+}
+
+static int filled_frames(void)
+{
+    return oss_bytes_to_frames(ring_filled(&oss_ring));
+}
+
+static bool_t pump_ready(void)
+{
+    return !ATOMIC_GET(pump_quit) && !ATOMIC_GET(oss_prebuffer) &&
+     !ATOMIC_GET(oss_paused) && filled_frames();
+}
+
+/* called without the mutex, when there is nothing to write */
+static void pump_wait(void)
+{
+    ATOMIC_SET(pump_pipe.waiting, 1);
+
+    if (!pump_ready())
+        wake_sleep(&pump_pipe);
+
+    ATOMIC_SET(pump_pipe.waiting, 0);
+}
+
+static int get_delay(void)
+{
+    int delay = 0;
+
+    CHECK(ioctl, oss_data->fd, SNDCTL_DSP_GETODELAY, &delay);
+
+FAILED:
+    return oss_bytes_to_frames(delay);
+}
+
+static void *pump(void *unused)
+{
+    pthread_mutex_lock(&oss_mutex);
+    pthread_cond_broadcast(&oss_cond); /* signal thread started */
+
+    bool_t starved = FALSE;
+
+    while (!pump_quit)
+    {
+        if (!pump_ready())
+        {
+            /* ran out of data while playing, other than at the end */
+            if (!starved && !filled_frames() && !ATOMIC_GET(oss_prebuffer) &&
+             !ATOMIC_GET(oss_paused) && !ATOMIC_GET(oss_draining))
+            {
+                stats_count(&oss_stats.starvations);
+                starved = TRUE;
+            }
+
+            pthread_mutex_unlock(&oss_mutex);
+            pump_wait();
+            pthread_mutex_lock(&oss_mutex);
+            stats_count(&oss_stats.wakeups);
+            continue;
+        }
+
+        starved = FALSE;
+
+        audio_buf_info buf_info;
+
+        if (ioctl(oss_data->fd, SNDCTL_DSP_GETOSPACE, &buf_info) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            DESCRIBE_ERROR;
+            goto FAILED;
+        }
+
+        stats_fill(&oss_stats.device, oss_hw_buffer - buf_info.bytes, oss_hw_buffer);
+        stats_fill(&oss_stats.ring, ring_filled(&oss_ring), oss_ring.size);
+
+        /* never more than the device has room for, so write() cannot block */
+        void *data;
+        int length = MIN(buf_info.bytes, ring_peek(&oss_ring, &data));
+        length = oss_frames_to_bytes(oss_bytes_to_frames(length));
+
+        if (!length)
+            goto WAIT;
+
+        int64_t start = stats_now();
+        int written = write(oss_data->fd, data, length);
+        stats_write_done(&oss_stats, start);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            DESCRIBE_ERROR;
+            goto FAILED;
+        }
+
+        /* Publish the new delay before giving up the data, so that the output
+         * time may lag for a moment but never runs ahead. */
+        delay_set(&oss_delay, get_delay());
+
+        ring_consume(&oss_ring, written);
+        writer_wake();
+
+        if (written == length)
+            continue;
+
+    WAIT:
+        pthread_mutex_unlock(&oss_mutex);
+        poll_sleep();
+        pthread_mutex_lock(&oss_mutex);
+        stats_count(&oss_stats.wakeups);
+    }
+
+    pthread_mutex_unlock(&oss_mutex);
+    return NULL;
+
+FAILED:
+    ATOMIC_SET(pump_failed, 1);
+    writer_wake();
+    pthread_mutex_unlock(&oss_mutex);
+    return NULL;
+}
+
+static void pump_start(void)
+{
+    AUDDBG("Starting pump.\n");
+    ATOMIC_SET(pump_failed, 0);
+    pthread_create(&pump_thread, NULL, pump, NULL);
+    pthread_cond_wait(&oss_cond, &oss_mutex);
+}
+
+static void pump_stop(void)
+{
+    AUDDBG("Stopping pump.\n");
+    ATOMIC_SET(pump_quit, 1);
+    wake_signal(&pump_pipe);
+    pthread_mutex_unlock(&oss_mutex);
+    pthread_join(pump_thread, NULL);
+    pthread_mutex_lock(&oss_mutex);
+    ATOMIC_SET(pump_quit, 0);
+}
+
+/* The device starts by itself on the first write; we just let the pump go. */
+static void start_playback(void)
+{
+    AUDDBG("Starting playback.\n");
+    delay_set(&oss_delay, 0);
+    ATOMIC_SET(oss_prebuffer, 0);
+    pump_wake();
+}
+
 static bool_t set_format(int format, int rate, int channels)
 {
     int param;
@@ -119,6 +351,15 @@ static int open_device(void)
     return res;
 }
 
+/* The driver counts underruns itself; the counters are reset on every read. */
+static void update_underruns(void)
+{
+    audio_errinfo info;
+
+    if (ioctl(oss_data->fd, SNDCTL_DSP_GETERROR, &info) == 0)
+        oss_stats.underruns += info.play_underruns;
+}
+
 static void close_device(void)
 {
     close(oss_data->fd);
@@ -133,6 +374,8 @@ int oss_open_audio(int aud_format, int rate, int channels)
     int vol_left, vol_right;
     audio_buf_info buf_info;
 
+    pthread_mutex_lock(&oss_mutex);
+
     CHECK_NOISY(oss_data->fd = open_device);
 
     format = oss_convert_aud_format(aud_format);
@@ -147,13 +390,30 @@ int oss_open_audio(int aud_format, int rate, int channels)
         buf_info.fragsize,
         buf_info.bytes);
 
-    oss_time = 0;
-    oss_paused = FALSE;
-    oss_paused_time = 0;
-    oss_delay = oss_bytes_to_frames(buf_info.fragstotal * buf_info.fragsize) * 1000 / oss_data->rate;
+    oss_hw_buffer = buf_info.fragstotal * buf_info.fragsize;
+
+    int total_buffer = aud_get_int(NULL, "output_buffer_size");
+    int hard_buffer = oss_bytes_to_frames(oss_hw_buffer) * 1000 / rate;
+    int soft_buffer = MAX(total_buffer / 2, total_buffer - hard_buffer);
+
+    AUDDBG("Internal OSS buffer size: %dms, software buffer: %dms.\n", hard_buffer, soft_buffer);
+
+    if (!poll_setup())
+        goto FAILED;
+
+    ring_init(&oss_ring, oss_frames_to_bytes((int64_t) soft_buffer * rate / 1000));
+
+    oss_written = 0;
+    oss_prebuffer = 1;
+    oss_paused = 0;
+    oss_paused_delay = 0;
+    oss_draining = 0;
     oss_ioctl_vol = TRUE;
+    delay_set(&oss_delay, 0);
 
-    AUDDBG("Internal OSS buffer size: %dms.\n", oss_delay);
+    stats_reset(&oss_stats, "oss4");
+    update_underruns();
+    oss_stats.underruns = 0;
 
     if (aud_get_bool("oss4", "save_volume"))
     {
@@ -162,10 +422,14 @@ int oss_open_audio(int aud_format, int rate, int channels)
         oss_set_volume(vol_left, vol_right);
     }
 
+    pump_start();
+
+    pthread_mutex_unlock(&oss_mutex);
     return 1;
 
 FAILED:
     close_device();
+    pthread_mutex_unlock(&oss_mutex);
     return 0;
 }
 
@@ -173,26 +437,75 @@ void oss_close_audio(void)
 {
     AUDDBG ("Closing audio.\n");
 
+    pthread_mutex_lock(&oss_mutex);
+    pump_stop();
+
+    update_underruns();
+    stats_dump(&oss_stats);
+
+    ring_free(&oss_ring);
+    poll_cleanup();
     close_device();
+
+    pthread_mutex_unlock(&oss_mutex);
+}
+
+int oss_buffer_free(void)
+{
+    return ring_space(&oss_ring);
 }
 
 void oss_write_audio(void *data, int length)
 {
-    int written = 0, start = 0;
+    if (ATOMIC_GET(oss_draining))
+        ATOMIC_SET(oss_draining, 0);
 
-    while (length > 0)
+    ring_write(&oss_ring, data, length);
+    ATOMIC_SET(oss_written, oss_written + oss_bytes_to_frames(length));
+
+    if (stats_due(&oss_stats))
     {
-        written = write(oss_data->fd, (char *) data + start, length);
+        update_underruns();
+        stats_dump(&oss_stats);
+    }
 
-        if (written < 0)
+    if (!ATOMIC_GET(oss_paused))
+        pump_wake();
+}
+
+static bool_t must_start(void)
+{
+    return ATOMIC_GET(oss_prebuffer) && !ATOMIC_GET(oss_paused);
+}
+
+void oss_period_wait(void)
+{
+    if (ATOMIC_GET(pump_failed))
+    {
+        /* nothing to wait for; just keep the caller from spinning */
+        const struct timespec delay = {.tv_sec = 0, .tv_nsec = 10000000};
+        nanosleep(&delay, NULL);
+        return;
+    }
+
+    while (!ring_space(&oss_ring) && !ATOMIC_GET(pump_failed))
+    {
+        if (must_start())
         {
-            DESCRIBE_ERROR;
-            return;
+            pthread_mutex_lock(&oss_mutex);
+
+            if (must_start() && !ring_space(&oss_ring))
+                start_playback();
+
+            pthread_mutex_unlock(&oss_mutex);
         }
 
-        length -= written;
-        start += written;
-        oss_time += (int64_t) oss_bytes_to_frames(written) * 1000000 / oss_data->rate;
+        ATOMIC_SET(writer_pipe.waiting, 1);
+
+        if (!ring_space(&oss_ring) && !must_start() && !ATOMIC_GET(pump_failed))
+            wake_sleep(&writer_pipe);
+
+        ATOMIC_SET(writer_pipe.waiting, 0);
     }
 }
 
@@ -200,69 +513,110 @@ void oss_drain(void)
 {
     AUDDBG("Drain.\n");
 
-    if (ioctl(oss_data->fd, SNDCTL_DSP_SYNC, NULL) == -1)
-        DESCRIBE_ERROR;
-}
+    pthread_mutex_lock(&oss_mutex);
 
-int oss_buffer_free(void)
-{
-    audio_buf_info buf_info;
+    if (oss_prebuffer)
+        start_playback();
 
-    if (oss_paused)
-        return 0;
+    pthread_mutex_unlock(&oss_mutex);
 
-    CHECK(ioctl, oss_data->fd, SNDCTL_DSP_GETOSPACE, &buf_info);
+    ATOMIC_SET(oss_draining, 1); /* until more data is written */
 
-    return MAX(0, buf_info.fragments - 1) * buf_info.fragsize;
+    while (filled_frames() && !ATOMIC_GET(pump_failed))
+    {
+        ATOMIC_SET(writer_pipe.waiting, 1);
 
-FAILED:
-    return 0;
-}
+        if (filled_frames() && !ATOMIC_GET(pump_failed))
+            wake_sleep(&writer_pipe);
 
-static int real_output_time()
-{
-    int  time = 0;
+        ATOMIC_SET(writer_pipe.waiting, 0);
+    }
+
+    pthread_mutex_lock(&oss_mutex);
+    pump_stop();
+    pthread_mutex_unlock(&oss_mutex);
+
+    if (ioctl(oss_data->fd, SNDCTL_DSP_SYNC, NULL) == -1)
+        DESCRIBE_ERROR;
 
-    time = (oss_time - (int64_t) (oss_delay * 1000)) / 1000;
-    return time;
+    pthread_mutex_lock(&oss_mutex);
+    delay_set(&oss_delay, 0); /* all played */
+    pump_start();
+    pthread_mutex_unlock(&oss_mutex);
 }
 
+/* Lock-free and without ioctls.  The values are read in the reverse of the
+ * order in which they are updated, so that a write or a pump cycle happening
+ * meanwhile can only make the time come out a little early. */
 int oss_output_time(void)
 {
-    int time = 0;
+    int64_t frames = ATOMIC_GET(oss_written);
+    frames -= filled_frames();
 
-    if (oss_paused)
-        time = oss_paused_time;
+    if (ATOMIC_GET(oss_prebuffer) || ATOMIC_GET(oss_paused))
+        frames -= ATOMIC_GET(oss_paused_delay);
     else
-        time = real_output_time();
-    return time;
+        frames -= delay_guess(&oss_delay, oss_data->rate);
+
+    return frames * 1000 / oss_data->rate;
 }
 
 void oss_flush(int time)
 {
     AUDDBG("Flush.\n");
 
+    pthread_mutex_lock(&oss_mutex);
+    pump_stop();
+
     CHECK(ioctl, oss_data->fd, SNDCTL_DSP_RESET, NULL);
 
 FAILED:
-    oss_time = (int64_t) time * 1000;
-    oss_paused_time = time;
+    ring_reset(&oss_ring);
+
+    ATOMIC_SET(oss_written, (int64_t) time * oss_data->rate / 1000);
+    ATOMIC_SET(oss_prebuffer, 1);
+    ATOMIC_SET(oss_paused_delay, 0);
+    delay_set(&oss_delay, 0);
+
+    wake_signal(&writer_pipe); /* interrupt period wait */
+
+    pump_start();
+    pthread_mutex_unlock(&oss_mutex);
 }
 
+/* What is left in the device is silenced on pause and skipped on unpause, so
+ * the delay is taken afresh afterward. */
 void oss_pause(bool_t pause)
 {
     AUDDBG("%sause.\n", pause ? "P" : "Unp");
 
+    pthread_mutex_lock(&oss_mutex);
+
+    if (!oss_prebuffer && pause)
+        ATOMIC_SET(oss_paused_delay, get_delay());
+
+    ATOMIC_SET(oss_paused, pause);
+
+    if (oss_prebuffer)
+        goto DONE;
+
     if (pause)
-    {
-        oss_paused_time = real_output_time();
         CHECK(ioctl, oss_data->fd, SNDCTL_DSP_SILENCE, NULL);
-    }
     else
         CHECK(ioctl, oss_data->fd, SNDCTL_DSP_SKIP, NULL);
 
 FAILED:
-    oss_paused = pause;
+    if (!pause)
+        delay_set(&oss_delay, get_delay());
+
+DONE:
+    if (!pause)
+    {
+        pump_wake();
+        writer_wake(); /* may be waiting to start playback */
+    }
+
+    pthread_mutex_unlock(&oss_mutex);
 }
 
 void oss_get_volume(int *left, int *right)
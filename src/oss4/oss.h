@@ -107,6 +107,7 @@ void oss_close_audio(void);
 void oss_write_audio(void *data, int length);
 void oss_drain(void);
 int oss_buffer_free(void);
+void oss_period_wait(void);
 int oss_output_time(void);
 void oss_flush(int time);
 void oss_pause(bool_t pause);
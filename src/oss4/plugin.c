@@ -122,6 +122,7 @@ AUD_OUTPUT_PLUGIN
     .write_audio = oss_write_audio,
     .drain = oss_drain,
     .buffer_free = oss_buffer_free,
+    .period_wait = oss_period_wait,
     .output_time = oss_output_time,
     .flush = oss_flush,
     .pause = oss_pause,
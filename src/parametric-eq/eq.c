@@ -0,0 +1,366 @@
+/*
+ * Parametric Equalizer Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Each band is a biquad filter (RBJ cookbook designs) in transposed direct
+ * form II.  Audio is copied into a block with the channel count padded to a
+ * multiple of four, so that each filter runs four channels at once.
+ *
+ * When the settings change, the coefficients move linearly to their new values
+ * over RAMP_BLOCKS blocks.  The region of stable coefficients is convex, so
+ * every step on the way is stable too.  Bands with no effect (turned off, or a
+ * peak or shelf at 0 dB) are left out of the cascade entirely.
+ *
+ * After each block, filter state too small to matter is set to zero, so that
+ * it cannot decay into denormal numbers during silence. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE__)
+#include <xmmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "denormal.h"
+#include "eq.h"
+
+#define BLOCK 64        /* frames */
+#define RAMP_BLOCKS 16  /* about 20 ms at 48 kHz */
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+    float b0, b1, b2, a1, a2;
+} Coefs;
+
+static const Coefs identity = {1, 0, 0, 0, 0};
+
+static int channels, rate, lanes;
+static Coefs current[MAX_BANDS], target[MAX_BANDS], step[MAX_BANDS];
+static float preamp_current, preamp_target, preamp_step;
+static int ramp_left, have_settings;
+
+static int run_list[MAX_BANDS], run_count;
+
+static float * state1, * state2; /* MAX_BANDS rows of <lanes> values */
+static float * work;             /* BLOCK frames of <lanes> values */
+
+static int is_identity (const Coefs * c)
+{
+    return ! memcmp (c, & identity, sizeof (Coefs));
+}
+
+static Coefs design (const EQBand * band)
+{
+    float freq = MIN (MAX (band->freq, 1), rate * 0.49f);
+    float q = MAX (band->q, 0.1f);
+
+    if (band->type == TYPE_OFF || ((band->type == TYPE_PEAK || band->type ==
+     TYPE_LOW_SHELF || band->type == TYPE_HIGH_SHELF) && fabsf (band->gain) < 0.01f))
+        return identity;
+
+    double A = pow (10, band->gain / 40);
+    double w = 2 * M_PI * freq / rate;
+    double cw = cos (w), alpha = sin (w) / (2 * q);
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (band->type)
+    {
+    case TYPE_PEAK:
+        b0 = 1 + alpha * A;
+        b1 = -2 * cw;
+        b2 = 1 - alpha * A;
+        a0 = 1 + alpha / A;
+        a1 = -2 * cw;
+        a2 = 1 - alpha / A;
+        break;
+    case TYPE_LOW_SHELF:
+    {
+        double sa = 2 * sqrt (A) * alpha;
+        b0 = A * ((A + 1) - (A - 1) * cw + sa);
+        b1 = 2 * A * ((A - 1) - (A + 1) * cw);
+        b2 = A * ((A + 1) - (A - 1) * cw - sa);
+        a0 = (A + 1) + (A - 1) * cw + sa;
+        a1 = -2 * ((A - 1) + (A + 1) * cw);
+        a2 = (A + 1) + (A - 1) * cw - sa;
+        break;
+    }
+    case TYPE_HIGH_SHELF:
+    {
+        double sa = 2 * sqrt (A) * alpha;
+        b0 = A * ((A + 1) + (A - 1) * cw + sa);
+        b1 = -2 * A * ((A - 1) + (A + 1) * cw);
+        b2 = A * ((A + 1) + (A - 1) * cw - sa);
+        a0 = (A + 1) - (A - 1) * cw + sa;
+        a1 = 2 * ((A - 1) - (A + 1) * cw);
+        a2 = (A + 1) - (A - 1) * cw - sa;
+        break;
+    }
+    case TYPE_LOW_PASS:
+        b0 = b2 = (1 - cw) / 2;
+        b1 = 1 - cw;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    case TYPE_HIGH_PASS:
+        b0 = b2 = (1 + cw) / 2;
+        b1 = -(1 + cw);
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    default: /* TYPE_NOTCH */
+        b0 = b2 = 1;
+        b1 = -2 * cw;
+        a0 = 1 + alpha;
+        a1 = -2 * cw;
+        a2 = 1 - alpha;
+        break;
+    }
+
+    Coefs c = {b0 / a0, b1 / a0, b2 / a0, a1 / a0, a2 / a0};
+    return c;
+}
+
+/* Bands that are and will stay at identity are skipped. */
+static void build_run_list (void)
+{
+    run_count = 0;
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+    {
+        if (is_identity (& current[b]) && is_identity (& target[b]))
+        {
+            /* start from a clean state when it comes back */
+            memset (state1 + b * lanes, 0, sizeof (float) * lanes);
+            memset (state2 + b * lanes, 0, sizeof (float) * lanes);
+        }
+        else
+            run_list[run_count ++] = b;
+    }
+}
+
+void eq_start (int new_channels, int new_rate)
+{
+    channels = new_channels;
+    rate = new_rate;
+    lanes = (channels + 3) & ~3;
+
+    state1 = realloc (state1, sizeof (float) * MAX_BANDS * lanes);
+    state2 = realloc (state2, sizeof (float) * MAX_BANDS * lanes);
+    work = realloc (work, sizeof (float) * BLOCK * lanes);
+
+    memset (work, 0, sizeof (float) * BLOCK * lanes);
+
+    /* the coefficients depend on the rate; jump to the next settings */
+    have_settings = 0;
+    ramp_left = 0;
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+        current[b] = target[b] = identity;
+
+    preamp_current = preamp_target = 1;
+
+    eq_flush ();
+}
+
+void eq_flush (void)
+{
+    memset (state1, 0, sizeof (float) * MAX_BANDS * lanes);
+    memset (state2, 0, sizeof (float) * MAX_BANDS * lanes);
+}
+
+void eq_cleanup (void)
+{
+    free (state1);
+    free (state2);
+    free (work);
+
+    state1 = state2 = work = NULL;
+}
+
+void eq_set_bands (const EQBand * bands, float preamp)
+{
+    for (int b = 0; b < MAX_BANDS; b ++)
+        target[b] = design (& bands[b]);
+
+    preamp_target = pow (10, preamp / 20);
+
+    if (! have_settings)
+    {
+        memcpy (current, target, sizeof current);
+        preamp_current = preamp_target;
+        ramp_left = 0;
+        have_settings = 1;
+    }
+    else
+    {
+        for (int b = 0; b < MAX_BANDS; b ++)
+        {
+            step[b].b0 = (target[b].b0 - current[b].b0) / RAMP_BLOCKS;
+            step[b].b1 = (target[b].b1 - current[b].b1) / RAMP_BLOCKS;
+            step[b].b2 = (target[b].b2 - current[b].b2) / RAMP_BLOCKS;
+            step[b].a1 = (target[b].a1 - current[b].a1) / RAMP_BLOCKS;
+            step[b].a2 = (target[b].a2 - current[b].a2) / RAMP_BLOCKS;
+        }
+
+        preamp_step = (preamp_target - preamp_current) / RAMP_BLOCKS;
+        ramp_left = RAMP_BLOCKS;
+    }
+
+    build_run_list ();
+}
+
+static void advance_ramp (void)
+{
+    if (! ramp_left)
+        return;
+
+    if (-- ramp_left)
+    {
+        for (int i = 0; i < run_count; i ++)
+        {
+            Coefs * c = & current[run_list[i]];
+            const Coefs * s = & step[run_list[i]];
+
+            c->b0 += s->b0;
+            c->b1 += s->b1;
+            c->b2 += s->b2;
+            c->a1 += s->a1;
+            c->a2 += s->a2;
+        }
+
+        preamp_current += preamp_step;
+    }
+    else
+    {
+        /* land exactly, then drop the bands that are now at identity */
+        memcpy (current, target, sizeof current);
+        preamp_current = preamp_target;
+        build_run_list ();
+    }
+}
+
+/* One band over a block, four lanes at a time. */
+static void run_band (const Coefs * c, float * s1, float * s2, int frames)
+{
+#if defined (__SSE__)
+    __m128 b0 = _mm_set1_ps (c->b0), b1 = _mm_set1_ps (c->b1);
+    __m128 b2 = _mm_set1_ps (c->b2), a1 = _mm_set1_ps (c->a1);
+    __m128 a2 = _mm_set1_ps (c->a2), tiny = _mm_set1_ps (DENORMAL_TINY);
+    __m128 sign = _mm_set1_ps (-0.0f);
+
+    for (int l = 0; l < lanes; l += 4)
+    {
+        __m128 v1 = _mm_loadu_ps (s1 + l), v2 = _mm_loadu_ps (s2 + l);
+        float * p = work + l;
+
+        for (int f = 0; f < frames; f ++, p += lanes)
+        {
+            __m128 x = _mm_loadu_ps (p);
+            __m128 y = _mm_add_ps (_mm_mul_ps (b0, x), v1);
+            v1 = _mm_add_ps (_mm_sub_ps (_mm_mul_ps (b1, x), _mm_mul_ps (a1, y)), v2);
+            v2 = _mm_sub_ps (_mm_mul_ps (b2, x), _mm_mul_ps (a2, y));
+            _mm_storeu_ps (p, y);
+        }
+
+        v1 = _mm_and_ps (v1, _mm_cmpge_ps (_mm_andnot_ps (sign, v1), tiny));
+        v2 = _mm_and_ps (v2, _mm_cmpge_ps (_mm_andnot_ps (sign, v2), tiny));
+        _mm_storeu_ps (s1 + l, v1);
+        _mm_storeu_ps (s2 + l, v2);
+    }
+#elif defined (HAVE_NEON)
+    float32x4_t tiny = vdupq_n_f32 (DENORMAL_TINY);
+
+    for (int l = 0; l < lanes; l += 4)
+    {
+        float32x4_t v1 = vld1q_f32 (s1 + l), v2 = vld1q_f32 (s2 + l);
+        float * p = work + l;
+
+        for (int f = 0; f < frames; f ++, p += lanes)
+        {
+            float32x4_t x = vld1q_f32 (p);
+            float32x4_t y = vmlaq_n_f32 (v1, x, c->b0);
+            v1 = vmlsq_n_f32 (vmlaq_n_f32 (v2, x, c->b1), y, c->a1);
+            v2 = vmlsq_n_f32 (vmulq_n_f32 (x, c->b2), y, c->a2);
+            vst1q_f32 (p, y);
+        }
+
+        v1 = vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (v1), vcageq_f32 (v1, tiny)));
+        v2 = vreinterpretq_f32_u32 (vandq_u32 (vreinterpretq_u32_f32 (v2), vcageq_f32 (v2, tiny)));
+        vst1q_f32 (s1 + l, v1);
+        vst1q_f32 (s2 + l, v2);
+    }
+#else
+    for (int l = 0; l < lanes; l ++)
+    {
+        float v1 = s1[l], v2 = s2[l];
+        float * p = work + l;
+
+        for (int f = 0; f < frames; f ++, p += lanes)
+        {
+            float x = * p;
+            float y = c->b0 * x + v1;
+            v1 = c->b1 * x - c->a1 * y + v2;
+            v2 = c->b2 * x - c->a2 * y;
+            * p = y;
+        }
+
+        s1[l] = denormal_guard (v1);
+        s2[l] = denormal_guard (v2);
+    }
+#endif
+}
+
+void eq_process (float * data, int frames)
+{
+    DenormalState fpu = denormal_disable ();
+
+    while (frames > 0)
+    {
+        int block = MIN (frames, BLOCK);
+        float gain = preamp_current;
+
+        for (int f = 0; f < block; f ++)
+        for (int c = 0; c < channels; c ++)
+            work[f * lanes + c] = data[f * channels + c] * gain;
+
+        for (int i = 0; i < run_count; i ++)
+        {
+            int b = run_list[i];
+            run_band (& current[b], state1 + b * lanes, state2 + b * lanes, block);
+        }
+
+        for (int f = 0; f < block; f ++)
+        for (int c = 0; c < channels; c ++)
+            data[f * channels + c] = work[f * lanes + c];
+
+        advance_ramp ();
+
+        data += block * channels;
+        frames -= block;
+    }
+
+    denormal_restore (fpu);
+}
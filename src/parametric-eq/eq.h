@@ -0,0 +1,53 @@
+/*
+ * Parametric Equalizer Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef PARAMETRIC_EQ_H
+#define PARAMETRIC_EQ_H
+
+#define MAX_BANDS 31
+
+enum {
+    TYPE_OFF,
+    TYPE_PEAK,
+    TYPE_LOW_SHELF,
+    TYPE_HIGH_SHELF,
+    TYPE_LOW_PASS,
+    TYPE_HIGH_PASS,
+    TYPE_NOTCH
+};
+
+typedef struct {
+    int type;
+    float freq, gain, q; /* Hz, dB, quality */
+} EQBand;
+
+/* eq.c */
+
+void eq_start (int channels, int rate);
+void eq_flush (void);
+void eq_cleanup (void);
+
+/* Sets new parameters for all MAX_BANDS bands.  After the first call, the
+ * filters move to the new settings gradually. */
+void eq_set_bands (const EQBand * bands, float preamp);
+
+/* Processes interleaved frames in place. */
+void eq_process (float * data, int frames);
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ * Parametric Equalizer Plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include <stdlib.h>
+
+#include <audacious/i18n.h>
+#include <audacious/misc.h>
+#include <audacious/plugin.h>
+#include <audacious/preferences.h>
+
+#include "config.h"
+#include "eq.h"
+
+#define CFGSECT "parametric-eq"
+
+/* By default the bands sit on the ISO third-octave centers, as peaks at 0 dB
+ * (which cost nothing until they are changed). */
+static const int default_freqs[MAX_BANDS] = {20, 25, 31, 40, 50, 63, 80, 100,
+ 125, 160, 200, 250, 315, 400, 500, 630, 800, 1000, 1250, 1600, 2000, 2500,
+ 3150, 4000, 5000, 6300, 8000, 10000, 12500, 16000, 20000};
+
+static const char * const eq_defaults[] = {
+ "preamp", "0",
+ NULL};
+
+static volatile bool_t changed;
+
+static void bands_changed (void)
+{
+    changed = TRUE;
+}
+
+static void read_bands (void)
+{
+    EQBand bands[MAX_BANDS];
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+    {
+        SPRINTF (type, "band%d_type", b + 1);
+        SPRINTF (freq, "band%d_freq", b + 1);
+        SPRINTF (gain, "band%d_gain", b + 1);
+        SPRINTF (q, "band%d_q", b + 1);
+
+        bands[b].type = aud_get_int (CFGSECT, type);
+        bands[b].freq = aud_get_int (CFGSECT, freq);
+        bands[b].gain = aud_get_double (CFGSECT, gain);
+        bands[b].q = aud_get_double (CFGSECT, q);
+    }
+
+    changed = FALSE;
+    eq_set_bands (bands, aud_get_double (CFGSECT, "preamp"));
+}
+
+static bool_t eq_init (void)
+{
+    aud_config_set_defaults (CFGSECT, eq_defaults);
+
+    for (int b = 0; b < MAX_BANDS; b ++)
+    {
+        SPRINTF (type, "band%d_type", b + 1);
+        SPRINTF (freq, "band%d_freq", b + 1);
+        SPRINTF (gain, "band%d_gain", b + 1);
+        SPRINTF (q, "band%d_q", b + 1);
+        SPRINTF (freq_value, "%d", default_freqs[b]);
+
+        const char * const defaults[] = {
+         type, "1", /* TYPE_PEAK */
+         freq, freq_value,
+         gain, "0",
+         q, "4.3", /* one third of an octave */
+         NULL};
+
+        aud_config_set_defaults (CFGSECT, defaults);
+    }
+
+    return TRUE;
+}
+
+static int current_channels;
+
+static void eq_plugin_start (int * channels, int * rate)
+{
+    current_channels = * channels;
+    eq_start (* channels, * rate);
+    read_bands ();
+}
+
+static void eq_plugin_process (float * * data, int * samples)
+{
+    if (changed)
+        read_bands ();
+
+    eq_process (* data, * samples / current_channels);
+}
+
+static const char eq_about[] =
+ N_("Parametric Equalizer Plugin for Audacious\n"
+    "Copyright 2013 Audacious developers");
+
+static const ComboBoxElements type_list[] = {
+ {"0", N_("Off")}, /* TYPE_OFF */
+ {"1", N_("Peak")}, /* TYPE_PEAK */
+ {"2", N_("Low shelf")}, /* TYPE_LOW_SHELF */
+ {"3", N_("High shelf")}, /* TYPE_HIGH_SHELF */
+ {"4", N_("Low pass")}, /* TYPE_LOW_PASS */
+ {"5", N_("High pass")}, /* TYPE_HIGH_PASS */
+ {"6", N_("Notch")}}; /* TYPE_NOTCH */
+
+/* one row per band: type, frequency, gain, Q */
+#define BAND_WIDGETS(n) \
+static const PreferencesWidget band##n##_widgets[] = { \
+ {WIDGET_COMBO_BOX, #n, \
+  .cfg_type = VALUE_STRING, .csect = CFGSECT, .cname = "band" #n "_type", \
+  .callback = bands_changed, \
+  .data = {.combo = {type_list, sizeof type_list / sizeof type_list[0]}}}, \
+ {WIDGET_SPIN_BTN, NULL, \
+  .cfg_type = VALUE_INT, .csect = CFGSECT, .cname = "band" #n "_freq", \
+  .callback = bands_changed, \
+  .data = {.spin_btn = {10, 22000, 1, N_("Hz")}}}, \
+ {WIDGET_SPIN_BTN, NULL, \
+  .cfg_type = VALUE_FLOAT, .csect = CFGSECT, .cname = "band" #n "_gain", \
+  .callback = bands_changed, \
+  .data = {.spin_btn = {-24, 24, 0.5, N_("dB")}}}, \
+ {WIDGET_SPIN_BTN, N_("Q:"), \
+  .cfg_type = VALUE_FLOAT, .csect = CFGSECT, .cname = "band" #n "_q", \
+  .callback = bands_changed, \
+  .data = {.spin_btn = {0.1, 30, 0.1}}}};
+
+#define BAND_ROW(n) \
+ {WIDGET_BOX, .data = {.box = {band##n##_widgets, \
+  sizeof band##n##_widgets / sizeof band##n##_widgets[0], .horizontal = TRUE}}}
+
+BAND_WIDGETS (1) BAND_WIDGETS (2) BAND_WIDGETS (3) BAND_WIDGETS (4)
+BAND_WIDGETS (5) BAND_WIDGETS (6) BAND_WIDGETS (7) BAND_WIDGETS (8)
+BAND_WIDGETS (9) BAND_WIDGETS (10) BAND_WIDGETS (11) BAND_WIDGETS (12)
+BAND_WIDGETS (13) BAND_WIDGETS (14) BAND_WIDGETS (15) BAND_WIDGETS (16)
+BAND_WIDGETS (17) BAND_WIDGETS (18) BAND_WIDGETS (19) BAND_WIDGETS (20)
+BAND_WIDGETS (21) BAND_WIDGETS (22) BAND_WIDGETS (23) BAND_WIDGETS (24)
+BAND_WIDGETS (25) BAND_WIDGETS (26) BAND_WIDGETS (27) BAND_WIDGETS (28)
+BAND_WIDGETS (29) BAND_WIDGETS (30) BAND_WIDGETS (31)
+
+static const PreferencesWidget eq_widgets[] = {
+ {WIDGET_LABEL, N_("<b>Parametric Equalizer</b>")},
+ {WIDGET_SPIN_BTN, N_("Preamp:"),
+  .cfg_type = VALUE_FLOAT, .csect = CFGSECT, .cname = "preamp",
+  .callback = bands_changed,
+  .data = {.spin_btn = {-24, 24, 0.5, N_("dB")}}},
+ {WIDGET_LABEL, N_("<b>Bands</b>")},
+ BAND_ROW (1), BAND_ROW (2), BAND_ROW (3), BAND_ROW (4), BAND_ROW (5),
+ BAND_ROW (6), BAND_ROW (7), BAND_ROW (8), BAND_ROW (9), BAND_ROW (10),
+ BAND_ROW (11), BAND_ROW (12), BAND_ROW (13), BAND_ROW (14), BAND_ROW (15),
+ BAND_ROW (16), BAND_ROW (17), BAND_ROW (18), BAND_ROW (19), BAND_ROW (20),
+ BAND_ROW (21), BAND_ROW (22), BAND_ROW (23), BAND_ROW (24), BAND_ROW (25),
+ BAND_ROW (26), BAND_ROW (27), BAND_ROW (28), BAND_ROW (29), BAND_ROW (30),
+ BAND_ROW (31)};
+
+static const PluginPreferences eq_prefs = {
+ .widgets = eq_widgets,
+ .n_widgets = sizeof eq_widgets / sizeof eq_widgets[0]};
+
+AUD_EFFECT_PLUGIN
+(
+    .name = N_("Parametric Equalizer"),
+    .domain = PACKAGE,
+    .about_text = eq_about,
+    .prefs = & eq_prefs,
+    .init = eq_init,
+    .cleanup = eq_cleanup,
+    .start = eq_plugin_start,
+    .process = eq_plugin_process,
+    .flush = eq_flush,
+    .finish = eq_plugin_process,
+    .preserves_format = TRUE
+)
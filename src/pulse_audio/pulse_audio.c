@@ -33,6 +33,10 @@
 #include <audacious/misc.h>
 #include <audacious/plugin.h>
 #include <audacious/i18n.h>
+#include <audacious/preferences.h>
+
+#include "outstats.h"
+#include "ring.h"
 
 #define ERROR(...) do {fprintf (stderr, "pulseaudio: " __VA_ARGS__); putchar ('\n');} while (0)
 
@@ -43,15 +47,35 @@ static pa_threaded_mainloop *mainloop = NULL;
 static pa_cvolume volume;
 static int volume_valid = 0;
 
-static int do_trigger = 0;
-static int64_t written;
+/* The server asks for data in stream_request_cb.  What it asked for and did
+ * not get (wanted) is all the core is offered to write; the writer copies that
+ * straight from the core's buffer into the server's memory, so in the steady
+ * state each byte is copied once.  The ring only holds what the server could
+ * not take at once; it goes first at the next request, which is rendered
+ * straight into the server's memory as well. */
+static Ring ring;
+static int wanted; /* bytes */
+static char starved, draining;
+
+static int64_t played; /* bytes handed to the server */
 static int flush_time;
-static int bytes_per_second;
+static int bytes_per_second, frame_size;
 
 static int connected = 0;
 
 static pa_time_event *volume_time_event = NULL;
 
+static OutputStats pulse_stats;
+
+enum {PROFILE_DEFAULT, PROFILE_LOW_LATENCY, PROFILE_POWER_SAVING};
+
+#define POWER_SAVING_BUFFER 2000 /* milliseconds */
+
+static const char * const pulse_defaults[] = {
+ "profile", "0", /* PROFILE_DEFAULT */
+ "latency", "20",
+ NULL};
+
 #define CHECK_DEAD_GOTO(label, warn) do { \
 if (!mainloop || \
     !context || pa_context_get_state(context) != PA_CONTEXT_READY || \
@@ -149,18 +173,129 @@ static void context_success_cb(pa_context *c, int success, void *userdata) {
     pa_threaded_mainloop_signal(mainloop, 0);
 }
 
+/* Called with the main loop locked. */
+static void fill_stream(void) {
+    size_t want = pa_stream_writable_size(stream);
+
+    if (want == (size_t) -1) {
+        AUDDBG("pa_stream_writable_size() failed: %s", pa_strerror(pa_context_errno(context)));
+        return;
+    }
+
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(stream);
+    if (attr)
+        stats_fill(&pulse_stats.device, (int64_t) attr->tlength - want, attr->tlength);
+
+    while (want >= (size_t) frame_size) {
+        int filled = ring_filled(&ring);
+
+        if (!filled) {
+            /* less than one request's worth left in the server while playing */
+            const pa_timing_info *timing = pa_stream_get_timing_info(stream);
+            if (attr && attr->tlength - want < attr->minreq && timing &&
+             timing->playing && !starved && !draining) {
+                stats_count(&pulse_stats.starvations);
+                starved = 1;
+            }
+
+            /* let the writer know, then look again in case it just wrote */
+            ATOMIC_SET(wanted, (int) (want - want % frame_size));
+
+            if (ring_filled(&ring))
+                continue;
+
+            return;
+        }
+
+        void *buf = NULL;
+        size_t size = MIN(want, (size_t) filled);
+
+        if (pa_stream_begin_write(stream, &buf, &size) < 0 || !buf) {
+            AUDDBG("pa_stream_begin_write() failed: %s", pa_strerror(pa_context_errno(context)));
+            return;
+        }
+
+        size = MIN(size, (size_t) filled);
+        size -= size % frame_size;
+
+        if (!size) {
+            pa_stream_cancel_write(stream);
+            break;
+        }
+
+        ring_read(&ring, buf, size);
+
+        int64_t start = stats_now();
+        int error = pa_stream_write(stream, buf, size, NULL, 0, PA_SEEK_RELATIVE);
+        stats_write_done(&pulse_stats, start);
+
+        if (error < 0) {
+            AUDDBG("pa_stream_write() failed: %s", pa_strerror(pa_context_errno(context)));
+            return;
+        }
+
+        played += size;
+        want -= size;
+        starved = 0;
+    }
+
+    ATOMIC_SET(wanted, 0);
+}
+
 static void stream_request_cb(pa_stream *s, size_t length, void *userdata) {
     assert(s);
 
+    stats_count(&pulse_stats.wakeups);
+    fill_stream();
     pa_threaded_mainloop_signal(mainloop, 0);
 }
 
+static void stream_underflow_cb(pa_stream *s, void *userdata) {
+    assert(s);
+
+    stats_count(&pulse_stats.underruns);
+}
+
 static void stream_latency_update_cb(pa_stream *s, void *userdata) {
     assert(s);
 
     pa_threaded_mainloop_signal(mainloop, 0);
 }
 
+/* Fills in the server buffer for the chosen profile; returns the size of our
+ * own ring in milliseconds. */
+static int get_buffer_attr(const pa_sample_spec *ss, pa_buffer_attr *attr, pa_stream_flags_t *flags) {
+    int aud_buffer = aud_get_int(NULL, "output_buffer_size");
+    int latency = aud_get_int("pulse_audio", "latency");
+    size_t buffer_size = pa_usec_to_bytes(aud_buffer, ss) * 1000;
+
+    *attr = (pa_buffer_attr) {(uint32_t) -1, buffer_size, (uint32_t) -1, (uint32_t) -1, buffer_size};
+
+    switch (aud_get_int("pulse_audio", "profile")) {
+    case PROFILE_LOW_LATENCY:
+        /* a short server buffer, topped up four times over, and started once
+         * half full */
+        attr->tlength = pa_usec_to_bytes((pa_usec_t) CLAMP(latency, 1, 1000) * 1000, ss);
+        attr->minreq = attr->tlength / 4;
+        attr->prebuf = attr->tlength / 2;
+        attr->fragsize = (uint32_t) -1;
+        *flags |= PA_STREAM_ADJUST_LATENCY;
+        return aud_buffer;
+
+    case PROFILE_POWER_SAVING:
+        /* a long server buffer, refilled only when half empty; the ring must
+         * hold at least that much for one request to be met at once */
+        aud_buffer = MAX(aud_buffer, POWER_SAVING_BUFFER);
+        attr->tlength = pa_usec_to_bytes((pa_usec_t) aud_buffer * 1000, ss);
+        attr->minreq = attr->tlength / 2;
+        attr->fragsize = (uint32_t) -1;
+        return aud_buffer;
+
+    default:
+        return aud_buffer;
+    }
+}
+
 static void pulse_get_volume (int * l, int * r)
 {
     * l = * r = 0;
@@ -263,48 +398,29 @@ fail:
     pa_threaded_mainloop_unlock(mainloop);
 }
 
+/* Rather than filling the ring (which would cost a second copy), the core
+ * waits until the server asks for more. */
 static int pulse_free(void) {
-    size_t l = 0;
-    pa_operation *o = NULL;
-
     CHECK_CONNECTED(0);
 
-    pa_threaded_mainloop_lock(mainloop);
-    CHECK_DEAD_GOTO(fail, 1);
-
-    if ((l = pa_stream_writable_size(stream)) == (size_t) -1) {
-        AUDDBG("pa_stream_writable_size() failed: %s", pa_strerror(pa_context_errno(context)));
-        l = 0;
-        goto fail;
-    }
+    return MIN(ATOMIC_GET(wanted), ring_space(&ring));
+}
 
-    /* If this function is called twice with no pulse_write() call in
-     * between this means we should trigger the playback */
-    if (do_trigger) {
-        int success = 0;
+static void pulse_period_wait(void) {
+    CHECK_CONNECTED();
 
-        if (!(o = pa_stream_trigger(stream, stream_success_cb, &success))) {
-            AUDDBG("pa_stream_trigger() failed: %s", pa_strerror(pa_context_errno(context)));
-            goto fail;
-        }
+    if (pulse_free())
+        return;
 
-        while (pa_operation_get_state(o) != PA_OPERATION_DONE) {
-            CHECK_DEAD_GOTO(fail, 1);
-            pa_threaded_mainloop_wait(mainloop);
-        }
+    pa_threaded_mainloop_lock(mainloop);
 
-        if (!success)
-            AUDDBG("pa_stream_trigger() failed: %s", pa_strerror(pa_context_errno(context)));
+    while (!pulse_free()) {
+        CHECK_DEAD_GOTO(fail, 1);
+        pa_threaded_mainloop_wait(mainloop);
     }
 
 fail:
-    if (o)
-        pa_operation_unref(o);
-
     pa_threaded_mainloop_unlock(mainloop);
-
-    do_trigger = !!l;
-    return (int) l;
 }
 
 static int pulse_get_output_time (void)
@@ -315,7 +431,7 @@ static int pulse_get_output_time (void)
 
     pa_threaded_mainloop_lock(mainloop);
 
-    time = written * (int64_t) 1000 / bytes_per_second;
+    time = played * 1000 / bytes_per_second;
 
     pa_usec_t usec;
     int neg;
@@ -340,6 +456,17 @@ static void pulse_drain(void) {
     CHECK_CONNECTED();
 
     pa_threaded_mainloop_lock(mainloop);
+    draining = 1;
+
+    /* first hand over whatever is left in the ring */
+    while (ring_filled(&ring)) {
+        CHECK_DEAD_GOTO(fail, 0);
+        fill_stream();
+
+        if (ring_filled(&ring))
+            pa_threaded_mainloop_wait(mainloop);
+    }
+
     CHECK_DEAD_GOTO(fail, 0);
 
     if (!(o = pa_stream_drain(stream, stream_success_cb, &success))) {
@@ -359,6 +486,7 @@ fail:
     if (o)
         pa_operation_unref(o);
 
+    draining = 0;
     pa_threaded_mainloop_unlock(mainloop);
 }
 
@@ -371,9 +499,15 @@ static void pulse_flush(int time) {
     pa_threaded_mainloop_lock(mainloop);
     CHECK_DEAD_GOTO(fail, 1);
 
-    written = time * (int64_t) bytes_per_second / 1000;
+    ring_reset(&ring);
+    ATOMIC_SET(wanted, 0);
+    starved = 1;
+
+    played = time * (int64_t) bytes_per_second / 1000;
     flush_time = time;
 
+    pa_threaded_mainloop_signal(mainloop, 0); /* wake up period wait */
+
     if (!(o = pa_stream_flush(stream, stream_success_cb, &success))) {
         AUDDBG("pa_stream_flush() failed: %s", pa_strerror(pa_context_errno(context)));
         goto fail;
@@ -387,6 +521,10 @@ static void pulse_flush(int time) {
     if (!success)
         AUDDBG("pa_stream_flush() failed: %s", pa_strerror(pa_context_errno(context)));
 
+    /* the server may not ask again by itself */
+    fill_stream();
+    pa_threaded_mainloop_signal(mainloop, 0);
+
 fail:
     if (o)
         pa_operation_unref(o);
@@ -394,43 +532,101 @@ fail:
     pa_threaded_mainloop_unlock(mainloop);
 }
 
-static void pulse_write(void* ptr, int length) {
-    int writeoffs, remain, writable;
+/* Called with the main loop locked and the ring empty.  Returns how much of
+ * <data> the server took. */
+static int write_direct(const void *data, int length) {
+    size_t want = pa_stream_writable_size(stream);
 
-    CHECK_CONNECTED();
+    if (want == (size_t) -1) {
+        AUDDBG("pa_stream_writable_size() failed: %s", pa_strerror(pa_context_errno(context)));
+        return 0;
+    }
 
-    pa_threaded_mainloop_lock(mainloop);
-    CHECK_DEAD_GOTO(fail, 1);
+    void *buf = NULL;
+    size_t size = MIN(want, (size_t) length);
+    size -= size % frame_size;
 
-    /* break large fragments into smaller fragments. --nenolod */
-    for (writeoffs = 0, remain = length;
-         writeoffs < length;
-         writeoffs += writable, remain -= writable)
-    {
-         void * pptr = (char *) ptr + writeoffs;
+    if (!size)
+        return 0;
+
+    if (pa_stream_begin_write(stream, &buf, &size) < 0 || !buf) {
+        AUDDBG("pa_stream_begin_write() failed: %s", pa_strerror(pa_context_errno(context)));
+        return 0;
+    }
+
+    size = MIN(size, (size_t) length);
+    size -= size % frame_size;
 
-         writable = length - writeoffs;
-         size_t fragsize = pa_stream_writable_size(stream);
+    if (!size) {
+        pa_stream_cancel_write(stream);
+        return 0;
+    }
+
+    memcpy(buf, data, size);
 
-         /* don't write more than what PA is willing to handle right now. */
-         if (writable > fragsize)
-             writable = fragsize;
+    int64_t start = stats_now();
+    int error = pa_stream_write(stream, buf, size, NULL, 0, PA_SEEK_RELATIVE);
+    stats_write_done(&pulse_stats, start);
 
-         if (pa_stream_write(stream, pptr, writable, NULL, PA_SEEK_RELATIVE, 0) < 0) {
-             AUDDBG("pa_stream_write() failed: %s", pa_strerror(pa_context_errno(context)));
-             goto fail;
-         }
+    if (error < 0) {
+        AUDDBG("pa_stream_write() failed: %s", pa_strerror(pa_context_errno(context)));
+        return 0;
     }
 
-    do_trigger = 0;
-    written += length;
+    played += size;
+    starved = 0;
+
+    want -= size;
+    ATOMIC_SET(wanted, (int) (want - want % frame_size));
+
+    return size;
+}
+
+/* The server asked for data we did not have; it will not ask again until it
+ * gets some.  What is in the ring goes first; returns how much of <data>
+ * followed it. */
+static int push_pending(const void *data, int length) {
+    int done = 0;
+
+    pa_threaded_mainloop_lock(mainloop);
+    CHECK_DEAD_GOTO(fail, 1);
+
+    fill_stream();
+
+    /* still wanted means the ring ran dry */
+    if (ATOMIC_GET(wanted))
+        done = write_direct(data, length);
 
 fail:
     pa_threaded_mainloop_unlock(mainloop);
+    return done;
+}
+
+static void pulse_write(void* ptr, int length) {
+    CHECK_CONNECTED();
+
+    assert(length <= ring_space(&ring));
+
+    if (ATOMIC_GET(wanted)) {
+        int done = push_pending(ptr, length);
+        ptr = (char *) ptr + done;
+        length -= done;
+    }
+
+    ring_write(&ring, ptr, length);
+
+    /* the server may have run dry meanwhile */
+    if (ATOMIC_GET(wanted))
+        push_pending(NULL, 0);
+
+    stats_poll(&pulse_stats);
 }
 
 static void pulse_close(void)
 {
+    if (connected)
+        stats_dump(&pulse_stats);
+
     connected = 0;
 
     if (mainloop)
@@ -455,6 +651,8 @@ static void pulse_close(void)
 
     volume_time_event = NULL;
     volume_valid = 0;
+
+    ring_free(&ring);
 }
 
 static int pulse_open(int fmt, int rate, int nch) {
@@ -550,15 +748,25 @@ static int pulse_open(int fmt, int rate, int nch) {
     pa_stream_set_state_callback(stream, stream_state_cb, NULL);
     pa_stream_set_write_callback(stream, stream_request_cb, NULL);
     pa_stream_set_latency_update_callback(stream, stream_latency_update_cb, NULL);
+    pa_stream_set_underflow_callback(stream, stream_underflow_cb, NULL);
 
     /* Connect stream with sink and default volume */
     /* Buffer struct */
 
-    int aud_buffer = aud_get_int(NULL, "output_buffer_size");
-    size_t buffer_size = pa_usec_to_bytes(aud_buffer, &ss) * 1000;
-    pa_buffer_attr buffer = {(uint32_t) -1, buffer_size, (uint32_t) -1, (uint32_t) -1, buffer_size};
+    pa_stream_flags_t flags = PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_AUTO_TIMING_UPDATE;
+    pa_buffer_attr buffer;
+    int ring_ms = get_buffer_attr(&ss, &buffer, &flags);
+
+    played = 0;
+    flush_time = 0;
+    bytes_per_second = FMT_SIZEOF (fmt) * nch * rate;
+    frame_size = FMT_SIZEOF (fmt) * nch;
+    starved = 1;
+    draining = 0;
+    wanted = 0;
+    ring_init(&ring, (int64_t) ring_ms * rate / 1000 * frame_size);
 
-    if (pa_stream_connect_playback(stream, NULL, &buffer, PA_STREAM_INTERPOLATE_TIMING|PA_STREAM_AUTO_TIMING_UPDATE, NULL, NULL) < 0) {
+    if (pa_stream_connect_playback(stream, NULL, &buffer, flags, NULL, NULL) < 0) {
         ERROR ("Failed to connect stream: %s", pa_strerror(pa_context_errno(context)));
         goto unlock_and_fail;
     }
@@ -608,12 +816,14 @@ static int pulse_open(int fmt, int rate, int nch) {
     }
     pa_operation_unref(o);
 
-    do_trigger = 0;
-    written = 0;
-    flush_time = 0;
-    bytes_per_second = FMT_SIZEOF (fmt) * nch * rate;
+    const pa_buffer_attr *attr = pa_stream_get_buffer_attr(stream);
+    if (attr)
+        AUDDBG("Buffer: tlength %u, minreq %u, prebuf %u bytes.\n",
+         attr->tlength, attr->minreq, attr->prebuf);
+
     connected = 1;
     volume_time_event = NULL;
+    stats_reset(&pulse_stats, "pulseaudio");
 
     pa_threaded_mainloop_unlock(mainloop);
 
@@ -635,6 +845,8 @@ fail:
 
 static bool_t pulse_init (void)
 {
+    aud_config_set_defaults ("pulse_audio", pulse_defaults);
+
     if (! pulse_open (FMT_S16_NE, 44100, 2))
         return FALSE;
 
@@ -659,11 +871,30 @@ static const char pulse_about[] =
     "Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,\n"
     "USA.");
 
+static const ComboBoxElements profile_list[] = {
+ {"0", N_("Default")}, /* PROFILE_DEFAULT */
+ {"1", N_("Low latency")}, /* PROFILE_LOW_LATENCY */
+ {"2", N_("Power saving")}}; /* PROFILE_POWER_SAVING */
+
+static const PreferencesWidget pulse_widgets[] = {
+ {WIDGET_COMBO_BOX, N_("Buffering:"),
+  .cfg_type = VALUE_STRING, .csect = "pulse_audio", .cname = "profile",
+  .data = {.combo = {profile_list, sizeof profile_list / sizeof profile_list[0]}}},
+ {WIDGET_SPIN_BTN, N_("Low latency target:"),
+  .cfg_type = VALUE_INT, .csect = "pulse_audio", .cname = "latency",
+  .data = {.spin_btn = {1, 1000, 1, N_("ms")}}},
+ {WIDGET_LABEL, N_("Changes take effect when the next song starts.")}};
+
+static const PluginPreferences pulse_prefs = {
+ .widgets = pulse_widgets,
+ .n_widgets = sizeof pulse_widgets / sizeof pulse_widgets[0]};
+
 AUD_OUTPUT_PLUGIN
 (
     .name = N_("PulseAudio Output"),
     .domain = PACKAGE,
     .about_text = pulse_about,
+    .prefs = & pulse_prefs,
     .probe_priority = 8,
     .init = pulse_init,
     .get_volume = pulse_get_volume,
@@ -674,6 +905,7 @@ AUD_OUTPUT_PLUGIN
     .flush = pulse_flush,
     .pause = pulse_pause,
     .buffer_free = pulse_free,
+    .period_wait = pulse_period_wait,
     .drain = pulse_drain,
     .output_time = pulse_get_output_time
 )
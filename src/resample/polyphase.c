@@ -0,0 +1,418 @@
+/*
+ * Polyphase Resampler for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* The input is (conceptually) upsampled by a factor U, lowpass filtered, and
+ * downsampled by a factor D, where U/D is the conversion ratio reduced to
+ * lowest terms.  Only the filter taps which line up with real input samples are
+ * ever evaluated, so each output sample is a dot product of TAPS input samples
+ * with one of U "phases" of the filter.  The phases are computed once per ratio
+ * and cached, so that switching between songs of the usual rates costs
+ * nothing. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+#if defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON_KERNEL
+#endif
+
+#include "polyphase.h"
+
+#define MAX_FACTOR 512  /* largest U or D we are willing to build a table for */
+#define BASE_TAPS 64    /* taps per phase, scaled up when downsampling */
+#define CUTOFF 0.95     /* relative to the lower of the two Nyquist rates */
+#define KAISER_BETA 9.6 /* about 95 dB stopband attenuation */
+#define MAX_TABLES 4
+
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+typedef float (* DotFunc) (const float * a, const float * b, int n);
+
+typedef struct {
+    int up, down, taps;
+    float * coefs; /* <up> phases of <taps> coefficients, each in reverse */
+    int users;
+} CoefTable;
+
+struct Polyphase {
+    int channels;
+    CoefTable * table;
+    DotFunc dot;
+    int phase;      /* current filter phase, 0 to up - 1 */
+    int pos;        /* index of the newest frame under the filter */
+    int len, size;  /* frames held in each history buffer */
+    float * * hist; /* one history buffer per channel */
+};
+
+static CoefTable tables[MAX_TABLES];
+static int tables_used;
+
+/* ---- dot product kernels; n is always a multiple of 16 ---- */
+
+#if ! defined (__SSE2__) && ! defined (HAVE_NEON_KERNEL)
+static float dot_generic (const float * a, const float * b, int n)
+{
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    for (int i = 0; i < n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+
+    return (s0 + s1) + (s2 + s3);
+}
+#endif
+
+#ifdef __SSE2__
+static float dot_sse2 (const float * a, const float * b, int n)
+{
+    __m128 s0 = _mm_setzero_ps ();
+    __m128 s1 = _mm_setzero_ps ();
+
+    for (int i = 0; i < n; i += 8)
+    {
+        s0 = _mm_add_ps (s0, _mm_mul_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i)));
+        s1 = _mm_add_ps (s1, _mm_mul_ps (_mm_loadu_ps (a + i + 4), _mm_loadu_ps (b + i + 4)));
+    }
+
+    s0 = _mm_add_ps (s0, s1);
+    s0 = _mm_add_ps (s0, _mm_movehl_ps (s0, s0));
+    s0 = _mm_add_ss (s0, _mm_shuffle_ps (s0, s0, 1));
+
+    return _mm_cvtss_f32 (s0);
+}
+#endif
+
+#ifdef HAVE_AVX2_KERNEL
+__attribute__ ((target ("avx2")))
+static float dot_avx2 (const float * a, const float * b, int n)
+{
+    __m256 s0 = _mm256_setzero_ps ();
+    __m256 s1 = _mm256_setzero_ps ();
+
+    for (int i = 0; i < n; i += 16)
+    {
+        s0 = _mm256_add_ps (s0, _mm256_mul_ps (_mm256_loadu_ps (a + i), _mm256_loadu_ps (b + i)));
+        s1 = _mm256_add_ps (s1, _mm256_mul_ps (_mm256_loadu_ps (a + i + 8), _mm256_loadu_ps (b + i + 8)));
+    }
+
+    s0 = _mm256_add_ps (s0, s1);
+    __m128 s = _mm_add_ps (_mm256_castps256_ps128 (s0), _mm256_extractf128_ps (s0, 1));
+    s = _mm_add_ps (s, _mm_movehl_ps (s, s));
+    s = _mm_add_ss (s, _mm_shuffle_ps (s, s, 1));
+
+    return _mm_cvtss_f32 (s);
+}
+#endif
+
+#ifdef HAVE_NEON_KERNEL
+static float dot_neon (const float * a, const float * b, int n)
+{
+    float32x4_t s0 = vdupq_n_f32 (0);
+    float32x4_t s1 = vdupq_n_f32 (0);
+
+    for (int i = 0; i < n; i += 8)
+    {
+        s0 = vmlaq_f32 (s0, vld1q_f32 (a + i), vld1q_f32 (b + i));
+        s1 = vmlaq_f32 (s1, vld1q_f32 (a + i + 4), vld1q_f32 (b + i + 4));
+    }
+
+    s0 = vaddq_f32 (s0, s1);
+    float32x2_t s = vadd_f32 (vget_low_f32 (s0), vget_high_f32 (s0));
+
+    return vget_lane_f32 (vpadd_f32 (s, s), 0);
+}
+#endif
+
+static DotFunc choose_dot (void)
+{
+#ifdef HAVE_AVX2_KERNEL
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+        return dot_avx2;
+#endif
+#if defined (__SSE2__)
+    return dot_sse2;
+#elif defined (HAVE_NEON_KERNEL)
+    return dot_neon;
+#else
+    return dot_generic;
+#endif
+}
+
+/* ---- coefficient tables ---- */
+
+static int gcd (int a, int b)
+{
+    while (b)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+static double bessel_i0 (double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 50 && term > sum * 1e-12; k ++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static void build_table (CoefTable * t)
+{
+    int len = t->up * t->taps;
+    double cutoff = CUTOFF * 0.5 / MAX (t->up, t->down);
+    double center = (len - 1) / 2.0;
+    double scale = 1 / bessel_i0 (KAISER_BETA);
+
+    t->coefs = realloc (t->coefs, sizeof (float) * len);
+
+    for (int i = 0; i < len; i ++)
+    {
+        double x = i - center;
+        double r = x / (center + 1);
+        double sinc = (x == 0) ? 1 : sin (2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+        double window = bessel_i0 (KAISER_BETA * sqrt (1 - r * r)) * scale;
+
+        int phase = i % t->up, k = i / t->up;
+        t->coefs[phase * t->taps + (t->taps - 1 - k)] = sinc * window;
+    }
+
+    /* Normalize each phase separately to unity gain at DC. */
+    for (int phase = 0; phase < t->up; phase ++)
+    {
+        float * c = t->coefs + phase * t->taps;
+        double sum = 0;
+
+        for (int k = 0; k < t->taps; k ++)
+            sum += c[k];
+        for (int k = 0; k < t->taps; k ++)
+            c[k] /= sum;
+    }
+}
+
+static CoefTable * get_table (int up, int down)
+{
+    CoefTable * unused = NULL;
+
+    for (int i = 0; i < tables_used; i ++)
+    {
+        if (tables[i].up == up && tables[i].down == down)
+        {
+            tables[i].users ++;
+            return & tables[i];
+        }
+
+        if (! tables[i].users)
+            unused = & tables[i];
+    }
+
+    if (tables_used < MAX_TABLES)
+        unused = & tables[tables_used ++];
+    else if (! unused)
+        return NULL;
+
+    unused->up = up;
+    unused->down = down;
+    unused->taps = BASE_TAPS * ((down + up - 1) / up);
+    build_table (unused);
+
+    unused->users = 1;
+    return unused;
+}
+
+void polyphase_cleanup (void)
+{
+    for (int i = 0; i < tables_used; i ++)
+        free (tables[i].coefs);
+
+    memset (tables, 0, sizeof tables);
+    tables_used = 0;
+}
+
+/* ---- resampler ---- */
+
+Polyphase * polyphase_new (int channels, int in_rate, int out_rate)
+{
+    int div = gcd (in_rate, out_rate);
+    int up = out_rate / div;
+    int down = in_rate / div;
+
+    if (up > MAX_FACTOR || down > MAX_FACTOR)
+        return NULL;
+
+    CoefTable * table = get_table (up, down);
+    if (! table)
+        return NULL;
+
+    Polyphase * p = calloc (1, sizeof (Polyphase));
+    p->channels = channels;
+    p->table = table;
+    p->dot = choose_dot ();
+    p->hist = calloc (channels, sizeof (float *));
+
+    polyphase_reset (p);
+    return p;
+}
+
+void polyphase_free (Polyphase * p)
+{
+    for (int c = 0; c < p->channels; c ++)
+        free (p->hist[c]);
+
+    p->table->users --;
+
+    free (p->hist);
+    free (p);
+}
+
+void polyphase_reset (Polyphase * p)
+{
+    /* Start with a filter's width of silence in the history, and with the
+     * filter centered on the first input frame so as not to add latency. */
+    int silence = p->table->taps - 1;
+
+    if (p->size < silence)
+    {
+        for (int c = 0; c < p->channels; c ++)
+            p->hist[c] = realloc (p->hist[c], sizeof (float) * silence);
+
+        p->size = silence;
+    }
+
+    for (int c = 0; c < p->channels; c ++)
+        memset (p->hist[c], 0, sizeof (float) * silence);
+
+    p->phase = 0;
+    p->pos = silence + p->table->taps / 2;
+    p->len = silence;
+}
+
+void polyphase_reserve (Polyphase * p, int frames)
+{
+    int need = p->table->taps + p->table->taps / 2 + frames;
+
+    if (p->size < need)
+    {
+        for (int c = 0; c < p->channels; c ++)
+            p->hist[c] = realloc (p->hist[c], sizeof (float) * need);
+
+        p->size = need;
+    }
+}
+
+int polyphase_max_output (Polyphase * p, int frames)
+{
+    int64_t avail = (int64_t) p->len + frames + p->table->taps / 2 - p->pos;
+    return (int) (MAX (avail, 0) * p->table->up / p->table->down) + 2;
+}
+
+static void append (Polyphase * p, const float * in, int frames)
+{
+    if (p->size < p->len + frames)
+        polyphase_reserve (p, MAX (p->len + frames, 2 * p->size));
+
+    for (int c = 0; c < p->channels; c ++)
+    {
+        float * set = p->hist[c] + p->len;
+
+        if (in)
+        {
+            const float * get = in + c;
+
+            for (int i = 0; i < frames; i ++, get += p->channels)
+                set[i] = * get;
+        }
+        else
+            memset (set, 0, sizeof (float) * frames);
+    }
+
+    p->len += frames;
+}
+
+int polyphase_process (Polyphase * p, const float * in, int frames, float * out,
+ int finish)
+{
+    const CoefTable * t = p->table;
+    int channels = p->channels;
+    int generated = 0;
+
+    append (p, in, frames);
+
+    /* Feed in enough silence to push the last input through the filter. */
+    if (finish)
+        append (p, NULL, t->taps / 2);
+
+    while (p->pos < p->len)
+    {
+        const float * coefs = t->coefs + p->phase * t->taps;
+        int start = p->pos - (t->taps - 1);
+
+        for (int c = 0; c < channels; c ++)
+            * out ++ = p->dot (coefs, p->hist[c] + start, t->taps);
+
+        generated ++;
+
+        p->phase += t->down;
+        p->pos += p->phase / t->up;
+        p->phase %= t->up;
+    }
+
+    if (finish)
+    {
+        polyphase_reset (p);
+        return generated;
+    }
+
+    /* Keep only the frames still needed for the next output. */
+    int drop = p->pos - (t->taps - 1);
+
+    if (drop > 0)
+    {
+        for (int c = 0; c < channels; c ++)
+            memmove (p->hist[c], p->hist[c] + drop, sizeof (float) * (p->len - drop));
+
+        p->len -= drop;
+        p->pos -= drop;
+    }
+
+    return generated;
+}
@@ -0,0 +1,46 @@
+/*
+ * Polyphase Resampler for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef RESAMPLE_POLYPHASE_H
+#define RESAMPLE_POLYPHASE_H
+
+typedef struct Polyphase Polyphase;
+
+/* Returns NULL if the ratio between the two rates is not a simple enough
+ * fraction to be handled with a coefficient table of reasonable size. */
+Polyphase * polyphase_new (int channels, int in_rate, int out_rate);
+void polyphase_free (Polyphase * p);
+
+/* Preallocates history for input blocks of up to <frames> frames. */
+void polyphase_reserve (Polyphase * p, int frames);
+
+/* Upper bound on the number of frames produced from <frames> more input. */
+int polyphase_max_output (Polyphase * p, int frames);
+
+/* Converts <frames> interleaved input frames and returns the number of frames
+ * written to <out>.  If <finish> is set, the filter tail is flushed out and the
+ * history is cleared afterward. */
+int polyphase_process (Polyphase * p, const float * in, int frames, float * out,
+ int finish);
+void polyphase_reset (Polyphase * p);
+
+/* Frees the cached coefficient tables. */
+void polyphase_cleanup (void);
+
+#endif
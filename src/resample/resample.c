@@ -19,6 +19,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <samplerate.h>
 
@@ -28,11 +29,20 @@
 #include <audacious/preferences.h>
 
 #include "config.h"
+#include "polyphase.h"
+#include "scratch.h"
 
 #define MIN_RATE 8000
 #define MAX_RATE 192000
 #define RATE_STEP 50
 
+/* output buffer is preallocated for blocks of up to this length */
+#define BLOCK_TIME 500 /* ms */
+
+/* not a libsamplerate converter; handled by polyphase.c */
+#define METHOD_POLYPHASE 10
+#define FALLBACK_METHOD SRC_SINC_FASTEST
+
 #define RESAMPLE_ERROR(e) fprintf (stderr, "resample: %s\n", src_strerror (e))
 
 static const char * const resample_defaults[] = {
@@ -49,18 +59,25 @@ static const char * const resample_defaults[] = {
  NULL};
 
 static SRC_STATE * state;
-static int stored_channels;
+static Polyphase * poly;
+static int stored_channels, stored_rate, stored_new_rate, stored_method;
 static double ratio;
-static float * buffer;
-static int buffer_samples;
+static bool_t ending;
+
+/* filter tail of the last song, to go out ahead of the next one */
+static AlignedBuf tail;
+static int tail_samples, tail_channels, tail_rate;
+
+/* scratch: the output, then the input with the tail in front */
+static int slots;
 
 bool_t resample_init (void)
 {
     aud_config_set_defaults ("resample", resample_defaults);
-    return TRUE;
+    return (slots = scratch_reserve (2)) >= 0;
 }
 
-void resample_cleanup (void)
+static void close_converter (void)
 {
     if (state)
     {
@@ -68,19 +85,45 @@ void resample_cleanup (void)
         state = NULL;
     }
 
-    free (buffer);
-    buffer = NULL;
-    buffer_samples = 0;
+    if (poly)
+    {
+        polyphase_free (poly);
+        poly = NULL;
+    }
 }
 
-void resample_start (int * channels, int * rate)
+static float * reserve_buffer (int samples)
 {
-    if (state)
-    {
-        src_delete (state);
-        state = NULL;
-    }
+    return scratch_get (slots, samples);
+}
+
+void resample_cleanup (void)
+{
+    close_converter ();
+    polyphase_cleanup ();
+    aligned_free (& tail);
+    scratch_release (slots, 2);
+}
 
+static void do_resample (float * * data, int * samples, bool_t finish);
+
+/* Pushes out the tail held back at the end of the last song (see
+ * resample_finish), since the converter holding it is about to go. */
+static void save_tail (void)
+{
+    float * data = NULL;
+    int samples = 0;
+
+    do_resample (& data, & samples, TRUE);
+
+    memcpy (aligned_reserve (& tail, samples), data, sizeof (float) * samples);
+    tail_samples = samples;
+    tail_channels = stored_channels;
+    tail_rate = stored_new_rate;
+}
+
+static void open_converter (int * channels, int * rate)
+{
     int new_rate = 0;
 
     if (aud_get_bool ("resample", "use-mappings"))
@@ -94,34 +137,100 @@ void resample_start (int * channels, int * rate)
 
     new_rate = CLAMP (new_rate, MIN_RATE, MAX_RATE);
 
+    int method = aud_get_int ("resample", "method");
+
+    /* If the new song has the same format as the last one, keep the converter
+     * along with its filter history, so that gapless playback stays gapless
+     * and no time is spent reallocating or warming up the filter. */
+    if ((state || poly) && * channels == stored_channels && * rate ==
+     stored_rate && new_rate == stored_new_rate && method == stored_method)
+    {
+        ending = FALSE;
+        * rate = new_rate;
+        return;
+    }
+
+    if (ending && (state || poly))
+        save_tail ();
+
+    close_converter ();
+    ending = FALSE;
+
     if (new_rate == * rate)
         return;
 
-    int method = aud_get_int ("resample", "method");
+    stored_method = method;
     int error;
 
-    if ((state = src_new (method, * channels, & error)) == NULL)
+    /* The built-in resampler handles only the simpler ratios; fall back to
+     * libsamplerate for the rest. */
+    if (method == METHOD_POLYPHASE)
+    {
+        poly = polyphase_new (* channels, * rate, new_rate);
+        method = FALLBACK_METHOD;
+    }
+
+    if (! poly && (state = src_new (method, * channels, & error)) == NULL)
     {
         RESAMPLE_ERROR (error);
         return;
     }
 
     stored_channels = * channels;
+    stored_rate = * rate;
+    stored_new_rate = new_rate;
     ratio = (double) new_rate / * rate;
+
+    /* Allocate everything up front for the largest block we expect. */
+    int frames = * rate * BLOCK_TIME / 1000;
+
+    if (poly)
+    {
+        polyphase_reserve (poly, frames);
+        reserve_buffer (* channels * polyphase_max_output (poly, frames));
+    }
+    else
+        reserve_buffer (* channels * (int) (frames * ratio) + 256);
+
     * rate = new_rate;
 }
 
-void do_resample (float * * data, int * samples, bool_t finish)
+void resample_start (int * channels, int * rate)
 {
-    if (! state || ! * samples)
-        return;
+    open_converter (channels, rate);
+
+    /* The tail can go out only if the output format stays the same; otherwise
+     * the output is reopened, and it is lost. */
+    if (tail_samples && (* channels != tail_channels || * rate != tail_rate))
+        tail_samples = 0;
+}
+
+static void do_polyphase (float * * data, int * samples, bool_t finish)
+{
+    int frames = * samples / stored_channels;
+    float * buffer = reserve_buffer (stored_channels *
+     polyphase_max_output (poly, frames));
 
-    if (buffer_samples < (int) (* samples * ratio) + 256)
+    int generated = polyphase_process (poly, * data, frames, buffer, finish);
+
+    * data = buffer;
+    * samples = stored_channels * generated;
+}
+
+static void do_resample (float * * data, int * samples, bool_t finish)
+{
+    if (poly && (* samples || finish))
     {
-        buffer_samples = (int) (* samples * ratio) + 256;
-        buffer = realloc (buffer, sizeof (float) * buffer_samples);
+        do_polyphase (data, samples, finish);
+        return;
     }
 
+    if (! state || (! * samples && ! finish))
+        return;
+
+    int buffer_samples = (int) (* samples * ratio) + 256;
+    float * buffer = reserve_buffer (buffer_samples);
+
     SRC_DATA d = {
      .data_in = * data,
      .input_frames = * samples / stored_channels,
@@ -141,13 +250,33 @@ void do_resample (float * * data, int * samples, bool_t finish)
     * samples = stored_channels * d.output_frames_gen;
 }
 
+static void prepend_tail (float * * data, int * samples)
+{
+    float * buffer = scratch_get (slots + 1, tail_samples + * samples);
+
+    memcpy (buffer, tail.mem, sizeof (float) * tail_samples);
+    memcpy (buffer + tail_samples, * data, sizeof (float) * * samples);
+
+    * data = buffer;
+    * samples += tail_samples;
+    tail_samples = 0;
+}
+
 void resample_process (float * * data, int * samples)
 {
     do_resample (data, samples, FALSE);
+
+    if (tail_samples)
+        prepend_tail (data, samples);
 }
 
 void resample_flush (void)
 {
+    tail_samples = 0;
+
+    if (poly)
+        polyphase_reset (poly);
+
     int error;
     if (state && (error = src_reset (state)))
         RESAMPLE_ERROR (error);
@@ -155,8 +284,23 @@ void resample_flush (void)
 
 void resample_finish (float * * data, int * samples)
 {
+    /* The first call comes at the end of each song.  Hold back the filter tail
+     * in case the next song continues at the same rate; it is pushed out by the
+     * second call, at the end of the playlist. */
+    if (! ending)
+    {
+        ending = TRUE;
+        resample_process (data, samples);
+        return;
+    }
+
     do_resample (data, samples, TRUE);
+
+    if (tail_samples)
+        prepend_tail (data, samples);
+
     resample_flush ();
+    ending = FALSE;
 }
 
 static const char resample_about[] =
@@ -168,7 +312,8 @@ static const ComboBoxElements method_list[] = {
  {"4", N_("Linear interpolation")}, /* SRC_LINEAR */
  {"2", N_("Fast sinc interpolation")}, /* SRC_SINC_FASTEST */
  {"1", N_("Medium sinc interpolation")}, /* SRC_SINC_MEDIUM_QUALITY */
- {"0", N_("Best sinc interpolation")}}; /* SRC_SINC_BEST_QUALITY */
+ {"0", N_("Best sinc interpolation")}, /* SRC_SINC_BEST_QUALITY */
+ {"10", N_("Built-in polyphase filter")}}; /* METHOD_POLYPHASE */
 
 static const PreferencesWidget resample_widgets[] = {
  {WIDGET_LABEL, N_("<b>Conversion</b>")},
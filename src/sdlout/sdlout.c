@@ -23,7 +23,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <string.h>
 
 #include <SDL.h>
 #include <SDL_audio.h>
@@ -31,7 +31,11 @@
 #include <audacious/debug.h>
 #include <audacious/misc.h>
 #include <audacious/plugin.h>
+#include <libaudcore/audio.h>
 
+#include "gain.h"
+#include "outstats.h"
+#include "ring.h"
 #include "sdlout.h"
 
 #define VOLUME_RANGE 40 /* decibels */
@@ -46,21 +50,29 @@ static const char * const sdl_defaults[] = {
  "vol_right", "100",
  NULL};
 
+/* The playback thread fills the ring and the SDL callback empties it, without
+ * a lock between them.  The mutex only orders starting, pausing and flushing;
+ * the SDL audio lock is taken only to flush. */
 static pthread_mutex_t sdlout_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t sdlout_cond = PTHREAD_COND_INITIALIZER;
 
-static volatile int vol_left, vol_right;
+static int vol_left, vol_right;
 
-static int sdlout_chan, sdlout_rate;
+static int sdlout_format, sdlout_chan, sdlout_rate, sdlout_frame_size;
 
-static unsigned char * buffer;
-static int buffer_size, buffer_data_start, buffer_data_len;
+static Ring ring;
 
+/* The following are shared with the callback (or with callers of output_time)
+ * and are accessed only through ATOMIC_GET and ATOMIC_SET. */
 static int64_t frames_written;
-static char prebuffer_flag, paused_flag;
+static char prebuffer_flag, paused_flag, drain_flag;
+static int paused_delay; /* frames */
+static uint64_t block_delay; /* frames << 32 | timestamp in milliseconds */
 
-static int block_delay;
-static struct timeval block_time;
+static char writer_waiting;
+static SDL_sem * writer_sem;
+
+static OutputStats sdlout_stats;
+static char starved_flag; /* callback only */
 
 int sdlout_init (void)
 {
@@ -75,128 +87,181 @@ int sdlout_init (void)
         return 0;
     }
 
+    writer_sem = SDL_CreateSemaphore (0);
     return 1;
 }
 
 void sdlout_cleanup (void)
 {
+    SDL_DestroySemaphore (writer_sem);
     SDL_Quit ();
 }
 
 void sdlout_get_volume (int * left, int * right)
 {
-    * left = vol_left;
-    * right = vol_right;
+    * left = ATOMIC_GET (vol_left);
+    * right = ATOMIC_GET (vol_right);
 }
 
 void sdlout_set_volume (int left, int right)
 {
-    vol_left = left;
-    vol_right = right;
+    ATOMIC_SET (vol_left, left);
+    ATOMIC_SET (vol_right, right);
 
     aud_set_int ("sdlout", "vol_left", left);
     aud_set_int ("sdlout", "vol_right", right);
 }
 
-static void apply_mono_volume (unsigned char * data, int len)
+static float get_gain (int vol)
 {
-    int vol = MAX (vol_left, vol_right);
-    int factor = (vol == 0) ? 0 : powf (10, (float) VOLUME_RANGE * (vol - 100)
-     / 100 / 20) * 65536;
+    if (vol <= 0)
+        return 0;
+    if (vol >= 100)
+        return 1;
 
-    int16_t * i = (int16_t *) data;
-    int16_t * end = (int16_t *) (data + len);
+    return powf (10, (float) VOLUME_RANGE * (vol - 100) / 100 / 20);
+}
 
-    while (i < end)
-    {
-        * i = ((int) * i * factor) >> 16;
-        i ++;
-    }
+static void apply_volume (void * data, int frames)
+{
+    int left = ATOMIC_GET (vol_left), right = ATOMIC_GET (vol_right);
+
+    if (sdlout_chan == 1)
+        left = right = MAX (left, right);
+
+    float gl = get_gain (left), gr = get_gain (right);
+
+    if (sdlout_format == FMT_FLOAT)
+        gain_float (data, frames, sdlout_chan, gl, gr);
+    else if (sdlout_format == FMT_S32_NE)
+        gain_s32 (data, frames, sdlout_chan, gl, gr);
+    else
+        gain_s16 (data, frames, sdlout_chan, gl, gr);
 }
 
-static void apply_stereo_volume (unsigned char * data, int len)
+static void writer_wake (void)
 {
-    int factor_left = (vol_left == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
-     (vol_left - 100) / 100 / 20) * 65536;
-    int factor_right = (vol_right == 0) ? 0 : powf (10, (float) VOLUME_RANGE *
-     (vol_right - 100) / 100 / 20) * 65536;
+    if (ATOMIC_SWAP (writer_waiting, 0))
+        SDL_SemPost (writer_sem);
+}
 
-    int16_t * i = (int16_t *) data;
-    int16_t * end = (int16_t *) (data + len);
+/* waits for the callback, or for flush or unpause */
+static void writer_sleep (char (* done) (void))
+{
+    ATOMIC_SET (writer_waiting, 1);
 
-    while (i < end)
-    {
-        * i = ((int) * i * factor_left) >> 16;
-        i ++;
-        * i = ((int) * i * factor_right) >> 16;
-        i ++;
-    }
+    if (! done ())
+        SDL_SemWait (writer_sem);
+
+    ATOMIC_SET (writer_waiting, 0);
+}
+
+static void set_delay (int delay)
+{
+    ATOMIC_SET (block_delay, (uint64_t) MAX (delay, 0) << 32 | SDL_GetTicks ());
+}
+
+/* the block last handed to SDL, less the time passed since then */
+static int guess_delay (void)
+{
+    uint64_t packed = ATOMIC_GET (block_delay);
+    int64_t delay = packed >> 32;
+    unsigned int elapsed = SDL_GetTicks () - (unsigned int) packed;
+
+    return MAX (delay - (int64_t) elapsed * sdlout_rate / 1000, 0);
 }
 
 static void callback (void * user, unsigned char * buf, int len)
 {
-    pthread_mutex_lock (& sdlout_mutex);
+    stats_count (& sdlout_stats.wakeups);
+    stats_fill (& sdlout_stats.ring, ring_filled (& ring), ring.size);
 
-    int copy = MIN (len, buffer_data_len);
-    int part = buffer_size - buffer_data_start;
+    int copy = MIN (len, ring_filled (& ring));
+    copy -= copy % sdlout_frame_size;
 
-    if (copy <= part)
-    {
-        memcpy (buf, buffer + buffer_data_start, copy);
-        buffer_data_start += copy;
-    }
-    else
+    /* At this moment, we know that there is a delay of (at least) the block of
+     * data just written.  It is published before the data is given up, so that
+     * the output time may lag for a moment but never runs ahead. */
+    set_delay (copy / sdlout_frame_size);
+
+    for (int done = 0; done < copy; )
     {
-        memcpy (buf, buffer + buffer_data_start, part);
-        memcpy (buf + part, buffer, copy - part);
-        buffer_data_start = copy - part;
+        void * data;
+        int part = MIN (copy - done, ring_peek (& ring, & data));
+        memcpy (buf + done, data, part);
+        ring_consume (& ring, part);
+        done += part;
     }
 
-    buffer_data_len -= copy;
+    writer_wake ();
 
-    if (sdlout_chan == 2)
-        apply_stereo_volume (buf, copy);
-    else
-        apply_mono_volume (buf, copy);
+    apply_volume (buf, copy / sdlout_frame_size);
 
     if (copy < len)
+    {
+        if (! starved_flag && ! ATOMIC_GET (drain_flag) && ! ATOMIC_GET
+         (prebuffer_flag))
+            stats_count (& sdlout_stats.starvations);
+
         memset (buf + copy, 0, len - copy);
+    }
 
-    /* At this moment, we know that there is a delay of (at least) the block of
-     * data just written.  We save the block size and the current time for
-     * estimating the delay later on. */
-    block_delay = copy / (2 * sdlout_chan) * 1000 / sdlout_rate;
-    gettimeofday (& block_time, NULL);
+    starved_flag = (copy < len);
+}
 
-    pthread_cond_broadcast (& sdlout_cond);
-    pthread_mutex_unlock (& sdlout_mutex);
+static int convert_format (int format)
+{
+    switch (format)
+    {
+        case FMT_S16_NE: return AUDIO_S16SYS;
+#if SDL_VERSION_ATLEAST (2, 0, 0)
+        case FMT_S32_NE: return AUDIO_S32SYS;
+        case FMT_FLOAT: return AUDIO_F32SYS;
+#endif
+        default: return -1;
+    }
 }
 
 int sdlout_open_audio (int format, int rate, int chan)
 {
-    if (format != FMT_S16_NE)
+    int sdl_format = convert_format (format);
+
+    if (sdl_format < 0)
     {
+#if SDL_VERSION_ATLEAST (2, 0, 0)
+        sdlout_error ("Only signed 16- and 32-bit native endian and floating "
+         "point audio are supported.\n");
+#else
         sdlout_error ("Only signed 16-bit, native endian audio is supported.\n");
+#endif
         return 0;
     }
 
     AUDDBG ("Opening audio for %d channels, %d Hz.\n", chan, rate);
 
+    sdlout_format = format;
     sdlout_chan = chan;
     sdlout_rate = rate;
+    sdlout_frame_size = FMT_SIZEOF (format) * chan;
 
-    buffer_size = 2 * chan * (aud_get_int (NULL, "output_buffer_size") * rate / 1000);
-    buffer = malloc (buffer_size);
-    buffer_data_start = 0;
-    buffer_data_len = 0;
+    ring_init (& ring, sdlout_frame_size * (aud_get_int (NULL,
+     "output_buffer_size") * rate / 1000));
 
     frames_written = 0;
     prebuffer_flag = 1;
     paused_flag = 0;
+    drain_flag = 0;
+    paused_delay = 0;
+    starved_flag = 0;
+    writer_waiting = 0;
+    set_delay (0);
 
+    stats_reset (& sdlout_stats, "sdlout");
+
+    /* With SDL 2, anything the device cannot take is converted by SDL. */
     SDL_AudioSpec spec = {
      .freq = rate,
-     .format = AUDIO_S16,
+     .format = sdl_format,
      .channels = chan,
      .samples = 4096,
      .callback = callback,
@@ -205,8 +270,7 @@ int sdlout_open_audio (int format, int rate, int chan)
     if (SDL_OpenAudio (& spec, NULL) < 0)
     {
         sdlout_error ("Failed to open audio stream: %s.\n", SDL_GetError ());
-        free (buffer);
-        buffer = NULL;
+        ring_free (& ring);
         return 0;
     }
 
@@ -217,102 +281,103 @@ void sdlout_close_audio (void)
 {
     AUDDBG ("Closing audio.\n");
     SDL_CloseAudio ();
-    free (buffer);
-    buffer = NULL;
+    stats_dump (& sdlout_stats);
+    ring_free (& ring);
 }
 
 int sdlout_buffer_free (void)
 {
-    pthread_mutex_lock (& sdlout_mutex);
-    int space = buffer_size - buffer_data_len;
-    pthread_mutex_unlock (& sdlout_mutex);
-    return space;
+    return ring_space (& ring);
 }
 
-static void check_started (void)
+static void start_playback (void)
 {
-    if (! prebuffer_flag)
-        return;
-
     AUDDBG ("Starting playback.\n");
-    prebuffer_flag = 0;
-    block_delay = 0;
+    set_delay (0);
+    ATOMIC_SET (prebuffer_flag, 0);
     SDL_PauseAudio (0);
 }
 
-void sdlout_period_wait (void)
+static char must_start (void)
 {
-    pthread_mutex_lock (& sdlout_mutex);
+    return ATOMIC_GET (prebuffer_flag) && ! ATOMIC_GET (paused_flag);
+}
 
-    while (buffer_data_len == buffer_size)
+static char writer_ready (void)
+{
+    return ring_space (& ring) || must_start ();
+}
+
+void sdlout_period_wait (void)
+{
+    while (! ring_space (& ring))
     {
-        if (! paused_flag)
-            check_started ();
+        if (must_start ())
+        {
+            pthread_mutex_lock (& sdlout_mutex);
 
-        pthread_cond_wait (& sdlout_cond, & sdlout_mutex);
-    }
+            if (must_start ())
+                start_playback ();
 
-    pthread_mutex_unlock (& sdlout_mutex);
+            pthread_mutex_unlock (& sdlout_mutex);
+        }
+
+        writer_sleep (writer_ready);
+    }
 }
 
 void sdlout_write_audio (void * data, int len)
 {
-    pthread_mutex_lock (& sdlout_mutex);
+    int64_t write_start = stats_now ();
 
-    assert (len <= buffer_size - buffer_data_len);
+    assert (len <= ring_space (& ring));
 
-    int start = (buffer_data_start + buffer_data_len) % buffer_size;
+    if (ATOMIC_GET (drain_flag))
+        ATOMIC_SET (drain_flag, 0);
 
-    if (len <= buffer_size - start)
-        memcpy (buffer + start, data, len);
-    else
-    {
-        int part = buffer_size - start;
-        memcpy (buffer + start, data, part);
-        memcpy (buffer, (char *) data + part, len - part);
-    }
+    ring_write (& ring, data, len);
+    ATOMIC_SET (frames_written, frames_written + len / sdlout_frame_size);
 
-    buffer_data_len += len;
-    frames_written += len / (2 * sdlout_chan);
+    stats_write_done (& sdlout_stats, write_start);
+    stats_poll (& sdlout_stats);
+}
 
-    pthread_mutex_unlock (& sdlout_mutex);
+static char ring_empty (void)
+{
+    return ! ring_filled (& ring);
 }
 
 void sdlout_drain (void)
 {
     AUDDBG ("Draining.\n");
-    pthread_mutex_lock (& sdlout_mutex);
 
-    check_started ();
+    pthread_mutex_lock (& sdlout_mutex);
 
-    while (buffer_data_len)
-        pthread_cond_wait (& sdlout_cond, & sdlout_mutex);
+    if (ATOMIC_GET (prebuffer_flag))
+        start_playback ();
 
     pthread_mutex_unlock (& sdlout_mutex);
+
+    ATOMIC_SET (drain_flag, 1); /* until more data is written */
+
+    while (! ring_empty ())
+        writer_sleep (ring_empty);
 }
 
+/* Lock-free.  The values are read in the reverse of the order in which they
+ * are updated, so that a write or a callback happening meanwhile can only make
+ * the time come out a little early. */
 int sdlout_output_time (void)
 {
-    pthread_mutex_lock (& sdlout_mutex);
-
-    int out = (int64_t) (frames_written - buffer_data_len / (2 * sdlout_chan))
-     * 1000 / sdlout_rate;
-
-    /* Estimate the additional delay of the last block written. */
-    if (! prebuffer_flag && ! paused_flag && block_delay)
-    {
-        struct timeval cur;
-        gettimeofday (& cur, NULL);
-
-        int elapsed = 1000 * (cur.tv_sec - block_time.tv_sec) + (cur.tv_usec -
-         block_time.tv_usec) / 1000;
+    int64_t frames = ATOMIC_GET (frames_written);
+    frames -= ring_filled (& ring) / sdlout_frame_size;
 
-        if (elapsed < block_delay)
-            out -= block_delay - elapsed;
-    }
+    if (ATOMIC_GET (prebuffer_flag) || ATOMIC_GET (paused_flag))
+        frames -= ATOMIC_GET (paused_delay);
+    else
+        frames -= guess_delay ();
 
-    pthread_mutex_unlock (& sdlout_mutex);
-    return out;
+    return frames * 1000 / sdlout_rate;
 }
 
 void sdlout_pause (int pause)
@@ -320,12 +385,20 @@ void sdlout_pause (int pause)
     AUDDBG ("%sause.\n", pause ? "P" : "Unp");
     pthread_mutex_lock (& sdlout_mutex);
 
-    paused_flag = pause;
+    if (pause && ! prebuffer_flag)
+        ATOMIC_SET (paused_delay, guess_delay ());
+
+    ATOMIC_SET (paused_flag, pause);
 
     if (! prebuffer_flag)
+    {
         SDL_PauseAudio (pause);
 
-    pthread_cond_broadcast (& sdlout_cond); /* wake up period wait */
+        if (! pause)
+            set_delay (paused_delay);
+    }
+
+    writer_wake (); /* may be waiting to start playback */
     pthread_mutex_unlock (& sdlout_mutex);
 }
 
@@ -334,12 +407,19 @@ void sdlout_flush (int time)
     AUDDBG ("Seek requested; discarding buffer.\n");
     pthread_mutex_lock (& sdlout_mutex);
 
-    buffer_data_start = 0;
-    buffer_data_len = 0;
+    /* keep the callback out while the ring is reset */
+    SDL_PauseAudio (1);
+    SDL_LockAudio ();
 
-    frames_written = (int64_t) time * sdlout_rate / 1000;
-    prebuffer_flag = 1;
+    ring_reset (& ring);
+
+    ATOMIC_SET (frames_written, (int64_t) time * sdlout_rate / 1000);
+    ATOMIC_SET (prebuffer_flag, 1);
+    ATOMIC_SET (paused_delay, 0);
+    set_delay (0);
+
+    SDL_UnlockAudio ();
 
-    pthread_cond_broadcast (& sdlout_cond); /* wake up period wait */
+    writer_wake (); /* interrupt period wait */
     pthread_mutex_unlock (& sdlout_mutex);
 }
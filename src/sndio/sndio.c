@@ -31,6 +31,7 @@
 #include <libaudgui/libaudgui-gtk.h>
 
 #include "config.h"
+#include "outstats.h"
 
 /*
  * minimum output buffer size in milliseconds
@@ -66,6 +67,7 @@ static int paused, restarted, volume;
 static int pause_pending, flush_pending, volume_pending;
 static int bytes_per_sec;
 static pthread_mutex_t mtx;
+static OutputStats stats;
 
 static GtkWidget *configure_win;
 static GtkWidget *adevice_entry;
@@ -156,6 +158,7 @@ wait_ready(void)
 			}
 		}
 		pthread_mutex_lock(&mtx);
+		stats_count(&stats.wakeups);
 	}
 	(void)sio_revents(hdl, pfds);
 }
@@ -279,6 +282,7 @@ sndio_open(int fmt, int rate, int nch)
 	bytes_per_sec = par.bps * par.pchan * par.rate;
 	restarted = 1;
 	paused = 0;
+	stats_reset(&stats, "sndio");
 	return (1);
 }
 
@@ -286,16 +290,21 @@ void
 sndio_write(void *ptr, int length)
 {
 	unsigned n;
+	int64_t start;
 
 	pthread_mutex_lock(&mtx);
 	for (;;) {
 		if (paused)
 			break;
 		restarted = 0;
+		start = stats_now();
 		n = sio_write(hdl, ptr, length);
+		stats_write_done(&stats, start);
 		if (n == 0 && sio_eof(hdl))
 			return;
 		wrpos += n;
+		stats_fill(&stats.device, wrpos - rdpos,
+		    par.appbufsz * par.bps * par.pchan);
 		length -= n;
 		ptr = (char *)ptr + n;
 		if (length == 0)
@@ -303,6 +312,7 @@ sndio_write(void *ptr, int length)
 		wait_ready();
 	}
 	pthread_mutex_unlock(&mtx);
+	stats_poll(&stats);
 }
 
 void
@@ -310,6 +320,7 @@ sndio_close(void)
 {
 	if (!hdl)
 		return;
+	stats_dump(&stats);
 	sio_close(hdl);
 	hdl = NULL;
 }
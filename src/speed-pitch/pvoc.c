@@ -0,0 +1,289 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* A classic phase vocoder.  The signal is cut into Hann-windowed frames, four
+ * to a frame length, and transformed.  From the phase advance of each bin since
+ * the previous frame we estimate the true frequency of the partial in it; the
+ * spectral peaks are then moved to their new frequencies and resynthesized
+ * with phases accumulated at the new rate.
+ *
+ * All buffers are planar (one per channel) and are allocated in pvoc_start.
+ * The input and output histories are rings of one frame length, so frames are
+ * read and overlap-added in place without moving any memory. */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fft.h"
+#include "pvoc.h"
+#include "scratch.h"
+
+#define OVERSAMPLE 4
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+static int chans, size, hop, bins;
+static RFFTPlan plan;
+static float * window;
+static float scale;
+
+static float * * in_ring, * * out_ring;   /* per channel, <size> frames */
+static float * * last_phase, * * sum_phase; /* per channel, <bins> values */
+static int at;                  /* position in both rings */
+static int trim;                /* output frames still to be discarded */
+static int out_slot;            /* scratch */
+
+static float * frame;            /* windowed input, resynthesized output */
+static float * re, * im;        /* spectrum, <bins> values */
+static float * magn, * phase;   /* analysis results */
+static float * freq;            /* true frequency of each bin, in bins */
+static int * peaks;
+
+
+static float * * alloc_planar (int count)
+{
+    float * * p = malloc (sizeof (float *) * chans);
+
+    for (int c = 0; c < chans; c ++)
+        p[c] = calloc (count, sizeof (float));
+
+    return p;
+}
+
+static void free_planar (float * * p)
+{
+    if (! p)
+        return;
+
+    for (int c = 0; c < chans; c ++)
+        free (p[c]);
+
+    free (p);
+}
+
+static void free_buffers (void)
+{
+    free_planar (in_ring);
+    free_planar (out_ring);
+    free_planar (last_phase);
+    free_planar (sum_phase);
+
+    in_ring = out_ring = last_phase = sum_phase = NULL;
+
+    free (window);
+    free (frame);
+    free (re);
+    free (im);
+    free (magn);
+    free (phase);
+    free (freq);
+    free (peaks);
+
+    window = frame = re = im = magn = phase = freq = NULL;
+    peaks = NULL;
+}
+
+void pvoc_start (int new_chans, int frame_size, int slot)
+{
+    out_slot = slot;
+
+    if (new_chans == chans && frame_size == size && in_ring)
+    {
+        pvoc_flush ();
+        return;
+    }
+
+    free_buffers ();
+
+    chans = new_chans;
+    size = frame_size;
+    hop = size / OVERSAMPLE;
+    bins = size / 2 + 1;
+
+    if (plan.size != size)
+        rfft_plan_init (& plan, size);
+
+    /* The window is applied twice, before analysis and after synthesis; the
+     * overlapping squared Hann windows sum to 3/8 of the oversampling factor.
+     * The inverse transform is not normalized either (see fft.h). */
+    window = malloc (sizeof (float) * size);
+    for (int i = 0; i < size; i ++)
+        window[i] = (1 - cos (2 * M_PI * i / size)) / 2;
+
+    scale = 1 / (size / 2 * OVERSAMPLE * 3.0 / 8);
+
+    in_ring = alloc_planar (size);
+    out_ring = alloc_planar (size);
+    last_phase = alloc_planar (bins);
+    sum_phase = alloc_planar (bins);
+
+    frame = malloc (sizeof (float) * size);
+    re = malloc (sizeof (float) * bins);
+    im = malloc (sizeof (float) * bins);
+    magn = malloc (sizeof (float) * bins);
+    phase = malloc (sizeof (float) * bins);
+    freq = malloc (sizeof (float) * bins);
+    peaks = malloc (sizeof (int) * bins);
+
+    pvoc_flush ();
+}
+
+void pvoc_flush (void)
+{
+    for (int c = 0; c < chans; c ++)
+    {
+        memset (in_ring[c], 0, sizeof (float) * size);
+        memset (out_ring[c], 0, sizeof (float) * size);
+        memset (last_phase[c], 0, sizeof (float) * bins);
+        memset (sum_phase[c], 0, sizeof (float) * bins);
+    }
+
+    at = 0;
+    trim = size;
+}
+
+int pvoc_latency (void)
+{
+    return size;
+}
+
+static float wrap (float phase)
+{
+    return phase - 2 * M_PI * floorf (phase / (2 * M_PI) + 0.5f);
+}
+
+/* Processes the frame of one channel ending at the current ring position. */
+static void do_frame (int c, double pitch)
+{
+    float * in = in_ring[c], * out = out_ring[c];
+    float * last = last_phase[c], * sum = sum_phase[c];
+    float expect = 2 * M_PI / OVERSAMPLE;
+
+    for (int i = 0; i < size; i ++)
+        frame[i] = in[(at + i) % size] * window[i];
+
+    rfft_forward (& plan, frame, re, im);
+
+    /* Analysis: find the true frequency of each bin from its phase advance. */
+    for (int k = 0; k < bins; k ++)
+    {
+        phase[k] = atan2f (im[k], re[k]);
+        magn[k] = sqrtf (re[k] * re[k] + im[k] * im[k]);
+        freq[k] = k + wrap (phase[k] - last[k] - k * expect) / expect;
+        last[k] = phase[k];
+    }
+
+    int n_peaks = 0;
+    for (int k = 1; k < bins - 1; k ++)
+    {
+        if (magn[k] > magn[k - 1] && magn[k] >= magn[k + 1])
+            peaks[n_peaks ++] = k;
+    }
+
+    memset (re, 0, sizeof (float) * bins);
+    memset (im, 0, sizeof (float) * bins);
+
+    /* Synthesis: each peak owns the bins halfway to its neighbors.  The peak
+     * is moved to its new frequency, with its phase advanced at that frequency,
+     * and the bins around it are moved along with it, keeping their phases
+     * relative to the peak ("identity phase locking").  Only the positive
+     * frequencies are filled in; the inverse transform takes the negative ones
+     * as their mirror image. */
+    for (int i = 0; i < n_peaks; i ++)
+    {
+        int peak = peaks[i];
+        int to_peak = (int) (peak * pitch + 0.5);
+
+        if (to_peak >= bins)
+            break;
+
+        int low = i ? (peaks[i - 1] + peak) / 2 + 1 : 0;
+        int high = (i + 1 < n_peaks) ? (peak + peaks[i + 1]) / 2 : bins - 1;
+        int shift = to_peak - peak;
+
+        sum[to_peak] = wrap (sum[to_peak] + freq[peak] * pitch * expect);
+        float base = sum[to_peak] - phase[peak];
+
+        for (int k = MAX (low, - shift); k <= high && k + shift < bins; k ++)
+        {
+            int to = k + shift;
+            float ph = wrap (base + phase[k]);
+
+            re[to] += magn[k] * cosf (ph);
+            im[to] += magn[k] * sinf (ph);
+
+            if (to != to_peak)
+                sum[to] = ph;
+        }
+    }
+
+    /* DC and Nyquist are real */
+    im[0] = im[bins - 1] = 0;
+
+    rfft_inverse (& plan, re, im, frame);
+
+    for (int i = 0; i < size; i ++)
+        out[(at + i) % size] += frame[i] * window[i] * scale;
+}
+
+void pvoc_process (const float * data, int frames, double pitch, int ending,
+ float * * out, int * out_frames)
+{
+    /* Push a frame length of silence through at the end to flush out the last
+     * of the real audio. */
+    int total = frames + (ending ? size : 0);
+
+    float * output = scratch_get (out_slot, total * chans);
+    float * set = output;
+
+    for (int f = 0; f < total; f ++)
+    {
+        for (int c = 0; c < chans; c ++)
+        {
+            in_ring[c][at] = (f < frames) ? data[f * chans + c] : 0;
+            * set ++ = out_ring[c][at];
+            out_ring[c][at] = 0;
+        }
+
+        at = (at + 1) % size;
+
+        if (at % hop == 0)
+        {
+            for (int c = 0; c < chans; c ++)
+                do_frame (c, pitch);
+        }
+    }
+
+    int cut = MIN (trim, total);
+    trim -= cut;
+
+    * out = output + cut * chans;
+    * out_frames = total - cut;
+
+    if (ending)
+        pvoc_flush ();
+}
+
+void pvoc_cleanup (void)
+{
+    free_buffers ();
+    rfft_plan_free (& plan);
+}
@@ -0,0 +1,37 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SPEED_PITCH_PVOC_H
+#define SPEED_PITCH_PVOC_H
+
+/* <frame_size> must be a power of two. */
+void pvoc_start (int chans, int frame_size, int slot);
+void pvoc_flush (void);
+void pvoc_cleanup (void);
+
+/* Delay in frames between input and output. */
+int pvoc_latency (void);
+
+/* Shifts the pitch of <frames> interleaved frames without changing their
+ * length.  The returned buffer is valid until the next call.  If <ending> is
+ * set, the audio still held back is returned as well. */
+void pvoc_process (const float * data, int frames, double pitch, int ending,
+ float * * out, int * out_frames);
+
+#endif
@@ -29,6 +29,9 @@
 #include <audacious/preferences.h>
 
 #include "config.h"
+#include "pvoc.h"
+#include "scratch.h"
+#include "wsola.h"
 
 /* The general idea of the speed change algorithm is to divide the input signal
  * into pieces, spaced at a time interval A, using a cosine-shaped window
@@ -48,29 +51,42 @@
 #define MINPITCH 0.5
 #define MAXPITCH 2.0
 
+enum {
+    METHOD_OVERLAP_ADD,
+    METHOD_WSOLA
+};
+
+enum {
+    PITCH_RESAMPLE,
+    PITCH_VOCODER
+};
+
+#define MIN_FRAME_SIZE 256
+#define MAX_FRAME_SIZE 8192
+
 #define BYTES(frames) ((frames) * curchans * sizeof (float))
 #define OFFSET(buf,frames) ((buf) + (frames) * curchans)
 
+/* These hold audio between calls, so they have their own (aligned) memory
+ * rather than scratch buffers. */
 typedef struct {
     float * mem;
-    int size, len;
+    int len;
+    AlignedBuf alloc;
 } Buffer;
 
-static int curchans, currate;
+static int curchans, currate, curmethod, curpitchmethod;
 static SRC_STATE * srcstate;
 static int outstep, width;
 static double * cosine;
 static Buffer in, out;
 static int trim, written;
 static bool_t ending;
+static int slots; /* scratch: vocoder output, then WSOLA output */
 
 static void bufgrow (Buffer * b, int len)
 {
-    if (len > b->size)
-    {
-        b->mem = realloc (b->mem, BYTES (len));
-        b->size = len;
-    }
+    b->mem = aligned_reserve (& b->alloc, len * curchans);
 
     if (len > b->len)
     {
@@ -88,6 +104,14 @@ static void bufcut (Buffer * b, int len)
 static void bufadd (Buffer * b, float * data, int len, double ratio)
 {
     int oldlen = b->len;
+
+    if (ratio == 1)
+    {
+        bufgrow (b, oldlen + len);
+        memcpy (OFFSET (b->mem, oldlen), data, BYTES (len));
+        return;
+    }
+
     int max = len * ratio + 100;
     bufgrow (b, oldlen + max);
 
@@ -106,6 +130,17 @@ static void speed_flush (void)
 {
     src_reset (srcstate);
 
+    if (curpitchmethod == PITCH_VOCODER)
+        pvoc_flush ();
+
+    if (curmethod == METHOD_WSOLA)
+    {
+        wsola_flush ();
+        in.len = 0;
+        ending = FALSE;
+        return;
+    }
+
     in.len = 0;
     out.len = 0;
 
@@ -127,6 +162,27 @@ static void speed_start (int * chans, int * rate)
 
     srcstate = src_new (SRC_LINEAR, curchans, NULL);
 
+    curmethod = aud_get_int (CFGSECT, "method");
+    curpitchmethod = aud_get_int (CFGSECT, "pitch-method");
+
+    if (curpitchmethod == PITCH_VOCODER)
+    {
+        /* round down to a power of two, in case of a hand-edited config */
+        int size = CLAMP (aud_get_int (CFGSECT, "frame-size"), MIN_FRAME_SIZE,
+         MAX_FRAME_SIZE);
+        while (size & (size - 1))
+            size &= size - 1;
+
+        pvoc_start (curchans, size, slots);
+    }
+
+    if (curmethod == METHOD_WSOLA)
+    {
+        wsola_start (curchans, currate, slots + 1);
+        speed_flush ();
+        return;
+    }
+
     /* Calculate the width of the cosine window and the spacing interval for
      * output. */
     outstep = currate / FREQ;
@@ -141,11 +197,51 @@ static void speed_start (int * chans, int * rate)
     speed_flush ();
 }
 
+static void wsola_speed_process (float * * data, int * samples, double speed,
+ double pitch)
+{
+    float * get = * data;
+    int frames = * samples / curchans;
+
+    /* Scale to adjust pitch, unless there is nothing to scale.  The input
+     * buffer is only scratch space here; WSOLA keeps its own history. */
+    if (pitch != 1)
+    {
+        in.len = 0;
+        bufadd (& in, get, frames, 1.0 / pitch);
+        get = in.mem;
+        frames = in.len;
+    }
+
+    int instep = round (wsola_outstep () * speed / pitch);
+    int out_frames;
+
+    wsola_process (get, frames, instep, ending, data, & out_frames);
+    * samples = out_frames * curchans;
+}
+
 static void speed_process (float * * data, int * samples)
 {
     double pitch = aud_get_double (CFGSECT, "pitch");
     double speed = aud_get_double (CFGSECT, "speed");
 
+    /* The phase vocoder changes the pitch without changing the length, so
+     * what follows is only a matter of speed.  It runs even at the original
+     * pitch, so that the latency does not jump when the pitch is changed. */
+    if (curpitchmethod == PITCH_VOCODER)
+    {
+        int frames;
+        pvoc_process (* data, * samples / curchans, pitch, ending, data, & frames);
+        * samples = frames * curchans;
+        pitch = 1;
+    }
+
+    if (curmethod == METHOD_WSOLA)
+    {
+        wsola_speed_process (data, samples, speed, pitch);
+        return;
+    }
+
     /* Remove audio that has already been played from the output buffer. */
     bufcut (& out, written);
 
@@ -215,14 +311,39 @@ static int speed_adjust_delay (int delay)
 {
     /* Not sample-accurate, but should be a decent estimate. */
     double speed = aud_get_double (CFGSECT, "speed");
-    return delay * speed + width * 1000 / currate;
+    int latency = (curmethod == METHOD_WSOLA) ? wsola_latency () : width;
+
+    if (curpitchmethod == PITCH_VOCODER)
+        latency += pvoc_latency ();
+
+    return delay * speed + (int64_t) latency * 1000 / currate;
 }
 
 static const char * const speed_defaults[] = {
  "speed", "1",
  "pitch", "1",
+ "method", "0", /* METHOD_OVERLAP_ADD */
+ "pitch-method", "0", /* PITCH_RESAMPLE */
+ "frame-size", "2048",
  NULL};
 
+static const ComboBoxElements method_list[] = {
+ {"0", N_("Simple overlap-add")}, /* METHOD_OVERLAP_ADD */
+ {"1", N_("WSOLA (better quality)")}}; /* METHOD_WSOLA */
+
+static const ComboBoxElements pitch_method_list[] = {
+ {"0", N_("Resampling (fast)")}, /* PITCH_RESAMPLE */
+ {"1", N_("Phase vocoder")}}; /* PITCH_VOCODER */
+
+/* MIN_FRAME_SIZE to MAX_FRAME_SIZE; the FFT needs a power of two */
+static const ComboBoxElements frame_size_list[] = {
+ {"256", "256"},
+ {"512", "512"},
+ {"1024", "1024"},
+ {"2048", "2048"},
+ {"4096", "4096"},
+ {"8192", "8192"}};
+
 static const PreferencesWidget speed_widgets[] = {
  {WIDGET_LABEL, N_("<b>Speed and Pitch</b>")},
  {WIDGET_SPIN_BTN, N_("Speed:"),
@@ -230,7 +351,16 @@ static const PreferencesWidget speed_widgets[] = {
   .data = {.spin_btn = {MINSPEED, MAXSPEED, 0.05}}},
  {WIDGET_SPIN_BTN, N_("Pitch:"),
   .cfg_type = VALUE_FLOAT, .csect = CFGSECT, .cname = "pitch",
-  .data = {.spin_btn = {MINPITCH, MAXPITCH, 0.05}}}};
+  .data = {.spin_btn = {MINPITCH, MAXPITCH, 0.05}}},
+ {WIDGET_COMBO_BOX, N_("Method:"),
+  .cfg_type = VALUE_STRING, .csect = CFGSECT, .cname = "method",
+  .data = {.combo = {method_list, sizeof method_list / sizeof method_list[0]}}},
+ {WIDGET_COMBO_BOX, N_("Pitch shifting:"),
+  .cfg_type = VALUE_STRING, .csect = CFGSECT, .cname = "pitch-method",
+  .data = {.combo = {pitch_method_list, sizeof pitch_method_list / sizeof pitch_method_list[0]}}},
+ {WIDGET_COMBO_BOX, N_("Frame size (samples):"), .child = TRUE,
+  .cfg_type = VALUE_STRING, .csect = CFGSECT, .cname = "frame-size",
+  .data = {.combo = {frame_size_list, sizeof frame_size_list / sizeof frame_size_list[0]}}}};
 
 static const PluginPreferences speed_prefs = {
  .widgets = speed_widgets,
@@ -239,7 +369,7 @@ static const PluginPreferences speed_prefs = {
 static bool_t speed_init (void)
 {
     aud_config_set_defaults (CFGSECT, speed_defaults);
-    return TRUE;
+    return (slots = scratch_reserve (2)) >= 0;
 }
 
 static void speed_cleanup (void)
@@ -252,13 +382,16 @@ static void speed_cleanup (void)
     free (cosine);
     cosine = NULL;
 
-    free (in.mem);
+    wsola_cleanup ();
+    pvoc_cleanup ();
+
+    aligned_free (& in.alloc);
     in.mem = NULL;
-    in.size = 0;
 
-    free (out.mem);
+    aligned_free (& out.alloc);
     out.mem = NULL;
-    out.size = 0;
+
+    scratch_release (slots, 2);
 }
 
 AUD_EFFECT_PLUGIN
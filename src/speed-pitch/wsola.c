@@ -0,0 +1,373 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* WSOLA (waveform-similarity overlap-add) works like the plain overlap-add
+ * algorithm, except that each piece of input is not taken exactly at its
+ * nominal position.  Instead, we search a small neighborhood of that position
+ * for the piece that best continues the previous one, measured by normalized
+ * cross-correlation of a mono mix.  This avoids most of the phasing artifacts
+ * of plain overlap-add, which in turn lets us use a shorter window and a
+ * 50% overlap.
+ *
+ * The search is done in two passes: first over the whole neighborhood using a
+ * copy of the mono mix decimated to about 6 kHz (adequate for finding the
+ * period of the waveform), then at the full rate only around the best
+ * decimated match.
+ *
+ * Input is kept in a "double-mapped" ring buffer: each frame is stored twice,
+ * once in each half, so that any window of up to the ring size can be read as a
+ * contiguous block and nothing ever needs to be moved. */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON) || defined (__ARM_NEON__)
+#include <arm_neon.h>
+#define HAVE_NEON
+#endif
+
+#include "scratch.h"
+#include "wsola.h"
+
+#define WINDOW_TIME 40 /* ms */
+#define SEARCH_TIME 12 /* ms, in each direction */
+#define COARSE_RATE 6000 /* Hz, rate of the first search pass */
+
+#define MIN(a,b) ((a) < (b) ? (a) : (b))
+#define MAX(a,b) ((a) > (b) ? (a) : (b))
+
+static int chans;
+static int width, half, search; /* frames */
+static int decim, coarse_len;   /* frames per decimated value, values compared */
+static float * window;          /* interleaved, one value per sample */
+
+static int ring_size;           /* frames; the buffers hold twice as many */
+static float * ring, * mono, * coarse; /* coarse holds ring_size / decim */
+static int64_t ring_start, ring_end; /* absolute positions of frames held */
+
+static int64_t next;            /* nominal position of the next piece */
+static int64_t natural;         /* position that would continue the last one */
+static int first, trim;
+static double expect;           /* output frames due for the input so far */
+static int64_t emitted;         /* output frames returned so far */
+static float * tail;            /* second half of the last piece, windowed */
+
+static int out_slot;            /* scratch */
+static float * output;
+static int output_filled;
+
+/* Computes the correlation of a with b along with the energy of a. */
+static void correlate (const float * a, const float * b, int n, float * corr,
+ float * energy)
+{
+    int i = 0;
+    float c = 0, e = 0;
+
+#if defined (__SSE2__)
+    __m128 vc = _mm_setzero_ps (), ve = _mm_setzero_ps ();
+
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_loadu_ps (a + i);
+        vc = _mm_add_ps (vc, _mm_mul_ps (va, _mm_loadu_ps (b + i)));
+        ve = _mm_add_ps (ve, _mm_mul_ps (va, va));
+    }
+
+    float pc[4], pe[4];
+    _mm_storeu_ps (pc, vc);
+    _mm_storeu_ps (pe, ve);
+    c = (pc[0] + pc[1]) + (pc[2] + pc[3]);
+    e = (pe[0] + pe[1]) + (pe[2] + pe[3]);
+#elif defined (HAVE_NEON)
+    float32x4_t vc = vdupq_n_f32 (0), ve = vdupq_n_f32 (0);
+
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t va = vld1q_f32 (a + i);
+        vc = vmlaq_f32 (vc, va, vld1q_f32 (b + i));
+        ve = vmlaq_f32 (ve, va, va);
+    }
+
+    float pc[4], pe[4];
+    vst1q_f32 (pc, vc);
+    vst1q_f32 (pe, ve);
+    c = (pc[0] + pc[1]) + (pc[2] + pc[3]);
+    e = (pe[0] + pe[1]) + (pe[2] + pe[3]);
+#endif
+
+    for (; i < n; i ++)
+    {
+        c += a[i] * b[i];
+        e += a[i] * a[i];
+    }
+
+    * corr = c;
+    * energy = e;
+}
+
+void wsola_start (int new_chans, int rate, int slot)
+{
+    out_slot = slot;
+    chans = new_chans;
+    width = (rate * WINDOW_TIME / 1000) & ~1;
+    half = width / 2;
+    search = rate * SEARCH_TIME / 1000;
+    decim = MAX (rate / COARSE_RATE, 1);
+    coarse_len = half / decim;
+
+    /* Room for the search range, two windows, and the largest input step
+     * (four output steps at double speed and half pitch), rounded up to whole
+     * decimated values. */
+    ring_size = 2 * search + 2 * width + 4 * half;
+    ring_size = (ring_size + decim - 1) / decim * decim;
+
+    /* Hann window, which sums to unity at 50% overlap. */
+    window = realloc (window, sizeof (float) * width * chans);
+    for (int i = 0; i < width; i ++)
+    for (int c = 0; c < chans; c ++)
+        window[i * chans + c] = (1.0 - cos (2.0 * M_PI * i / width)) / 2;
+
+    ring = realloc (ring, sizeof (float) * 2 * ring_size * chans);
+    mono = realloc (mono, sizeof (float) * 2 * ring_size);
+    coarse = realloc (coarse, sizeof (float) * 2 * (ring_size / decim));
+    tail = realloc (tail, sizeof (float) * half * chans);
+
+    wsola_flush ();
+}
+
+static void push (const float * data, int frames)
+{
+    int at = ring_end % ring_size;
+    int block = at / decim, phase = at % decim;
+
+    for (int f = 0; f < frames; f ++)
+    {
+        float * set = ring + at * chans;
+        float sum = 0;
+
+        for (int c = 0; c < chans; c ++)
+        {
+            float val = data ? data[f * chans + c] : 0;
+            set[c] = set[ring_size * chans + c] = val;
+            sum += val;
+        }
+
+        mono[at] = mono[ring_size + at] = sum;
+
+        /* Each decimated value is the sum of <decim> consecutive frames. */
+        if (phase)
+            sum += coarse[block];
+
+        coarse[block] = coarse[ring_size / decim + block] = sum;
+
+        if (++ phase == decim)
+        {
+            phase = 0;
+            block ++;
+        }
+
+        if (++ at == ring_size)
+            at = block = 0;
+    }
+
+    ring_end += frames;
+}
+
+void wsola_flush (void)
+{
+    ring_start = ring_end = 0;
+    next = natural = 0;
+    first = 1;
+    expect = 0;
+    emitted = 0;
+
+    memset (tail, 0, sizeof (float) * half * chans);
+
+    /* Start with half a window of silence, trimmed again from the output, so
+     * that the beginning of the song is not faded in. */
+    push (NULL, half);
+    trim = half;
+}
+
+static float * output_grow (int frames)
+{
+    float * set = output + output_filled * chans;
+    output_filled += frames;
+    return set;
+}
+
+/* Finds the position from <from> to <to> in <buf>, a double-mapped ring of
+ * <size> values, that best matches the <len> values at <ref>. */
+static int64_t search_range (const float * buf, int size, int64_t from,
+ int64_t to, const float * ref, int len)
+{
+    int64_t best = from;
+    float best_score = -INFINITY;
+
+    for (int64_t pos = from; pos <= to; pos ++)
+    {
+        float corr, energy;
+        correlate (buf + pos % size, ref, len, & corr, & energy);
+
+        float score = corr / sqrtf (energy + 1e-9f);
+        if (score > best_score)
+        {
+            best_score = score;
+            best = pos;
+        }
+    }
+
+    return best;
+}
+
+static int64_t find_best (void)
+{
+    int64_t lo = MAX (next - search, ring_start);
+    int64_t hi = next + search;
+
+    if (first)
+        return next;
+
+    /* First pass: the reference starts at the first whole decimated value
+     * after <natural>, <offset> frames in, and candidates are shifted to
+     * match.  Values from before <ring_start> may be partly overwritten. */
+    int64_t ref = (natural + decim - 1) / decim;
+    int offset = ref * decim - natural;
+    int64_t from = MAX (lo + offset + decim - 1, ring_start + decim - 1) / decim;
+    int64_t to = (hi + offset) / decim;
+    int64_t best = next;
+
+    if (from <= to)
+    {
+        int size = ring_size / decim;
+        best = search_range (coarse, size, from, to, coarse + ref % size,
+         coarse_len) * decim - offset;
+    }
+
+    /* Second pass: refine at the full rate. */
+    return search_range (mono, ring_size, MAX (lo, best - decim + 1),
+     MIN (hi, best + decim - 1), mono + natural % ring_size, half);
+}
+
+static void run_steps (int instep, int64_t limit)
+{
+    int samples = half * chans;
+
+    while (next < limit && ring_end >= next + search + width)
+    {
+        int64_t pos = find_best ();
+        const float * seg = ring + (pos % ring_size) * chans;
+        float * set = output_grow (half);
+
+        for (int i = 0; i < samples; i ++)
+            set[i] = tail[i] + seg[i] * window[i];
+        for (int i = 0; i < samples; i ++)
+            tail[i] = seg[samples + i] * window[samples + i];
+
+        natural = pos + half;
+        next += instep;
+        first = 0;
+
+        /* Release input that no future search can reach. */
+        ring_start = MAX (ring_start, MIN (next - search, natural));
+    }
+}
+
+void wsola_process (const float * data, int frames, int instep, int ending,
+ float * * out, int * out_frames)
+{
+    /* Each step takes <instep> frames past <next> and puts out <half>; when
+     * ending, the steps run until the end of the input, and the tail follows.
+     * Two more than that is room enough. */
+    int64_t steps = MAX (ring_end + frames - next, 0) / instep + 2;
+
+    output = scratch_get (out_slot, (steps + 1) * half * chans);
+    output_filled = 0;
+    expect += (double) frames * half / instep;
+
+    while (frames > 0)
+    {
+        int copy = MIN (frames, ring_size - (int) (ring_end - ring_start));
+
+        push (data, copy);
+        data += copy * chans;
+        frames -= copy;
+
+        run_steps (instep, INT64_MAX);
+    }
+
+    if (ending)
+    {
+        /* Pad with silence until every piece of the real input is used. */
+        int64_t real_end = ring_end;
+
+        while (next < real_end)
+        {
+            int64_t need = next + search + width - ring_end;
+            int copy = MIN (need, ring_size - (int) (ring_end - ring_start));
+
+            if (copy > 0)
+                push (NULL, copy);
+
+            run_steps (instep, real_end);
+        }
+
+        memcpy (output_grow (half), tail, sizeof (float) * half * chans);
+    }
+
+    int cut = MIN (trim, output_filled);
+    trim -= cut;
+
+    * out = output + cut * chans;
+    * out_frames = output_filled - cut;
+
+    /* Likewise trim the silence that was added at the end. */
+    if (ending)
+        * out_frames = MIN (* out_frames, MAX (llround (expect) - emitted, 0));
+
+    emitted += * out_frames;
+
+    if (ending)
+        wsola_flush ();
+}
+
+int wsola_outstep (void)
+{
+    return half;
+}
+
+int wsola_latency (void)
+{
+    return width + search;
+}
+
+void wsola_cleanup (void)
+{
+    free (window);
+    free (ring);
+    free (mono);
+    free (coarse);
+    free (tail);
+
+    window = ring = mono = coarse = tail = output = NULL;
+}
@@ -0,0 +1,38 @@
+/*
+ * Speed and Pitch effect plugin for Audacious
+ * Copyright 2013 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef SPEED_PITCH_WSOLA_H
+#define SPEED_PITCH_WSOLA_H
+
+/* Precomputes the window, step and search sizes for a new format. */
+void wsola_start (int chans, int rate, int slot);
+void wsola_flush (void);
+void wsola_cleanup (void);
+
+/* Output step in frames; the input step is this times the speed ratio. */
+int wsola_outstep (void);
+int wsola_latency (void);
+
+/* Processes <frames> interleaved frames, consuming the input at <instep>
+ * frames per output step.  The returned buffer is valid until the next call.
+ * If <ending> is set, all remaining audio is returned. */
+void wsola_process (const float * data, int frames, int instep, int ending,
+ float * * out, int * out_frames);
+
+#endif
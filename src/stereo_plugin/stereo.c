@@ -2,7 +2,14 @@
  * Written by Johan Levin, 1999
  * Modified by John Lindgren, 2009-2012 */
 
+/* The intensity (width) scales the side part of the signal, as before; the
+ * mid and side gains and the center cancellation are applied in the same
+ * pass. */
+
+#include <math.h>
+
 #include "config.h"
+#include "midside.h"
 
 #include <audacious/i18n.h>
 #include <audacious/misc.h>
@@ -21,13 +28,26 @@ static const char stereo_about[] =
 
 static const char * const stereo_defaults[] = {
  "intensity", "2.5",
+ "mid_gain", "0",
+ "side_gain", "0",
+ "center_cancel", "0",
  NULL};
 
 static const PreferencesWidget stereo_widgets[] = {
  {WIDGET_LABEL, N_("<b>Extra Stereo</b>")},
- {WIDGET_SPIN_BTN, N_("Intensity:"),
+ {WIDGET_SPIN_BTN, N_("Width:"),
   .cfg_type = VALUE_FLOAT, .csect = "extra_stereo", .cname = "intensity",
-  .data = {.spin_btn = {0, 10, 0.1}}}};
+  .data = {.spin_btn = {0, 10, 0.1}}},
+ {WIDGET_LABEL, N_("<b>Mid/Side</b>")},
+ {WIDGET_SPIN_BTN, N_("Mid gain:"),
+  .cfg_type = VALUE_FLOAT, .csect = "extra_stereo", .cname = "mid_gain",
+  .data = {.spin_btn = {-24, 24, 0.5, N_("dB")}}},
+ {WIDGET_SPIN_BTN, N_("Side gain:"),
+  .cfg_type = VALUE_FLOAT, .csect = "extra_stereo", .cname = "side_gain",
+  .data = {.spin_btn = {-24, 24, 0.5, N_("dB")}}},
+ {WIDGET_SPIN_BTN, N_("Center cancellation:"),
+  .cfg_type = VALUE_INT, .csect = "extra_stereo", .cname = "center_cancel",
+  .data = {.spin_btn = {0, 100, 1, "%"}}}};
 
 static const PluginPreferences stereo_prefs = {
  .widgets = stereo_widgets,
@@ -61,21 +81,15 @@ static void stereo_start (int * channels, int * rate)
 
 static void stereo_process (float * * data, int * samples)
 {
-    float value = aud_get_double ("extra_stereo", "intensity");
-    float * f, * end;
-    float center;
-
-    if (stereo_channels != 2 || samples == 0)
-        return;
+    float width = aud_get_double ("extra_stereo", "intensity");
+    float mid_gain = aud_get_double ("extra_stereo", "mid_gain");
+    float side_gain = aud_get_double ("extra_stereo", "side_gain");
+    int cancel = aud_get_int ("extra_stereo", "center_cancel");
 
-    end = (* data) + (* samples);
+    float mid = powf (10, mid_gain / 20) * (100 - cancel) / 100;
+    float side = powf (10, side_gain / 20) * width;
 
-    for (f = * data; f < end; f += 2)
-    {
-        center = (f[0] + f[1]) / 2;
-        f[0] = center + (f[0] - center) * value;
-        f[1] = center + (f[1] - center) * value;
-    }
+    midside_run (* data, * samples / stereo_channels, stereo_channels, mid, side);
 }
 
 static void stereo_finish (float * * data, int * samples)
@@ -22,6 +22,7 @@
 #include <audacious/plugin.h>
 
 #include "config.h"
+#include "midside.h"
 
 static int voice_channels;
 
@@ -30,24 +31,10 @@ static void voice_start(int *channels, int *rate)
 	voice_channels = *channels;
 }
 
+/* left = R - L, right = L - R: no mid, and the side doubled and inverted */
 static void voice_process(float **d, int *samples)
 {
-	float *f = *d, *end;
-	end = *d + *samples;
-
-	if (voice_channels != 2 || samples == 0)
-		return;
-
-	for (f = *d; f < end; f += 2)
-	{
-		float left, right;
-
-		left = (f[1] - f[0]);
-		right = (f[0] - f[1]);
-
-		f[0] = left;
-		f[1] = right;
-	}
+	midside_run(*d, *samples / voice_channels, voice_channels, 0, -2);
 }
 
 static void voice_finish(float **d, int *samples)